@@ -41,7 +41,7 @@
 #define BINSTEP (2.0 * M_PI / (NX * STEP))   // Assumes NX = NY = NZ
 #define DENS_EPS 1E-3
 
-/* Predict-correct? (not available for 4th order splitting) */
+/* Predict-correct? (not available for 4th order splitting - use dft_ot_propagate() instead) */
 //#define PC
 
 /* Use dealiasing during real time propagation? */
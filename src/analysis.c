@@ -0,0 +1,300 @@
+/*
+ * Analysis bundle for wave functions.
+ *
+ * The observables are declared when the bundle is allocated (DFT_ANALYSIS_*
+ * flags) and dft_analysis_compute() then evaluates all of them together so
+ * that the shared intermediates are computed only once:
+ *
+ *   - one FFT of psi gives both occupation spectra and the total kinetic energy,
+ *   - the probability flux J is computed once and used for the vorticity and
+ *     for the kinetic energy spectra,
+ *   - sqrt(rho) v = J / sqrt(rho) is transformed once per component, after which
+ *     the total, incompressible and compressible spectra are obtained from a
+ *     single pass over the Fourier space (Helmholtz decomposition in k-space).
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <grid/grid.h>
+#include <grid/au.h>
+#include "dft.h"
+#include "ot.h"
+
+/*
+ * Allocate analysis bundle.
+ *
+ * otf     = OT functional structure (input; dft_ot_functional *).
+ * gwf     = Wave function to be analyzed (input; wf *). Only used for grid dimensions.
+ * what    = Requested observables (input; INT). Bitwise or of DFT_ANALYSIS_OCC_AVG,
+ *           DFT_ANALYSIS_OCC_TOT, DFT_ANALYSIS_KE, DFT_ANALYSIS_FLUX and DFT_ANALYSIS_ENERGY.
+ * binstep = Bin width in k for the spectra (input; REAL).
+ * nbins   = Number of bins in the spectra (input; INT).
+ * eps     = Epsilon for dividing by the density (input; REAL).
+ *
+ * Returns pointer to the analysis bundle (NULL on error).
+ *
+ */
+
+EXPORT dft_analysis *dft_analysis_alloc(dft_ot_functional *otf, wf *gwf, INT what, REAL binstep, INT nbins, REAL eps) {
+
+  dft_analysis *a;
+
+  if(binstep <= 0.0 || nbins < 1) {
+    fprintf(stderr, "libdft: Illegal parameters in dft_analysis_alloc().\n");
+    return NULL;
+  }
+  if(!(a = (dft_analysis *) malloc(sizeof(dft_analysis)))) {
+    fprintf(stderr, "libdft: Error in dft_analysis_alloc(): Could not allocate memory.\n");
+    return NULL;
+  }
+  a->what = what;
+  a->nbins = nbins;
+  a->binstep = binstep;
+  a->eps = eps;
+  a->occ_avg = a->occ_tot = a->ke = a->ke_incomp = a->ke_comp = NULL;
+  a->natoms = a->ke_total = a->ke_cl = a->ke_qp = a->ke_incomp_total = a->ke_comp_total = 0.0;
+  a->vorticity = a->energy = 0.0;
+  a->density = a->flux_x = a->flux_y = a->flux_z = a->wx = a->wy = a->wz = a->work = NULL;
+  a->psik = NULL;
+
+  if(what & DFT_ANALYSIS_OCC_AVG)
+    if(!(a->occ_avg = (REAL *) malloc(sizeof(REAL) * (size_t) nbins))) goto error;
+  if(what & DFT_ANALYSIS_OCC_TOT)
+    if(!(a->occ_tot = (REAL *) malloc(sizeof(REAL) * (size_t) nbins))) goto error;
+  if(what & DFT_ANALYSIS_KE) {
+    if(!(a->ke = (REAL *) malloc(sizeof(REAL) * (size_t) nbins))) goto error;
+    if(!(a->ke_incomp = (REAL *) malloc(sizeof(REAL) * (size_t) nbins))) goto error;
+    if(!(a->ke_comp = (REAL *) malloc(sizeof(REAL) * (size_t) nbins))) goto error;
+  }
+
+  a->psik = cgrid_clone(gwf->grid, "dft_analysis psik");
+  a->density = rgrid_clone(otf->density, "dft_analysis density");
+  a->work = rgrid_clone(otf->density, "dft_analysis work");
+  if(what & (DFT_ANALYSIS_KE | DFT_ANALYSIS_FLUX)) {
+    a->flux_x = rgrid_clone(otf->density, "dft_analysis flux_x");
+    a->flux_y = rgrid_clone(otf->density, "dft_analysis flux_y");
+    a->flux_z = rgrid_clone(otf->density, "dft_analysis flux_z");
+  }
+  if(what & DFT_ANALYSIS_KE) {
+    a->wx = rgrid_clone(otf->density, "dft_analysis wx");
+    a->wy = rgrid_clone(otf->density, "dft_analysis wy");
+    a->wz = rgrid_clone(otf->density, "dft_analysis wz");
+  }
+  return a;
+
+error:
+  fprintf(stderr, "libdft: Error in dft_analysis_alloc(): Could not allocate memory.\n");
+  dft_analysis_free(a);
+  return NULL;
+}
+
+/*
+ * Free analysis bundle.
+ *
+ * a = Analysis bundle to be freed (input; dft_analysis *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_analysis_free(dft_analysis *a) {
+
+  if(!a) return;
+  if(a->occ_avg) free(a->occ_avg);
+  if(a->occ_tot) free(a->occ_tot);
+  if(a->ke) free(a->ke);
+  if(a->ke_incomp) free(a->ke_incomp);
+  if(a->ke_comp) free(a->ke_comp);
+  if(a->psik) cgrid_free(a->psik);
+  if(a->density) rgrid_free(a->density);
+  if(a->work) rgrid_free(a->work);
+  if(a->flux_x) rgrid_free(a->flux_x);
+  if(a->flux_y) rgrid_free(a->flux_y);
+  if(a->flux_z) rgrid_free(a->flux_z);
+  if(a->wx) rgrid_free(a->wx);
+  if(a->wy) rgrid_free(a->wy);
+  if(a->wz) rgrid_free(a->wz);
+  free(a);
+}
+
+/*
+ * Occupations and total kinetic energy from psi in Fourier space.
+ *
+ */
+
+static void dft_analysis_psik(dft_analysis *a, wf *gwf) {
+
+  cgrid *grid = a->psik;
+  INT i, j, k, ib, nx = grid->nx, ny = grid->ny, nz = grid->nz, nbins = a->nbins;
+  REAL kx, ky, kz, k2, kk, occ, natoms = 0.0, ke = 0.0, *count = NULL;
+  REAL step = grid->step, norm = step * step * step / (((REAL) nx) * ((REAL) ny) * ((REAL) nz));
+  REAL dkx = 2.0 * M_PI / (((REAL) nx) * step), dky = 2.0 * M_PI / (((REAL) ny) * step), dkz = 2.0 * M_PI / (((REAL) nz) * step);
+  REAL kx0 = gwf->grid->kx0, ky0 = gwf->grid->ky0, kz0 = gwf->grid->kz0;
+  REAL complex *val;
+
+  cgrid_copy(grid, gwf->grid);
+  cgrid_fft(grid);
+
+  if(a->occ_avg) {
+    if(!(count = (REAL *) malloc(sizeof(REAL) * (size_t) nbins))) {
+      fprintf(stderr, "libdft: Error in dft_analysis_compute(): Could not allocate memory.\n");
+      exit(1);
+    }
+    for(ib = 0; ib < nbins; ib++)
+      a->occ_avg[ib] = count[ib] = 0.0;
+  }
+  if(a->occ_tot)
+    for(ib = 0; ib < nbins; ib++)
+      a->occ_tot[ib] = 0.0;
+
+#ifdef GRID_MGPU
+  cgrid_host_lock(grid);
+#endif
+  val = grid->value;
+  for(i = 0; i < nx; i++) {
+    kx = ((REAL) ((i < nx / 2)?i:(i - nx))) * dkx;
+    for(j = 0; j < ny; j++) {
+      ky = ((REAL) ((j < ny / 2)?j:(j - ny))) * dky;
+      for(k = 0; k < nz; k++) {
+        kz = ((REAL) ((k < nz / 2)?k:(k - nz))) * dkz;
+        occ = norm * CREAL(val[(i * ny + j) * nz + k] * CONJ(val[(i * ny + j) * nz + k]));
+        natoms += occ;
+        ke += occ * ((kx - kx0) * (kx - kx0) + (ky - ky0) * (ky - ky0) + (kz - kz0) * (kz - kz0));
+        k2 = kx * kx + ky * ky + kz * kz;
+        kk = SQRT(k2);
+        ib = (INT) (kk / a->binstep);
+        if(ib >= nbins) continue;
+        if(a->occ_avg) {
+          a->occ_avg[ib] += occ;
+          count[ib] += 1.0;
+        }
+        if(a->occ_tot) a->occ_tot[ib] += occ;
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  cgrid_host_unlock(grid);
+#endif
+
+  if(a->occ_avg) {
+    for(i = 0; i < nbins; i++)
+      if(count[i] > 0.0) a->occ_avg[i] /= count[i];
+    free(count);
+  }
+  a->natoms = natoms;
+  a->ke_total = HBAR * HBAR * ke / (2.0 * gwf->mass);
+}
+
+/*
+ * Kinetic energy spectra from sqrt(rho) v in Fourier space.
+ *
+ */
+
+static void dft_analysis_spectra(dft_analysis *a, wf *gwf) {
+
+  rgrid *wx = a->wx, *wy = a->wy, *wz = a->wz;
+  INT i, j, k, ib, idx, nx = wx->nx, ny = wx->ny, nz = wx->nz, nzz = wx->nz2 / 2, nbins = a->nbins;
+  REAL kx, ky, kz, k2, tot, comp, weight, ke_cl = 0.0, ke_comp = 0.0, ke_incomp = 0.0;
+  REAL step = wx->step, norm = 0.5 * gwf->mass * step * step * step / (((REAL) nx) * ((REAL) ny) * ((REAL) nz));
+  REAL dkx = 2.0 * M_PI / (((REAL) nx) * step), dky = 2.0 * M_PI / (((REAL) ny) * step), dkz = 2.0 * M_PI / (((REAL) nz) * step);
+  REAL complex *vx, *vy, *vz, dot;
+
+  /* w = J / sqrt(rho) = sqrt(rho) v, so that (m/2) rho v^2 = (m/2) w^2 */
+  rgrid_power(a->work, a->density, 0.5);
+  rgrid_division_eps(wx, a->flux_x, a->work, a->eps);
+  rgrid_division_eps(wy, a->flux_y, a->work, a->eps);
+  rgrid_division_eps(wz, a->flux_z, a->work, a->eps);
+  rgrid_fft(wx);
+  rgrid_fft(wy);
+  rgrid_fft(wz);
+
+  for(ib = 0; ib < nbins; ib++)
+    a->ke[ib] = a->ke_incomp[ib] = a->ke_comp[ib] = 0.0;
+
+#ifdef GRID_MGPU
+  rgrid_host_lock(wx);
+  rgrid_host_lock(wy);
+  rgrid_host_lock(wz);
+#endif
+  vx = (REAL complex *) wx->value;
+  vy = (REAL complex *) wy->value;
+  vz = (REAL complex *) wz->value;
+  for(i = 0; i < nx; i++) {
+    kx = ((REAL) ((i < nx / 2)?i:(i - nx))) * dkx;
+    for(j = 0; j < ny; j++) {
+      ky = ((REAL) ((j < ny / 2)?j:(j - ny))) * dky;
+      for(k = 0; k < nzz; k++) {
+        idx = (i * ny + j) * nzz + k;
+        kz = ((REAL) k) * dkz;
+        /* Half-complex storage: the other half of the z-axis is implicit except for k = 0 and the Nyquist plane */
+        weight = (k == 0 || (!(nz & 1) && k == nz / 2))?1.0:2.0;
+        tot = weight * norm * (CREAL(vx[idx] * CONJ(vx[idx])) + CREAL(vy[idx] * CONJ(vy[idx])) + CREAL(vz[idx] * CONJ(vz[idx])));
+        ke_cl += tot;
+        k2 = kx * kx + ky * ky + kz * kz;
+        if(k2 == 0.0) continue;  /* DC component: neither compressible nor incompressible */
+        dot = kx * vx[idx] + ky * vy[idx] + kz * vz[idx];
+        comp = weight * norm * CREAL(dot * CONJ(dot)) / k2;
+        ke_comp += comp;
+        ke_incomp += tot - comp;
+        ib = (INT) (SQRT(k2) / a->binstep);
+        if(ib >= nbins) continue;
+        a->ke[ib] += tot;
+        a->ke_comp[ib] += comp;
+        a->ke_incomp[ib] += tot - comp;
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(wx);
+  rgrid_host_unlock(wy);
+  rgrid_host_unlock(wz);
+#endif
+
+  /* Spectra as energy per unit k */
+  for(i = 0; i < nbins; i++) {
+    a->ke[i] /= a->binstep;
+    a->ke_comp[i] /= a->binstep;
+    a->ke_incomp[i] /= a->binstep;
+  }
+  a->ke_cl = ke_cl;
+  a->ke_comp_total = ke_comp;
+  a->ke_incomp_total = ke_incomp;
+  a->ke_qp = a->ke_total - ke_cl;
+}
+
+/*
+ * Compute all observables requested in the analysis bundle.
+ *
+ * a   = Analysis bundle (input/output; dft_analysis *).
+ * gwf = Wave function to be analyzed (input; wf *).
+ * otf = OT functional structure (input; dft_ot_functional *). Only used with DFT_ANALYSIS_ENERGY.
+ *
+ * The results are stored in the bundle: natoms, ke_total, density and psik are always
+ * available. The other fields are filled according to the requested observables.
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_analysis_compute(dft_analysis *a, wf *gwf, dft_ot_functional *otf) {
+
+  grid_wf_density(gwf, a->density);
+  dft_analysis_psik(a, gwf);
+
+  if(a->what & (DFT_ANALYSIS_KE | DFT_ANALYSIS_FLUX))
+    grid_wf_probability_flux(gwf, a->flux_x, a->flux_y, a->flux_z);
+
+  if(a->what & DFT_ANALYSIS_FLUX) {
+    rgrid_abs_rot(a->work, a->flux_x, a->flux_y, a->flux_z);
+    a->vorticity = rgrid_integral(a->work);
+  }
+
+  if(a->what & DFT_ANALYSIS_KE) dft_analysis_spectra(a, gwf);
+
+  if(a->what & DFT_ANALYSIS_ENERGY) {
+    dft_ot_energy_density(otf, a->work, gwf);
+    a->energy = a->ke_total + rgrid_integral(a->work);
+  }
+}
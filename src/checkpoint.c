@@ -0,0 +1,627 @@
+/*
+ * Checkpoint / restart files for OT calculations.
+ *
+ * A checkpoint holds the wave function, the functional model and parameters,
+ * the driver state (dft_ot_driver) and the simulation time. The wave function
+ * can be stored in the following modes:
+ *
+ * DFT_CHECKPOINT_DOUBLE  Lossless (restart is bit-identical).
+ * DFT_CHECKPOINT_FLOAT   Single precision.
+ * DFT_CHECKPOINT_LOSSY   Quantized with absolute error bound tol for the real and imaginary parts.
+ *
+ * Each value is converted to a 64 bit word (IEEE bit pattern or zigzag coded
+ * quantization index). With delta encoding the words are XORed (DOUBLE/FLOAT)
+ * or subtracted (LOSSY) with the words of the previous checkpoint, which
+ * leaves mostly zero bytes when the wave function changes little. The words
+ * are then byte shuffled (all first bytes, then all second bytes, ...) and
+ * the runs of zero bytes are run length encoded.
+ *
+ * A delta checkpoint stores the name of the checkpoint it refers to;
+ * dft_checkpoint_read() follows the chain back to the last full checkpoint.
+ * The writer keeps the names of all files in the current chain and writes a
+ * full checkpoint when a file in the chain would be overwritten, so file
+ * names may be reused freely (e.g., alternating between two restart files).
+ * Each file also records its position in the chain, the sequence number of
+ * its base and checksums of its own and the base's data. These are verified
+ * while following the chain, so an overwritten or wrong base file is detected
+ * (rather than silently decoding against it) and the chain length is bounded
+ * by full_every.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <grid/grid.h>
+#include <grid/au.h>
+#include "dft.h"
+#include "ot.h"
+
+#define DFT_CHECKPOINT_MAGIC "DFTCHK02"
+#define DFT_CHECKPOINT_NOTF 29       /* Number of functional parameters stored */
+
+struct dft_checkpoint_struct {
+  char mode;                /* DFT_CHECKPOINT_DOUBLE, DFT_CHECKPOINT_FLOAT or DFT_CHECKPOINT_LOSSY */
+  REAL tol;                 /* Error bound for DFT_CHECKPOINT_LOSSY */
+  INT full_every;           /* Write a full checkpoint after this many delta checkpoints (0 = never delta) */
+  INT seq;                  /* Number of checkpoints written */
+  INT ndelta;               /* Number of delta checkpoints since the last full checkpoint */
+  INT nwords;               /* Number of words in prev */
+  uint64_t *prev;           /* Words of the previous checkpoint */
+  uint64_t sum;             /* Checksum of prev */
+  INT nchain;               /* Number of files in the current chain (full checkpoint + ndelta deltas) */
+  char *chain;              /* File names in the current chain (full_every + 1 entries of DFT_CHECKPOINT_MAXNAME; last = previous checkpoint) */
+};
+
+/* Checkpoint file header */
+typedef struct {
+  int64_t ih[8];            /* mode, delta, nx, ny, nz, sequence, word size (bytes), functional model */
+  double dh[11];            /* step, x0, y0, z0, kx0, ky0, kz0, mass, tol, time, (reserved) */
+  char base[DFT_CHECKPOINT_MAXNAME]; /* Previous checkpoint (delta) */
+  int64_t chain[3];         /* position in the delta chain (0 = full), sequence number of the base, full_every */
+  uint64_t sum[2];          /* checksum of the words of this checkpoint, checksum of the words of the base */
+} dft_checkpoint_header;
+
+/*
+ * Allocate checkpoint writer.
+ *
+ * mode       = Storage mode: DFT_CHECKPOINT_DOUBLE, DFT_CHECKPOINT_FLOAT or DFT_CHECKPOINT_LOSSY (input; char).
+ * tol        = Absolute error bound for the real and imaginary parts in DFT_CHECKPOINT_LOSSY mode (input; REAL).
+ * full_every = Number of delta checkpoints between full checkpoints (input; INT). 0 = always full.
+ *
+ * Returns pointer to the checkpoint writer (NULL on error).
+ *
+ */
+
+EXPORT dft_checkpoint *dft_checkpoint_alloc(char mode, REAL tol, INT full_every) {
+
+  dft_checkpoint *chk;
+
+  if(mode != DFT_CHECKPOINT_DOUBLE && mode != DFT_CHECKPOINT_FLOAT && mode != DFT_CHECKPOINT_LOSSY) {
+    fprintf(stderr, "libdft: Unknown checkpoint mode.\n");
+    return NULL;
+  }
+  if(mode == DFT_CHECKPOINT_LOSSY && tol <= 0.0) {
+    fprintf(stderr, "libdft: Lossy checkpoint requires tol > 0.\n");
+    return NULL;
+  }
+  if(!(chk = (dft_checkpoint *) malloc(sizeof(dft_checkpoint)))) {
+    fprintf(stderr, "libdft: Error in dft_checkpoint_alloc(): Could not allocate memory.\n");
+    return NULL;
+  }
+  if(full_every < 0) full_every = 0;
+  if(!(chk->chain = (char *) malloc((size_t) (DFT_CHECKPOINT_MAXNAME * (full_every + 1))))) {
+    fprintf(stderr, "libdft: Error in dft_checkpoint_alloc(): Could not allocate memory.\n");
+    free(chk);
+    return NULL;
+  }
+  chk->mode = mode;
+  chk->tol = tol;
+  chk->full_every = full_every;
+  chk->seq = 0;
+  chk->ndelta = 0;
+  chk->nwords = 0;
+  chk->prev = NULL;
+  chk->sum = 0;
+  chk->nchain = 0;
+  return chk;
+}
+
+/*
+ * Free checkpoint writer.
+ *
+ * chk = Checkpoint writer (input; dft_checkpoint *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_checkpoint_free(dft_checkpoint *chk) {
+
+  if(!chk) return;
+  if(chk->prev) free(chk->prev);
+  free(chk->chain);
+  free(chk);
+}
+
+/*
+ * Convert the wave function to words. words has 2 * nx * ny * nz elements.
+ *
+ */
+
+static void dft_checkpoint_words(cgrid *grid, char mode, REAL tol, uint64_t *words) {
+
+  INT i, n = grid->nx * grid->ny * grid->nz;
+  REAL complex *value;
+  double d[2];
+  float f[2];
+  int64_t q;
+  uint32_t u;
+  INT c;
+
+#ifdef GRID_MGPU
+  cgrid_host_lock(grid);
+#endif
+  value = grid->value;
+#pragma omp parallel for firstprivate(n,value,mode,tol,words) private(i,d,f,q,u,c) default(none) schedule(runtime)
+  for(i = 0; i < n; i++) {
+    d[0] = (double) CREAL(value[i]);
+    d[1] = (double) CIMAG(value[i]);
+    for(c = 0; c < 2; c++) {
+      switch(mode) {
+      case DFT_CHECKPOINT_DOUBLE:
+        memcpy(&words[2 * i + c], &d[c], sizeof(uint64_t));
+        break;
+      case DFT_CHECKPOINT_FLOAT:
+        f[c] = (float) d[c];
+        memcpy(&u, &f[c], sizeof(uint32_t));
+        words[2 * i + c] = (uint64_t) u;
+        break;
+      default: /* lossy: zigzag coded quantization index */
+        q = (int64_t) llround(d[c] / (2.0 * tol));
+        words[2 * i + c] = ((uint64_t) q << 1) ^ (uint64_t) (q >> 63);
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  cgrid_host_unlock(grid);
+#endif
+}
+
+/*
+ * Convert words back to the wave function.
+ *
+ */
+
+static void dft_checkpoint_unwords(cgrid *grid, char mode, REAL tol, uint64_t *words) {
+
+  INT i, n = grid->nx * grid->ny * grid->nz;
+  REAL complex *value;
+  double d[2];
+  float f;
+  int64_t q;
+  uint32_t u;
+  INT c;
+
+#ifdef GRID_MGPU
+  cgrid_host_lock(grid);
+#endif
+  value = grid->value;
+#pragma omp parallel for firstprivate(n,value,mode,tol,words) private(i,d,f,q,u,c) default(none) schedule(runtime)
+  for(i = 0; i < n; i++) {
+    for(c = 0; c < 2; c++) {
+      switch(mode) {
+      case DFT_CHECKPOINT_DOUBLE:
+        memcpy(&d[c], &words[2 * i + c], sizeof(double));
+        break;
+      case DFT_CHECKPOINT_FLOAT:
+        u = (uint32_t) words[2 * i + c];
+        memcpy(&f, &u, sizeof(float));
+        d[c] = (double) f;
+        break;
+      default:
+        q = (int64_t) (words[2 * i + c] >> 1) ^ -(int64_t) (words[2 * i + c] & 1);
+        d[c] = 2.0 * tol * (double) q;
+      }
+    }
+    value[i] = (REAL) d[0] + I * (REAL) d[1];
+  }
+#ifdef GRID_MGPU
+  cgrid_host_unlock(grid);
+#endif
+  cgrid_fft_space(grid, 0);
+}
+
+/*
+ * Checksum of words (independent of the summation order, so it can be computed in parallel).
+ *
+ */
+
+static uint64_t dft_checkpoint_checksum(uint64_t *words, INT n) {
+
+  INT i;
+  uint64_t h, sum = 0;
+
+#pragma omp parallel for firstprivate(n,words) private(i,h) reduction(+:sum) default(none) schedule(runtime)
+  for(i = 0; i < n; i++) {
+    /* splitmix64 finalizer of the word combined with its position */
+    h = words[i] ^ ((uint64_t) i * 0x9E3779B97F4A7C15ULL);
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    sum += h ^ (h >> 31);
+  }
+  return sum;
+}
+
+/*
+ * Delta coding with respect to the previous words (XOR for bit patterns, difference for lossy).
+ * encode = 1: words = words - prev and prev = (original) words; encode = 0: words = words + prev.
+ *
+ */
+
+static void dft_checkpoint_delta(uint64_t *words, uint64_t *prev, INT n, char mode, char encode) {
+
+  INT i;
+  int64_t a, b;
+  uint64_t w;
+
+#pragma omp parallel for firstprivate(n,words,prev,mode,encode) private(i,a,b,w) default(none) schedule(runtime)
+  for(i = 0; i < n; i++) {
+    w = words[i];
+    if(mode != DFT_CHECKPOINT_LOSSY) words[i] = w ^ prev[i];
+    else {
+      a = (int64_t) (w >> 1) ^ -(int64_t) (w & 1);
+      b = (int64_t) (prev[i] >> 1) ^ -(int64_t) (prev[i] & 1);
+      a = encode?(a - b):(a + b);
+      words[i] = ((uint64_t) a << 1) ^ (uint64_t) (a >> 63);
+    }
+    if(encode) prev[i] = w;
+  }
+}
+
+/*
+ * Variable length integer I/O.
+ *
+ */
+
+static char dft_checkpoint_put_varint(FILE *fp, uint64_t v) {
+
+  unsigned char c;
+
+  do {
+    c = (unsigned char) (v & 0x7f);
+    v >>= 7;
+    if(v) c |= 0x80;
+    if(fputc(c, fp) == EOF) return 0;
+  } while(v);
+  return 1;
+}
+
+static char dft_checkpoint_get_varint(FILE *fp, uint64_t *v) {
+
+  int c, shift = 0;
+
+  *v = 0;
+  do {
+    if((c = fgetc(fp)) == EOF || shift > 63) return 0;
+    *v |= ((uint64_t) (c & 0x7f)) << shift;
+    shift += 7;
+  } while(c & 0x80);
+  return 1;
+}
+
+/*
+ * Write words: byte shuffle + zero run length encoding. Tokens are varint(length << 1 | zero)
+ * followed by the literal bytes when zero = 0.
+ *
+ */
+
+static char dft_checkpoint_put_words(FILE *fp, uint64_t *words, INT n, INT wsize) {
+
+  INT b, i, j;
+  unsigned char *plane;
+  char ok = 1;
+
+  if(!(plane = (unsigned char *) malloc((size_t) n))) {
+    fprintf(stderr, "libdft: Error in dft_checkpoint_write(): Could not allocate memory.\n");
+    exit(1);
+  }
+  for(b = 0; b < wsize && ok; b++) {
+#pragma omp parallel for firstprivate(n,words,plane,b) private(i) default(none) schedule(runtime)
+    for(i = 0; i < n; i++)
+      plane[i] = (unsigned char) (words[i] >> (8 * b));
+    for(i = 0; i < n && ok; i = j) {
+      if(!plane[i]) {
+        for(j = i; j < n && !plane[j]; j++);
+        ok = dft_checkpoint_put_varint(fp, (((uint64_t) (j - i)) << 1) | 1);
+      } else {
+        /* literal run ends at the first run of at least 4 zeros */
+        for(j = i; j < n; j++)
+          if(!plane[j] && j + 3 < n && !plane[j+1] && !plane[j+2] && !plane[j+3]) break;
+        ok = dft_checkpoint_put_varint(fp, ((uint64_t) (j - i)) << 1) && fwrite(plane + i, 1, (size_t) (j - i), fp) == (size_t) (j - i);
+      }
+    }
+  }
+  free(plane);
+  return ok;
+}
+
+static char dft_checkpoint_get_words(FILE *fp, uint64_t *words, INT n, INT wsize) {
+
+  INT b, i, len;
+  uint64_t tok;
+  unsigned char *plane;
+  char ok = 1;
+
+  if(!(plane = (unsigned char *) malloc((size_t) n))) {
+    fprintf(stderr, "libdft: Error in dft_checkpoint_read(): Could not allocate memory.\n");
+    exit(1);
+  }
+  for(i = 0; i < n; i++) words[i] = 0;
+  for(b = 0; b < wsize && ok; b++) {
+    for(i = 0; i < n && ok; i += len) {
+      if(!(ok = dft_checkpoint_get_varint(fp, &tok))) break;
+      len = (INT) (tok >> 1);
+      if(len < 1 || i + len > n) {
+        ok = 0;
+        break;
+      }
+      if(tok & 1) memset(plane + i, 0, (size_t) len);
+      else ok = fread(plane + i, 1, (size_t) len, fp) == (size_t) len;
+    }
+    if(!ok) break;
+#pragma omp parallel for firstprivate(n,words,plane,b) private(i) default(none) schedule(runtime)
+    for(i = 0; i < n; i++)
+      words[i] |= ((uint64_t) plane[i]) << (8 * b);
+  }
+  free(plane);
+  return ok;
+}
+
+/*
+ * Functional parameters as an array.
+ *
+ */
+
+static void dft_checkpoint_otf_params(dft_ot_functional *otf, double *p) {
+
+  p[0] = otf->b; p[1] = otf->c2; p[2] = otf->c2_exp; p[3] = otf->c3; p[4] = otf->c3_exp;
+  p[5] = otf->c4; p[6] = otf->rho_0s; p[7] = otf->alpha_s; p[8] = otf->l_g; p[9] = otf->mass;
+  p[10] = otf->rho0; p[11] = otf->temp; p[12] = otf->lj_params.h; p[13] = otf->lj_params.sigma;
+  p[14] = otf->lj_params.epsilon; p[15] = otf->lj_params.cval; p[16] = otf->bf_params.g11;
+  p[17] = otf->bf_params.g12; p[18] = otf->bf_params.g21; p[19] = otf->bf_params.g22;
+  p[20] = otf->bf_params.a1; p[21] = otf->bf_params.a2; p[22] = otf->beta; p[23] = otf->rhom;
+  p[24] = otf->C; p[25] = otf->mu0; p[26] = otf->xi; p[27] = otf->rhobf; p[28] = otf->div_epsilon;
+}
+
+/*
+ * Write checkpoint file.
+ *
+ * chk  = Checkpoint writer (input/output; dft_checkpoint *).
+ * file = File name (input; char *).
+ * gwf  = Wave function (input; wf *).
+ * otf  = Functional (input; dft_ot_functional *). May be NULL.
+ * drv  = Driver state (input; dft_ot_driver *). May be NULL.
+ * time = Current simulation time or iteration count (input; REAL).
+ *
+ * Returns 0 on success and -1 on error.
+ *
+ */
+
+EXPORT INT dft_checkpoint_write(dft_checkpoint *chk, char *file, wf *gwf, dft_ot_functional *otf, dft_ot_driver *drv, REAL time) {
+
+  dft_checkpoint_header hdr;
+  INT nwords = 2 * gwf->grid->nx * gwf->grid->ny * gwf->grid->nz, wsize = (chk->mode == DFT_CHECKPOINT_FLOAT)?4:8;
+  uint64_t *words, sum;
+  double p[DFT_CHECKPOINT_NOTF];
+  int64_t len;
+  char delta, ok;
+  INT i;
+  FILE *fp;
+
+  if(!(words = (uint64_t *) malloc(sizeof(uint64_t) * (size_t) nwords))) {
+    fprintf(stderr, "libdft: Error in dft_checkpoint_write(): Could not allocate memory.\n");
+    exit(1);
+  }
+  dft_checkpoint_words(gwf->grid, chk->mode, chk->tol, words);
+  sum = dft_checkpoint_checksum(words, nwords);
+
+  delta = chk->prev && chk->nwords == nwords && chk->full_every > 0 && chk->ndelta < chk->full_every;
+  /* Never overwrite a file that the chain depends on */
+  for(i = 0; delta && i < chk->nchain; i++)
+    if(!strncmp(chk->chain + i * DFT_CHECKPOINT_MAXNAME, file, DFT_CHECKPOINT_MAXNAME - 1)) delta = 0;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.ih[0] = chk->mode; hdr.ih[1] = delta; hdr.ih[2] = gwf->grid->nx; hdr.ih[3] = gwf->grid->ny; hdr.ih[4] = gwf->grid->nz;
+  hdr.ih[5] = chk->seq; hdr.ih[6] = wsize; hdr.ih[7] = otf?otf->model:-1;
+  hdr.dh[0] = gwf->grid->step; hdr.dh[1] = gwf->grid->x0; hdr.dh[2] = gwf->grid->y0; hdr.dh[3] = gwf->grid->z0;
+  hdr.dh[4] = gwf->grid->kx0; hdr.dh[5] = gwf->grid->ky0; hdr.dh[6] = gwf->grid->kz0;
+  hdr.dh[7] = gwf->mass; hdr.dh[8] = chk->tol; hdr.dh[9] = time;
+  hdr.chain[0] = delta?(chk->ndelta + 1):0;
+  hdr.chain[2] = chk->full_every;
+  hdr.sum[0] = sum;
+  if(delta) {
+    strncpy(hdr.base, chk->chain + (chk->nchain - 1) * DFT_CHECKPOINT_MAXNAME, DFT_CHECKPOINT_MAXNAME - 1);
+    hdr.chain[1] = chk->seq - 1;
+    hdr.sum[1] = chk->sum;
+  }
+
+  if(!(fp = fopen(file, "w"))) {
+    fprintf(stderr, "libdft: Can't open checkpoint file %s for writing.\n", file);
+    free(words);
+    return -1;
+  }
+  ok = fwrite(DFT_CHECKPOINT_MAGIC, 8, 1, fp) == 1 && fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+  /* Functional parameters */
+  len = otf?DFT_CHECKPOINT_NOTF:0;
+  if(otf) dft_checkpoint_otf_params(otf, p);
+  ok = ok && fwrite(&len, sizeof(int64_t), 1, fp) == 1 && fwrite(p, sizeof(double), (size_t) len, fp) == (size_t) len;
+  /* Driver state */
+  len = drv?(int64_t) sizeof(dft_ot_driver):0;
+  ok = ok && fwrite(&len, sizeof(int64_t), 1, fp) == 1 && (!drv || fwrite(drv, sizeof(dft_ot_driver), 1, fp) == 1);
+
+  /* Store the new words as reference for the next delta before encoding */
+  if(chk->nwords != nwords) {
+    if(chk->prev) free(chk->prev);
+    if(!(chk->prev = (uint64_t *) malloc(sizeof(uint64_t) * (size_t) nwords))) {
+      fprintf(stderr, "libdft: Error in dft_checkpoint_write(): Could not allocate memory.\n");
+      exit(1);
+    }
+    chk->nwords = nwords;
+  }
+  if(delta) dft_checkpoint_delta(words, chk->prev, nwords, chk->mode, 1);
+  else memcpy(chk->prev, words, sizeof(uint64_t) * (size_t) nwords);
+
+  ok = ok && dft_checkpoint_put_words(fp, words, nwords, wsize);
+  if(fclose(fp)) ok = 0;
+  free(words);
+  if(!ok) {
+    fprintf(stderr, "libdft: Error writing checkpoint file %s.\n", file);
+    free(chk->prev);    /* force full checkpoint next time */
+    chk->prev = NULL;
+    chk->nwords = 0;
+    chk->nchain = 0;
+    return -1;
+  }
+  if(!delta) chk->nchain = 0;
+  strncpy(chk->chain + chk->nchain * DFT_CHECKPOINT_MAXNAME, file, DFT_CHECKPOINT_MAXNAME - 1);
+  chk->chain[(chk->nchain + 1) * DFT_CHECKPOINT_MAXNAME - 1] = 0;
+  chk->nchain++;
+  chk->ndelta = delta?(chk->ndelta + 1):0;
+  chk->sum = sum;
+  chk->seq++;
+  return 0;
+}
+
+/*
+ * Read checkpoint (following the chain of delta checkpoints) into words. The header, functional
+ * parameters and driver state of the requested file are returned in hdr, p (np values) and drv.
+ * child is the header of the delta checkpoint that refers to this file (NULL for the requested file);
+ * the position in the chain, sequence number and checksum of this file must match it.
+ * Returns 1 on success and 0 on error.
+ *
+ */
+
+static char dft_checkpoint_load(char *file, dft_checkpoint_header *hdr, dft_checkpoint_header *child, uint64_t *words, INT nwords, double *p, int64_t *np, dft_ot_driver *drv, char *has_drv) {
+
+  FILE *fp;
+  char magic[8];
+  int64_t len;
+  dft_checkpoint_header bhdr;
+  dft_ot_driver bdrv;
+  double bp[DFT_CHECKPOINT_NOTF];
+  uint64_t *delta;
+  char ok;
+
+  if(!(fp = fopen(file, "r"))) {
+    fprintf(stderr, "libdft: Can't open checkpoint file %s.\n", file);
+    return 0;
+  }
+  if(fread(magic, 8, 1, fp) != 1 || memcmp(magic, DFT_CHECKPOINT_MAGIC, 8) || fread(hdr, sizeof(dft_checkpoint_header), 1, fp) != 1) {
+    fprintf(stderr, "libdft: %s is not a checkpoint file.\n", file);
+    fclose(fp);
+    return 0;
+  }
+  hdr->base[DFT_CHECKPOINT_MAXNAME - 1] = 0;
+  /* The chain position decreases by one at each step, which bounds the chain length by full_every */
+  if(hdr->chain[0] < 0 || (hdr->ih[1] && (hdr->chain[0] < 1 || hdr->chain[0] > hdr->chain[2])) || (!hdr->ih[1] && hdr->chain[0])) {
+    fprintf(stderr, "libdft: Invalid delta chain position in checkpoint file %s.\n", file);
+    fclose(fp);
+    return 0;
+  }
+  if(child && (hdr->chain[0] != child->chain[0] - 1 || hdr->ih[5] != child->chain[1] || hdr->sum[0] != child->sum[1])) {
+    fprintf(stderr, "libdft: Checkpoint file %s is not the base of the following delta checkpoint (overwritten?).\n", file);
+    fclose(fp);
+    return 0;
+  }
+  if(2 * hdr->ih[2] * hdr->ih[3] * hdr->ih[4] != nwords) {
+    fprintf(stderr, "libdft: Grid dimensions in checkpoint file %s do not match.\n", file);
+    fclose(fp);
+    return 0;
+  }
+  /* Functional parameters and driver state (only kept for the requested file) */
+  if(fread(&len, sizeof(int64_t), 1, fp) != 1 || len < 0 || len > DFT_CHECKPOINT_NOTF || fread(p, sizeof(double), (size_t) len, fp) != (size_t) len) {
+    fclose(fp);
+    return 0;
+  }
+  if(np) *np = len;
+  if(fread(&len, sizeof(int64_t), 1, fp) != 1 || (len && len != (int64_t) sizeof(dft_ot_driver))) {
+    fprintf(stderr, "libdft: Driver state in checkpoint file %s is incompatible.\n", file);
+    fclose(fp);
+    return 0;
+  }
+  if(has_drv) *has_drv = len?1:0;
+  if(len && fread(drv, sizeof(dft_ot_driver), 1, fp) != 1) {
+    fclose(fp);
+    return 0;
+  }
+
+  if(!hdr->ih[1]) { /* full checkpoint */
+    ok = dft_checkpoint_get_words(fp, words, nwords, (INT) hdr->ih[6]);
+    fclose(fp);
+    if(ok && dft_checkpoint_checksum(words, nwords) != hdr->sum[0]) ok = 0;
+    if(!ok) fprintf(stderr, "libdft: Checkpoint file %s is corrupt.\n", file);
+    return ok;
+  }
+
+  /* delta: load the base first */
+  if(!(delta = (uint64_t *) malloc(sizeof(uint64_t) * (size_t) nwords))) {
+    fprintf(stderr, "libdft: Error in dft_checkpoint_read(): Could not allocate memory.\n");
+    exit(1);
+  }
+  ok = dft_checkpoint_get_words(fp, delta, nwords, (INT) hdr->ih[6]);
+  fclose(fp);
+  if(!ok) fprintf(stderr, "libdft: Checkpoint file %s is corrupt.\n", file);
+  ok = ok && dft_checkpoint_load(hdr->base, &bhdr, hdr, words, nwords, bp, NULL, &bdrv, NULL);
+  if(ok && bhdr.ih[0] != hdr->ih[0]) {
+    fprintf(stderr, "libdft: Checkpoint chain for %s mixes storage modes.\n", file);
+    ok = 0;
+  }
+  if(ok) {
+    dft_checkpoint_delta(words, delta, nwords, (char) hdr->ih[0], 0);
+    if(dft_checkpoint_checksum(words, nwords) != hdr->sum[0]) {
+      fprintf(stderr, "libdft: Checksum mismatch after decoding delta checkpoint %s.\n", file);
+      ok = 0;
+    }
+  }
+  free(delta);
+  return ok;
+}
+
+/*
+ * Read checkpoint file.
+ *
+ * file = File name (input; char *).
+ * gwf  = Wave function (output; wf *). Must have the same grid dimensions as the checkpoint.
+ * otf  = Functional (input; dft_ot_functional *). If not NULL, the model and parameters are
+ *        compared with the checkpoint and a warning is printed if they differ.
+ * drv  = Driver state (output; dft_ot_driver *). May be NULL. The external potential pointers
+ *        (ext_pot, extpot, extpot_arg) of drv are not changed.
+ * time = Simulation time (output; REAL *). May be NULL.
+ *
+ * Returns 0 on success and -1 on error.
+ *
+ */
+
+EXPORT INT dft_checkpoint_read(char *file, wf *gwf, dft_ot_functional *otf, dft_ot_driver *drv, REAL *time) {
+
+  dft_checkpoint_header hdr;
+  INT nwords = 2 * gwf->grid->nx * gwf->grid->ny * gwf->grid->nz, i;
+  uint64_t *words;
+  double p[DFT_CHECKPOINT_NOTF], q[DFT_CHECKPOINT_NOTF];
+  int64_t np = 0;
+  dft_ot_driver sdrv;
+  char has_drv = 0;
+
+  if(!(words = (uint64_t *) malloc(sizeof(uint64_t) * (size_t) nwords))) {
+    fprintf(stderr, "libdft: Error in dft_checkpoint_read(): Could not allocate memory.\n");
+    exit(1);
+  }
+  if(!dft_checkpoint_load(file, &hdr, NULL, words, nwords, p, &np, &sdrv, &has_drv)) {
+    free(words);
+    return -1;
+  }
+  dft_checkpoint_unwords(gwf->grid, (char) hdr.ih[0], (REAL) hdr.dh[8], words);
+  free(words);
+  if(hdr.dh[0] != gwf->grid->step) fprintf(stderr, "libdft: Warning - grid step in checkpoint %s differs.\n", file);
+
+  if(otf && np == DFT_CHECKPOINT_NOTF) {
+    if(hdr.ih[7] != otf->model) fprintf(stderr, "libdft: Warning - functional model in checkpoint %s differs.\n", file);
+    dft_checkpoint_otf_params(otf, q);
+    for(i = 0; i < DFT_CHECKPOINT_NOTF; i++)
+      if(p[i] != q[i]) {
+        fprintf(stderr, "libdft: Warning - functional parameters in checkpoint %s differ.\n", file);
+        break;
+      }
+  }
+  if(drv && has_drv) {
+    sdrv.ext_pot = drv->ext_pot;
+    sdrv.extpot = drv->extpot;
+    sdrv.extpot_arg = drv->extpot_arg;
+    *drv = sdrv;
+  }
+  if(time) *time = (REAL) hdr.dh[9];
+  return 0;
+}
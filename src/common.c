@@ -1284,3 +1284,290 @@ EXPORT REAL dft_common_vortex_z(void *param, REAL x, REAL y, REAL z) {
   if(rp2 < R_M * R_M) rp2 = R_M * R_M;
   return 1.0 / (2.0 * *mass * rp2);
 }
+
+/*
+ * @FUNC{dft_common_kernel_support, "Effective support of a kernel in reciprocal space"}
+ * @DESC{"Find the largest wave vector magnitude where the Fourier transformed kernel
+          exceeds the given tolerance (relative to the largest magnitude of the kernel).
+          The result can be used with dft_common_bandlimit_convolute()"}
+ * @ARG1{rgrid *kernel, "Kernel (in Fourier space)"}
+ * @ARG2{REAL tol, "Relative tolerance. If zero or negative, no cutoff is applied"}
+ * @RVAL{REAL, "Returns the cutoff wave vector magnitude (Bohr$^{-1}$) or -1 if all components must be retained"}
+ *
+ */
+
+EXPORT REAL dft_common_kernel_support(rgrid *kernel, REAL tol) {
+
+  INT i, j, k, nx = kernel->nx, ny = kernel->ny, nz = kernel->nz, nzz = kernel->nz2 / 2;
+  REAL kx, ky, kz, k2, mx = 0.0, kmax2 = 0.0, kgrid2 = 0.0;
+  REAL dkx = 2.0 * M_PI / (((REAL) nx) * kernel->step), dky = 2.0 * M_PI / (((REAL) ny) * kernel->step), dkz = 2.0 * M_PI / (((REAL) nz) * kernel->step);
+  REAL complex *val;
+
+  if(tol <= 0.0) return -1.0;
+#ifdef GRID_MGPU
+  rgrid_host_lock(kernel);
+#endif
+  val = (REAL complex *) kernel->value;
+  for(i = 0; i < nx * ny * nzz; i++)
+    if(CABS(val[i]) > mx) mx = CABS(val[i]);
+  for(i = 0; i < nx; i++) {
+    kx = ((REAL) ((i < nx / 2)?i:(i - nx))) * dkx;
+    for(j = 0; j < ny; j++) {
+      ky = ((REAL) ((j < ny / 2)?j:(j - ny))) * dky;
+      for(k = 0; k < nzz; k++) {
+        kz = ((REAL) k) * dkz;
+        k2 = kx * kx + ky * ky + kz * kz;
+        if(k2 > kgrid2) kgrid2 = k2;
+        if(k2 > kmax2 && CABS(val[(i * ny + j) * nzz + k]) > tol * mx) kmax2 = k2;
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(kernel);
+#endif
+  if(kmax2 >= kgrid2) return -1.0;
+  return SQRT(kmax2);
+}
+
+/*
+ * @FUNC{dft_common_bandlimit_convolute, "Band-limited convolution in Fourier space"}
+ * @DESC{"Same as rgrid_fft_convolute() but the product is only evaluated for wave vectors
+          with $|k| \le k_{max}$ and the remaining components are set to zero.
+          Use dft_common_kernel_support() to obtain $k_{max}$ for a given kernel. After this call,
+          use rgrid_inverse_fft_norm2() to get the convolution in real space.
+          dst may be the same grid as src (but not kernel)"}
+ * @ARG1{rgrid *dst, "Destination grid (Fourier space)"}
+ * @ARG2{rgrid *src, "Source grid (Fourier space)"}
+ * @ARG3{rgrid *kernel, "Kernel grid (Fourier space)"}
+ * @ARG4{REAL kmax, "Cutoff wave vector magnitude. If negative, the full convolution is computed"}
+ * @RVAL{void, "No return value"}
+ *
+ */
+
+EXPORT void dft_common_bandlimit_convolute(rgrid *dst, rgrid *src, rgrid *kernel, REAL kmax) {
+
+  INT i, j, k, ii, jj, kzmax, nx = dst->nx, ny = dst->ny, nz = dst->nz, nzz = dst->nz2 / 2;
+  REAL kx, ky, r2;
+  REAL dkx = 2.0 * M_PI / (((REAL) nx) * dst->step), dky = 2.0 * M_PI / (((REAL) ny) * dst->step), dkz = 2.0 * M_PI / (((REAL) nz) * dst->step);
+  REAL complex *d, *s, *kv;
+
+  if(kmax < 0.0) {
+    rgrid_fft_convolute(dst, src, kernel);
+    return;
+  }
+
+#ifdef GRID_MGPU
+  rgrid_host_lock(dst);
+  rgrid_host_lock(src);
+  rgrid_host_lock(kernel);
+#endif
+  d = (REAL complex *) dst->value;
+  s = (REAL complex *) src->value;
+  kv = (REAL complex *) kernel->value;
+#pragma omp parallel for firstprivate(nx,ny,nzz,d,s,kv,kmax,dkx,dky,dkz) private(i,j,k,ii,jj,kx,ky,r2,kzmax) default(none) schedule(runtime)
+  for(i = 0; i < nx; i++) {
+    ii = (i < nx / 2)?i:(i - nx);
+    kx = ((REAL) ii) * dkx;
+    for(j = 0; j < ny; j++) {
+      jj = (j < ny / 2)?j:(j - ny);
+      ky = ((REAL) jj) * dky;
+      r2 = kmax * kmax - kx * kx - ky * ky;
+      /* Retained components along z for this row: 0 ... kzmax */
+      kzmax = (r2 < 0.0)?-1:((INT) (SQRT(r2) / dkz));
+      if(kzmax >= nzz) kzmax = nzz - 1;
+      for(k = 0; k <= kzmax; k++) {
+        /* Same sign convention as rgrid_fft_convolute() (origin at the center of the grid) */
+        if((i + j + k) & 1) d[(i * ny + j) * nzz + k] = -s[(i * ny + j) * nzz + k] * kv[(i * ny + j) * nzz + k];
+        else d[(i * ny + j) * nzz + k] = s[(i * ny + j) * nzz + k] * kv[(i * ny + j) * nzz + k];
+      }
+      for(k = kzmax + 1; k < nzz; k++)
+        d[(i * ny + j) * nzz + k] = 0.0;
+    }
+  }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(dst);
+  rgrid_host_unlock(src);
+  rgrid_host_unlock(kernel);
+#endif
+  rgrid_fft_space(dst, 1);
+}
+
+/*
+ * @FUNC{dft_common_convolute_batch, "Convolution of several grids with the same kernel in Fourier space"}
+ * @DESC{"Same as calling rgrid_fft_convolute(dst[i], src[i], kernel) for i = 0, ..., n - 1 but the kernel
+          is read only once (the loop over the batch is the innermost). After this call,
+          use rgrid_inverse_fft_norm2() to get the convolutions in real space. dst[i] may be the same as src[i]"}
+ * @ARG1{rgrid **dst, "Array of destination grids (Fourier space)"}
+ * @ARG2{rgrid **src, "Array of source grids (Fourier space)"}
+ * @ARG3{rgrid *kernel, "Kernel grid (Fourier space)"}
+ * @ARG4{INT n, "Number of grids in the batch"}
+ * @RVAL{void, "No return value"}
+ *
+ */
+
+EXPORT void dft_common_convolute_batch(rgrid **dst, rgrid **src, rgrid *kernel, INT n) {
+
+  INT ij, i, j, k, m, nx = kernel->nx, ny = kernel->ny, nzz = kernel->nz2 / 2, idx;
+  REAL complex *kv, kval;
+
+#ifdef GRID_MGPU
+  for(m = 0; m < n; m++) {
+    rgrid_host_lock(dst[m]);
+    rgrid_host_lock(src[m]);
+  }
+  rgrid_host_lock(kernel);
+#endif
+  kv = (REAL complex *) kernel->value;
+#pragma omp parallel for firstprivate(nx,ny,nzz,kv,dst,src,n) private(ij,i,j,k,m,idx,kval) default(none) schedule(runtime)
+  for(ij = 0; ij < nx * ny; ij++) {
+    i = ij / ny;
+    j = ij % ny;
+    for(m = 0; m < n; m++)   /* kernel row stays in cache over the batch */
+      for(k = 0; k < nzz; k++) {
+        idx = ij * nzz + k;
+        /* Same sign convention as rgrid_fft_convolute() (origin at the center of the grid) */
+        kval = ((i + j + k) & 1)?-kv[idx]:kv[idx];
+        ((REAL complex *) dst[m]->value)[idx] = ((REAL complex *) src[m]->value)[idx] * kval;
+      }
+  }
+#ifdef GRID_MGPU
+  for(m = 0; m < n; m++) {
+    rgrid_host_unlock(dst[m]);
+    rgrid_host_unlock(src[m]);
+  }
+  rgrid_host_unlock(kernel);
+#endif
+  for(m = 0; m < n; m++)
+    rgrid_fft_space(dst[m], 1);
+}
+
+/*
+ * Phase factors exp(-i k d) along one axis (Nyquist component: cos(k d) to keep the result real).
+ *
+ */
+
+static void dft_common_phase(REAL complex *f, INT n, INT len, REAL step, REAL d) {
+
+  INT i;
+  REAL k, dk = 2.0 * M_PI / (((REAL) n) * step);
+
+  for(i = 0; i < len; i++) {
+    k = ((REAL) ((i < n / 2)?i:(i - n))) * dk;
+    if(!(n & 1) && i == n / 2) f[i] = COS(k * d);
+    else f[i] = CEXP(-I * k * d);
+  }
+}
+
+/*
+ * @FUNC{dft_common_pair_interaction, "Liquid - impurity interaction energy, force and potentials"}
+ * @DESC{"Evaluate the interaction energy $E = \int\int \rho_l(r) U(r - r') \rho_i(r' - d) dr dr'$
+          between the liquid (density $\rho_l$) and an impurity (density $\rho_i$ displaced by $d$ or
+          a point particle at $d$) interacting through pair potential $U$. The energy, the force on the
+          impurity ($F = -\partial E / \partial d$, analytic gradient in Fourier space) and optionally the potentials
+          acting on the liquid ($\int U(r - r') \rho_i(r' - d) dr'$) and on the impurity
+          ($\int U(r + d - r') \rho_l(r') dr'$, to be multiplied by $\rho_i(r)$) are all obtained
+          from a single pass over Fourier space. The force on the liquid is $-F$.
+          If a density is given in real space, it is Fourier transformed in place and left in
+          Fourier space so that it can be passed back with the fft flag set during the following calls
+          (e.g., the impurity density when only its position changes)"}
+ * @ARG1{rgrid *rho_l, "Liquid density (real or Fourier space; see fft_l)"}
+ * @ARG2{char fft_l, "1 = rho_l is already in Fourier space, 0 = rho_l is in real space"}
+ * @ARG3{rgrid *rho_i, "Impurity density (real or Fourier space; see fft_i). NULL = point impurity at (x, y, z)"}
+ * @ARG4{char fft_i, "1 = rho_i is already in Fourier space, 0 = rho_i is in real space"}
+ * @ARG5{REAL x, "Impurity displacement / position along x (Bohr)"}
+ * @ARG6{REAL y, "Impurity displacement / position along y (Bohr)"}
+ * @ARG7{REAL z, "Impurity displacement / position along z (Bohr)"}
+ * @ARG8{rgrid *pair, "Pair potential (Fourier space; centered at the origin)"}
+ * @ARG9{REAL *force, "Force on the impurity (Hartree / Bohr; REAL [3]). NULL = not computed"}
+ * @ARG10{rgrid *pot_l, "Potential acting on the liquid (real space; output). NULL = not computed"}
+ * @ARG11{rgrid *pot_i, "Potential acting on the impurity (real space; output). NULL = not computed. Not used for point impurity"}
+ * @RVAL{REAL, "Returns the interaction energy (Hartree)"}
+ *
+ * Note: pot_l and pot_i must not be any of the input grids.
+ *
+ */
+
+EXPORT REAL dft_common_pair_interaction(rgrid *rho_l, char fft_l, rgrid *rho_i, char fft_i, REAL x, REAL y, REAL z, rgrid *pair, REAL *force, rgrid *pot_l, rgrid *pot_i) {
+
+  INT i, j, k, nx = pair->nx, ny = pair->ny, nz = pair->nz, nzz = pair->nz2 / 2, idx;
+  REAL step = pair->step, step3 = step * step * step, norm = 1.0 / (((REAL) nx) * ((REAL) ny) * ((REAL) nz));
+  REAL dkx = 2.0 * M_PI / (((REAL) nx) * step), dky = 2.0 * M_PI / (((REAL) ny) * step), dkz = 2.0 * M_PI / (((REAL) nz) * step);
+  REAL kx, ky, kz, w, e = 0.0, fx = 0.0, fy = 0.0, fz = 0.0, tmp;
+  REAL complex *lv, *iv, *uv, *vl, *vi, *phx, *phy, *phz, jk, pk, t;
+
+  if(!fft_l) rgrid_fft(rho_l);
+  if(rho_i && !fft_i) rgrid_fft(rho_i);
+
+  if(!(phx = (REAL complex *) malloc(sizeof(REAL complex) * (size_t) (nx + ny + nzz)))) {
+    fprintf(stderr, "libdft: Error in dft_common_pair_interaction(): Could not allocate memory.\n");
+    exit(1);
+  }
+  phy = phx + nx;
+  phz = phy + ny;
+  dft_common_phase(phx, nx, nx, step, x);
+  dft_common_phase(phy, ny, ny, step, y);
+  dft_common_phase(phz, nz, nzz, step, z);
+  if(!rho_i) pot_i = NULL;
+
+#ifdef GRID_MGPU
+  rgrid_host_lock(rho_l);
+  if(rho_i) rgrid_host_lock(rho_i);
+  rgrid_host_lock(pair);
+  if(pot_l) rgrid_host_lock(pot_l);
+  if(pot_i) rgrid_host_lock(pot_i);
+#endif
+  lv = (REAL complex *) rho_l->value;
+  iv = rho_i?((REAL complex *) rho_i->value):NULL;
+  uv = (REAL complex *) pair->value;
+  vl = pot_l?((REAL complex *) pot_l->value):NULL;
+  vi = pot_i?((REAL complex *) pot_i->value):NULL;
+#pragma omp parallel for firstprivate(nx,ny,nz,nzz,lv,iv,uv,vl,vi,phx,phy,phz,dkx,dky,dkz,step3,norm) private(i,j,k,idx,kx,ky,kz,w,jk,pk,t,tmp) reduction(+:e,fx,fy,fz) default(none) schedule(runtime)
+  for(i = 0; i < nx; i++) {
+    /* Nyquist components do not contribute to the gradient */
+    kx = (!(nx & 1) && i == nx / 2)?0.0:(((REAL) ((i < nx / 2)?i:(i - nx))) * dkx);
+    for(j = 0; j < ny; j++) {
+      ky = (!(ny & 1) && j == ny / 2)?0.0:(((REAL) ((j < ny / 2)?j:(j - ny))) * dky);
+      for(k = 0; k < nzz; k++) {
+        kz = (!(nz & 1) && k == nz / 2)?0.0:(((REAL) k) * dkz);
+        /* Weight of the half-complex component in the full sum */
+        w = (k == 0 || (!(nz & 1) && k == nz / 2))?1.0:2.0;
+        idx = (i * ny + j) * nzz + k;
+        /* Impurity density (displaced) with the same sign convention as rgrid_fft_convolute() */
+        jk = phx[i] * phy[j] * phz[k];
+        if(iv) jk *= ((i + j + k) & 1)?-step3 * iv[idx]:step3 * iv[idx];
+        pk = uv[idx] * jk;   /* Fourier transform of the potential acting on the liquid */
+        t = CONJ(lv[idx]) * pk;
+        e += w * CREAL(t);
+        tmp = -w * CIMAG(t);  /* Re(i t) */
+        fx += kx * tmp;
+        fy += ky * tmp;
+        fz += kz * tmp;
+        if(vi) vi[idx] = norm * step3 * (((i + j + k) & 1)?-uv[idx]:uv[idx]) * lv[idx] * CONJ(phx[i] * phy[j] * phz[k]);
+        if(vl) vl[idx] = norm * pk;
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(rho_l);
+  if(rho_i) rgrid_host_unlock(rho_i);
+  rgrid_host_unlock(pair);
+  if(pot_l) rgrid_host_unlock(pot_l);
+  if(pot_i) rgrid_host_unlock(pot_i);
+#endif
+  free(phx);
+
+  if(pot_l) {
+    rgrid_fft_space(pot_l, 1);
+    rgrid_inverse_fft(pot_l);
+  }
+  if(pot_i) {
+    rgrid_fft_space(pot_i, 1);
+    rgrid_inverse_fft(pot_i);
+  }
+  if(force) {
+    force[0] = step3 * norm * fx;
+    force[1] = step3 * norm * fy;
+    force[2] = step3 * norm * fz;
+  }
+  return step3 * norm * e;
+}
@@ -0,0 +1,165 @@
+/*
+ * Coupling between the liquid and an impurity (e.g., electron) through a pair potential
+ * (e.g., electron - helium pseudopotential).
+ *
+ * The potential acting on the impurity is the convolution of the liquid density with the
+ * pair potential and vice versa. Both are obtained from the Fourier transforms of the two
+ * densities with one pass over Fourier space followed by two inverse FFTs. When the
+ * coupling object is attached to the OT functional (dft_coupling_attach()), the Fourier
+ * transform of the liquid density computed by dft_ot_potential() is reused, so that
+ * only the impurity density needs to be transformed.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <grid/grid.h>
+#include <grid/au.h>
+#include "dft.h"
+#include "ot.h"
+
+/*
+ * Allocate coupling object.
+ *
+ * pair = Pair potential in real space, centered at the origin (input; rgrid *). Not modified.
+ *
+ * Returns pointer to the coupling object (NULL on error).
+ *
+ */
+
+EXPORT dft_coupling *dft_coupling_alloc(rgrid *pair) {
+
+  dft_coupling *cpl;
+
+  if(!(cpl = (dft_coupling *) malloc(sizeof(dft_coupling)))) {
+    fprintf(stderr, "libdft: Error in dft_coupling_alloc(): Could not allocate memory.\n");
+    return NULL;
+  }
+  cpl->pair = rgrid_clone(pair, "dft_coupling pair");
+  cpl->rho_tf = rgrid_clone(pair, "dft_coupling rho_tf");
+  cpl->work = rgrid_clone(pair, "dft_coupling work");
+  rgrid_copy(cpl->pair, pair);
+  rgrid_fft(cpl->pair);
+  cpl->valid = 0;
+  cpl->otf = NULL;
+  return cpl;
+}
+
+/*
+ * Free coupling object. If it is attached to an OT functional, it is detached from it.
+ *
+ * cpl = Coupling object to be freed (input; dft_coupling *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_coupling_free(dft_coupling *cpl) {
+
+  if(!cpl) return;
+  if(cpl->otf) cpl->otf->coupling = NULL;
+  rgrid_free(cpl->pair);
+  rgrid_free(cpl->rho_tf);
+  rgrid_free(cpl->work);
+  free(cpl);
+}
+
+/*
+ * Attach coupling object to OT functional. Each call to dft_ot_potential() then stores
+ * the Fourier transform of the liquid density in the coupling object and the following
+ * call to dft_coupling_potential() uses it instead of transforming the liquid density again.
+ *
+ * otf = OT functional (input/output; dft_ot_functional *).
+ * cpl = Coupling object (input/output; dft_coupling *). NULL = detach. A coupling object
+ *       can be attached to one functional at a time (it is detached from the previous one).
+ *
+ * No return value.
+ *
+ * NOTE: The liquid wave function given to dft_coupling_potential() must be the same as in
+ *       the preceding dft_ot_potential() call.
+ *
+ */
+
+EXPORT void dft_coupling_attach(dft_ot_functional *otf, dft_coupling *cpl) {
+
+  if(otf->coupling) otf->coupling->otf = NULL;
+  if(cpl && cpl->otf) cpl->otf->coupling = NULL;
+  otf->coupling = cpl;
+  if(cpl) {
+    cpl->otf = otf;
+    cpl->valid = 0;
+  }
+}
+
+/*
+ * Potentials acting on the liquid and the impurity due to their mutual interaction.
+ *
+ * cpl   = Coupling object (input; dft_coupling *).
+ * gwf   = Liquid wave function (input; wf *).
+ * iwf   = Impurity wave function (input; wf *).
+ * pot_l = Potential acting on the liquid (output; cgrid *). The potential is added to this.
+ *         NULL = not computed.
+ * pot_i = Potential acting on the impurity (output; cgrid *). The potential is added to this.
+ *         NULL = not computed.
+ *
+ * Returns the interaction energy (Hartree).
+ *
+ */
+
+EXPORT REAL dft_coupling_potential(dft_coupling *cpl, wf *gwf, wf *iwf, cgrid *pot_l, cgrid *pot_i) {
+
+  rgrid *rho_tf = cpl->rho_tf, *work = cpl->work, *pair = cpl->pair;
+  INT i, j, k, nx = pair->nx, ny = pair->ny, nz = pair->nz, nzz = pair->nz2 / 2, idx;
+  REAL step3 = pair->step * pair->step * pair->step, norm, w, e = 0.0;
+  REAL complex *lv, *iv, *uv, l, u;
+
+  if(!cpl->valid) {
+    grid_wf_density(gwf, rho_tf);
+    rgrid_fft(rho_tf);
+  }
+  cpl->valid = 0;
+  grid_wf_density(iwf, work);
+  rgrid_fft(work);
+
+  /* Normalization of the inverse FFT and the volume element of the convolution */
+  norm = step3 / (((REAL) nx) * ((REAL) ny) * ((REAL) nz));
+
+#ifdef GRID_MGPU
+  rgrid_host_lock(rho_tf);
+  rgrid_host_lock(work);
+  rgrid_host_lock(pair);
+#endif
+  lv = (REAL complex *) rho_tf->value;
+  iv = (REAL complex *) work->value;
+  uv = (REAL complex *) pair->value;
+#pragma omp parallel for firstprivate(nx,ny,nz,nzz,lv,iv,uv,norm) private(i,j,k,idx,w,l,u) reduction(+:e) default(none) schedule(runtime)
+  for(i = 0; i < nx; i++)
+    for(j = 0; j < ny; j++)
+      for(k = 0; k < nzz; k++) {
+        idx = (i * ny + j) * nzz + k;
+        /* Same sign convention as rgrid_fft_convolute() (origin at the center of the grid) */
+        u = ((i + j + k) & 1)?-norm * uv[idx]:norm * uv[idx];
+        l = lv[idx];
+        /* Weight of the half-complex component in the full sum */
+        w = (k == 0 || (!(nz & 1) && k == nz / 2))?1.0:2.0;
+        e += w * CREAL(CONJ(l) * u * iv[idx]);
+        lv[idx] = u * iv[idx];   /* potential acting on the liquid */
+        iv[idx] = u * l;         /* potential acting on the impurity */
+      }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(rho_tf);
+  rgrid_host_unlock(work);
+  rgrid_host_unlock(pair);
+#endif
+
+  if(pot_l) {
+    rgrid_inverse_fft(rho_tf);
+    grid_add_real_to_complex_re(pot_l, rho_tf);
+  }
+  if(pot_i) {
+    rgrid_inverse_fft(work);
+    grid_add_real_to_complex_re(pot_i, work);
+  }
+  return step3 * e;
+}
@@ -15,6 +15,10 @@
 
 #define DFT_MAX_POTENTIAL_POINTS 8192
 
+/* Snapshot writer (see snapshot.c) */
+#define DFT_SNAPSHOT_FLOAT   1     /* Store values in single precision */
+#define DFT_SNAPSHOT_MAXNAME 512   /* Maximum length of snapshot file names */
+
 /*
  * Structures
  *
@@ -59,6 +63,44 @@ typedef struct {
   REAL rho;                                /* Background amplitude = sqrt(rho) */
 } dft_plane_wave;
 
+/* Asynchronous snapshot writer (opaque; see snapshot.c) */
+typedef struct dft_snapshot_struct dft_snapshot;
+
+/* Movable (rigidly translated) potential (see movable.c) */
+typedef struct dft_movable_struct {
+  rgrid *fft;                              /* Fourier transform of the potential at zero displacement */
+  rgrid *work;                             /* Potential at the last displacement (real space) */
+  REAL x, y, z;                            /* Last displacement */
+  char valid;                              /* 1 = work holds the potential at (x, y, z) */
+} dft_movable;
+
+/* Two-species coupling through a pair potential, e.g., electron - liquid (see coupling.c) */
+typedef struct dft_coupling_struct {
+  rgrid *pair;                             /* Fourier transform of the pair potential */
+  rgrid *rho_tf;                           /* Fourier transform of the liquid density (shared with dft_ot_potential()) */
+  rgrid *work;                             /* Fourier transform of the impurity density */
+  char valid;                              /* 1 = rho_tf holds the current liquid density (set by dft_ot_potential()) */
+  struct dft_ot_functional_struct *otf;    /* OT functional the object is attached to (NULL = none) */
+} dft_coupling;
+
+/* Vortex lines detected from the phase winding of the wave function (see vortex.c) */
+typedef struct dft_vortex_struct {
+  INT npoints;                             /* Total number of points on the lines */
+  INT nlines;                              /* Number of lines */
+  INT nloops;                              /* Number of closed lines (loops) */
+  INT ncomponents;                         /* Number of connected components (lines that touch belong to the same component) */
+  REAL *points;                            /* Point coordinates (x, y, z) ordered along the lines (continuous across periodic boundaries) */
+  INT *start;                              /* Index of the first point of each line (start[nlines] = npoints) */
+  char *closed;                            /* 1 = line is closed, 0 = open (ends at low density region) */
+  INT *component;                          /* Component of each line */
+  REAL *length;                            /* Length of each line (Bohr) */
+  REAL *curvature;                         /* Mean curvature of each line (1 / Bohr) */
+  REAL total_length;                       /* Total line length (Bohr) */
+  REAL mean_curvature;                     /* Mean curvature over all points (1 / Bohr) */
+  REAL rms_curvature;                      /* RMS curvature over all points (1 / Bohr) */
+  REAL max_curvature;                      /* Maximum curvature (1 / Bohr) */
+} dft_vortex;
+
 /*
  * Prototypes (auto generated by Makefile).
  *
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <grid/grid.h>
 #include "helium-exp-bulk.h"
 #define EXPORT
 
@@ -18,6 +19,9 @@
  * k = pointer to array of knots
  * c = pointer to array of coefficients
  * x = value of independent variable
+ * hint = knot interval from the previous call (INT *; input/output). Initialize to -1.
+ *        If the new x is in the same or the next interval, the binary search is skipped.
+ *        May be NULL (dft_exp_bulk_spline_eval()).
  * first = address of variable to hold first derivative
  * second = address of variable to hold second derivative
  * This function returns the value of the spline at point X
@@ -26,21 +30,29 @@
  *
  */
 
-static REAL dft_exp_bulk_spline_eval(INT ncap7, REAL *k, REAL *c, REAL x, REAL *first, REAL *second) {
+static REAL dft_exp_bulk_spline_eval_hint(INT ncap7, REAL *k, REAL *c, REAL x, INT *hint, REAL *first, REAL *second) {
 
   INT j, j1r, L;
   REAL s, k1r, k2, k3, k4, k5, k6, e2, e3, e4, e5, c11, cd11, c21, cd21, cd31, c12, cd12;
   REAL cdd12, c22, cd22, cdd22, c31;
 
   if(x >= k[3] && x <= k[ncap7-3]) {
-    j1r = -1;
-    j = ncap7 - 7;
-    L = (j1r + j) / 2;
-    while(j - j1r > 1) {
-      if(x >= k[L+4]) j1r = L;
-      else j = L;
+    j = hint?*hint:-1;
+    /* Reuse the knot interval from the previous call if x is still inside it (or in the next one) */
+    if(j >= 0 && j <= ncap7 - 8 && x >= k[j+3] && (x < k[j+4] || j == ncap7 - 8)) ;
+    else if(j >= 0 && j < ncap7 - 8 && x >= k[j+4] && (x < k[j+5] || j + 1 == ncap7 - 8)) j++;
+    else {
+      j1r = -1;
+      j = ncap7 - 7;
       L = (j1r + j) / 2;
+      while(j - j1r > 1) {
+        if(x >= k[L+4]) j1r = L;
+        else j = L;
+        L = (j1r + j) / 2;
+      }
+      if(j > ncap7 - 8) j = ncap7 - 8;  /* x at the upper end of the spline region */
     }
+    if(hint) *hint = j;
 
     k1r = k[j + 1];
     k2 = k[j + 2];
@@ -75,6 +87,55 @@ static REAL dft_exp_bulk_spline_eval(INT ncap7, REAL *k, REAL *c, REAL x, REAL *
   return s;
 }
 
+static REAL dft_exp_bulk_spline_eval(INT ncap7, REAL *k, REAL *c, REAL x, REAL *first, REAL *second) {
+
+  return dft_exp_bulk_spline_eval_hint(ncap7, k, c, x, NULL, first, second);
+}
+
+/*
+ * Inverse of scale * spline(x) = y for x in [lo, hi] (spline monotonic in the interval).
+ * Safeguarded Newton-Raphson / bisection using the spline derivative.
+ *
+ * acc  = Accuracy for x.
+ * hint = Knot interval hint (see dft_exp_bulk_spline_eval_hint()). May be NULL.
+ *
+ * If y is outside the range of the function in [lo, hi], the nearest end point is returned.
+ *
+ */
+
+static REAL dft_exp_bulk_spline_inverse(INT ncap7, REAL *k, REAL *c, REAL scale, REAL y, REAL lo, REAL hi, REAL acc, INT *hint) {
+
+  REAL x, g, glo, ghi, f, s, dx;
+  INT i;
+
+  if(acc <= 0.0) acc = 1E-12;
+  glo = scale * dft_exp_bulk_spline_eval_hint(ncap7, k, c, lo, hint, &f, &s) - y;
+  ghi = scale * dft_exp_bulk_spline_eval_hint(ncap7, k, c, hi, hint, &f, &s) - y;
+  if(glo == 0.0) return lo;
+  if(ghi == 0.0) return hi;
+  if(glo * ghi > 0.0) return (FABS(glo) < FABS(ghi))?lo:hi;
+
+  x = lo + (hi - lo) * glo / (glo - ghi);  /* secant start */
+  for (i = 0; i < 200; i++) {
+    g = scale * dft_exp_bulk_spline_eval_hint(ncap7, k, c, x, hint, &f, &s) - y;
+    if(g == 0.0) return x;
+    if((g < 0.0) == (glo < 0.0)) lo = x;
+    else hi = x;
+    f *= scale;
+    if(f != 0.0) {
+      dx = -g / f;
+      if((lo < hi)?(x + dx > lo && x + dx < hi):(x + dx > hi && x + dx < lo)) {
+        x += dx;
+        if(FABS(dx) < acc) return x;
+        continue;
+      }
+    }
+    x = 0.5 * (lo + hi);   /* bisection */
+    if(FABS(hi - lo) < acc) return x;
+  }
+  return x;
+}
+
 /*
  * @FUNC{dft_exp_bulk_enthalpy, "Experimental enthalpy of liquid helium"}
  * @DESC{"Return enthalpy at saturated vapor pressure and a given temperature"}
@@ -99,13 +160,13 @@ EXPORT REAL dft_exp_bulk_enthalpy(REAL temperature, REAL *first, REAL *second) {
  * @FUNC{dft_exp_bulk_enthalpy_inverse, "Experimental temperature based on enthalpy of liquid helium"}
  * @DESC{"Return temperature at saturated vapor pressure based on enthalpy"}
  * @ARG1{REAL enthalpy, "Enthalpy for which the temperature is calculated"}
- * @ARG2{REAL acc, "Accuracy for serch"}
+ * @ARG2{REAL acc, "Accuracy for the temperature (safeguarded Newton-Raphson / bisection)"}
  * @RVAL{REAL, "Returns temperature (K) corresponding to the given enthalpy (J/mol)"}
 
  * Return temperature for given enthalpy (inverse of the above). The inversion is unique.
  *
  * enthalpy = Enthalpy at which the temperature is requested (REAL; input).
- * acc      = Search accuracy (REAL; input).
+ * acc      = Accuracy for the temperature (REAL; input).
  *
  * Returns the temperature (REAL).
  *
@@ -113,14 +174,8 @@ EXPORT REAL dft_exp_bulk_enthalpy(REAL temperature, REAL *first, REAL *second) {
 
 EXPORT REAL dft_exp_bulk_enthalpy_inverse(REAL enthalpy, REAL acc) {
 
-  REAL temp = 0.0;
-
-  // Search for the matching enthalpy
-  while(1) {
-    if(dft_exp_bulk_enthalpy(temp, NULL, NULL) >= enthalpy) break;
-    temp += acc;
-  }
-  return temp;
+  return dft_exp_bulk_spline_inverse(DFT_BULK_ENTHALPY_KNOTS, dft_bulk_enthalpy_k, dft_bulk_enthalpy_c, 1.0, enthalpy,
+                                     dft_bulk_enthalpy_k[3], dft_bulk_enthalpy_k[DFT_BULK_ENTHALPY_KNOTS-4], acc, NULL);
 }
 
 /*
@@ -164,21 +219,16 @@ EXPORT REAL dft_exp_bulk_superfluid_fraction(REAL temperature) {
  * @FUNC{dft_exp_bulk_superfluid_fraction_inverse, "Temperature based on superfluid fraction of liquid helium"}
  * @DESC{"Return temperature based on superfluid fraction of liquid helium (saturated vapor pressure)"}
  * @ARG1{REAL sfrac, "Superfluid fraction"}
- * @ARG2{REAL acc, "Accuracy for inverse search"}
+ * @ARG2{REAL acc, "Accuracy for the temperature (safeguarded Newton-Raphson / bisection)"}
  * @RVAL{REAL, "Returns the temperature (K)"}
  *
  */
 
 EXPORT REAL dft_exp_bulk_superfluid_fraction_inverse(REAL sfrac, REAL acc) {
 
-  REAL temp = 0.0;
-
-  // Search for the matching enthalpy
-  while(1) {
-    if(dft_exp_bulk_superfluid_fraction(temp) <= sfrac || temp >= 2.1768) break;
-    temp += acc;
-  }
-  return temp;
+  if(sfrac <= 0.0) return 2.1768;
+  return dft_exp_bulk_spline_inverse(DFT_BULK_SUPERFRACTION_KNOTS, dft_bulk_superfraction_k, dft_bulk_superfraction_c, 1.0 / 1.451275e-01, sfrac,
+                                     dft_bulk_superfraction_k[3], 2.1768, acc, NULL);
 }
 
 /*
@@ -205,18 +255,162 @@ EXPORT REAL dft_exp_bulk_entropy(REAL temperature, REAL *first, REAL *second) {
  * @FUNC{dft_exp_bulk_entropy_inverse, "Return temperature based on liquid helium entropy"}
  * @DESC{"Calculate liquid helium temperature based on entropy"}
  * @ARG1{REAL entropy, "Entropy for temperature evaluation"}
+ * @ARG2{REAL acc, "Accuracy for the temperature (safeguarded Newton-Raphson / bisection)"}
  * @RVAL{REAL, "Returns the temperature (K)"}
  *
  */
 
 EXPORT REAL dft_exp_bulk_entropy_inverse(REAL entropy, REAL acc) {
 
-  REAL temp = 0.0;
+  return dft_exp_bulk_spline_inverse(DFT_BULK_ENTROPY_KNOTS, dft_bulk_entropy_k, dft_bulk_entropy_c, 1.0, entropy,
+                                     dft_bulk_entropy_k[3], dft_bulk_entropy_k[DFT_BULK_ENTROPY_KNOTS-4], acc, NULL);
+}
+
+/*
+ * @FUNC{dft_exp_bulk_enthalpy_array, "Experimental enthalpy of liquid helium for an array of temperatures"}
+ * @DESC{"Return enthalpies at saturated vapor pressure for an array of temperatures. For sorted input,
+          the knot interval is reused between consecutive points"}
+ * @ARG1{REAL *temperature, "Temperatures (K)"}
+ * @ARG2{REAL *enthalpy, "Enthalpies (J / mol; output)"}
+ * @ARG3{REAL *first, "First derivatives of enthalpy (output). If NULL, not stored"}
+ * @ARG4{INT n, "Number of temperatures"}
+ * @RVAL{void, "No return value"}
+ *
+ */
+
+EXPORT void dft_exp_bulk_enthalpy_array(REAL *temperature, REAL *enthalpy, REAL *first, INT n) {
+
+  REAL f, s;
+  INT i, hint = -1;
+
+  for (i = 0; i < n; i++) {
+    enthalpy[i] = dft_exp_bulk_spline_eval_hint(DFT_BULK_ENTHALPY_KNOTS, dft_bulk_enthalpy_k, dft_bulk_enthalpy_c, temperature[i], &hint, &f, &s);
+    if(first) first[i] = f;
+  }
+}
+
+/*
+ * @FUNC{dft_exp_bulk_entropy_array, "Entropy of liquid helium for an array of temperatures"}
+ * @DESC{"Return entropies at saturated vapor pressure for an array of temperatures. For sorted input,
+          the knot interval is reused between consecutive points"}
+ * @ARG1{REAL *temperature, "Temperatures (K)"}
+ * @ARG2{REAL *entropy, "Entropies (J / K g; output)"}
+ * @ARG3{REAL *first, "First derivatives of entropy (output). If NULL, not stored"}
+ * @ARG4{INT n, "Number of temperatures"}
+ * @RVAL{void, "No return value"}
+ *
+ */
+
+EXPORT void dft_exp_bulk_entropy_array(REAL *temperature, REAL *entropy, REAL *first, INT n) {
+
+  REAL f, s;
+  INT i, hint = -1;
+
+  for (i = 0; i < n; i++) {
+    entropy[i] = dft_exp_bulk_spline_eval_hint(DFT_BULK_ENTROPY_KNOTS, dft_bulk_entropy_k, dft_bulk_entropy_c, temperature[i], &hint, &f, &s);
+    if(first) first[i] = f;
+  }
+}
+
+/*
+ * @FUNC{dft_exp_bulk_superfluid_fraction_array, "Superfluid fraction of liquid helium for an array of temperatures"}
+ * @DESC{"Return superfluid fractions (saturated vapor pressure) for an array of temperatures. For sorted input,
+          the knot interval is reused between consecutive points"}
+ * @ARG1{REAL *temperature, "Temperatures (K)"}
+ * @ARG2{REAL *sfrac, "Superfluid fractions (output)"}
+ * @ARG3{INT n, "Number of temperatures"}
+ * @RVAL{void, "No return value"}
+ *
+ */
+
+EXPORT void dft_exp_bulk_superfluid_fraction_array(REAL *temperature, REAL *sfrac, INT n) {
 
-  // Search for the matching enthalpy
-  while(1) {
-    if(dft_exp_bulk_entropy(temp, NULL, NULL) >= entropy) break;
-    temp += acc;
+  REAL f, s;
+  INT i, hint = -1;
+
+  for (i = 0; i < n; i++) {
+    if(temperature[i] >= 2.1768) sfrac[i] = 0.0;
+    else sfrac[i] = dft_exp_bulk_spline_eval_hint(DFT_BULK_SUPERFRACTION_KNOTS, dft_bulk_superfraction_k, dft_bulk_superfraction_c, temperature[i], &hint, &f, &s) / 1.451275e-01;
   }
-  return temp;
+}
+
+/*
+ * Batched inverse: for ascending y, the previous solution brackets the next one
+ * (lower bound if increasing = 1, upper bound otherwise) and the knot interval is reused.
+ *
+ */
+
+static void dft_exp_bulk_spline_inverse_array(INT ncap7, REAL *k, REAL *c, REAL scale, char increasing, REAL *y, REAL *x, INT n, REAL lo, REAL hi, REAL acc) {
+
+  INT i, hint = -1;
+  REAL a = lo, b = hi;
+
+  for (i = 0; i < n; i++) {
+    if(i > 0 && y[i] >= y[i-1]) {
+      if(increasing) a = x[i-1];
+      else b = x[i-1];
+    } else {
+      a = lo;
+      b = hi;
+    }
+    x[i] = dft_exp_bulk_spline_inverse(ncap7, k, c, scale, y[i], a, b, acc, &hint);
+  }
+}
+
+/*
+ * @FUNC{dft_exp_bulk_enthalpy_inverse_array, "Experimental temperatures based on enthalpies of liquid helium"}
+ * @DESC{"Return temperatures at saturated vapor pressure for an array of enthalpies. Sorted (ascending)
+          input is fastest: the previous solution brackets the next one"}
+ * @ARG1{REAL *enthalpy, "Enthalpies (J / mol)"}
+ * @ARG2{REAL *temperature, "Temperatures (K; output)"}
+ * @ARG3{INT n, "Number of enthalpies"}
+ * @ARG4{REAL acc, "Accuracy for the temperature"}
+ * @RVAL{void, "No return value"}
+ *
+ */
+
+EXPORT void dft_exp_bulk_enthalpy_inverse_array(REAL *enthalpy, REAL *temperature, INT n, REAL acc) {
+
+  dft_exp_bulk_spline_inverse_array(DFT_BULK_ENTHALPY_KNOTS, dft_bulk_enthalpy_k, dft_bulk_enthalpy_c, 1.0, 1, enthalpy, temperature, n,
+                                    dft_bulk_enthalpy_k[3], dft_bulk_enthalpy_k[DFT_BULK_ENTHALPY_KNOTS-4], acc);
+}
+
+/*
+ * @FUNC{dft_exp_bulk_entropy_inverse_array, "Temperatures based on liquid helium entropies"}
+ * @DESC{"Return temperatures at saturated vapor pressure for an array of entropies. Sorted (ascending)
+          input is fastest: the previous solution brackets the next one"}
+ * @ARG1{REAL *entropy, "Entropies (J / K g)"}
+ * @ARG2{REAL *temperature, "Temperatures (K; output)"}
+ * @ARG3{INT n, "Number of entropies"}
+ * @ARG4{REAL acc, "Accuracy for the temperature"}
+ * @RVAL{void, "No return value"}
+ *
+ */
+
+EXPORT void dft_exp_bulk_entropy_inverse_array(REAL *entropy, REAL *temperature, INT n, REAL acc) {
+
+  dft_exp_bulk_spline_inverse_array(DFT_BULK_ENTROPY_KNOTS, dft_bulk_entropy_k, dft_bulk_entropy_c, 1.0, 1, entropy, temperature, n,
+                                    dft_bulk_entropy_k[3], dft_bulk_entropy_k[DFT_BULK_ENTROPY_KNOTS-4], acc);
+}
+
+/*
+ * @FUNC{dft_exp_bulk_superfluid_fraction_inverse_array, "Temperatures based on superfluid fractions of liquid helium"}
+ * @DESC{"Return temperatures (saturated vapor pressure) for an array of superfluid fractions. Sorted (ascending)
+          input is fastest: the previous solution brackets the next one"}
+ * @ARG1{REAL *sfrac, "Superfluid fractions"}
+ * @ARG2{REAL *temperature, "Temperatures (K; output)"}
+ * @ARG3{INT n, "Number of superfluid fractions"}
+ * @ARG4{REAL acc, "Accuracy for the temperature"}
+ * @RVAL{void, "No return value"}
+ *
+ */
+
+EXPORT void dft_exp_bulk_superfluid_fraction_inverse_array(REAL *sfrac, REAL *temperature, INT n, REAL acc) {
+
+  INT i;
+
+  dft_exp_bulk_spline_inverse_array(DFT_BULK_SUPERFRACTION_KNOTS, dft_bulk_superfraction_k, dft_bulk_superfraction_c, 1.0 / 1.451275e-01, 0, sfrac, temperature, n,
+                                    dft_bulk_superfraction_k[3], 2.1768, acc);
+  for (i = 0; i < n; i++)
+    if(sfrac[i] <= 0.0) temperature[i] = 2.1768;
 }
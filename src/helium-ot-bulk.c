@@ -6,9 +6,6 @@
 #include "dft.h"
 #include "ot.h"
 
-/* Step size used for finite difference derivative. */
-#define LOCAL_EPS 1E-7
-
 /*
  * Energy density of uniform bulk.
  *
@@ -166,19 +163,317 @@ EXPORT REAL dft_ot_bulk_pressure(dft_ot_functional *otf, REAL rho) {
 
 EXPORT REAL dft_ot_bulk_dPdRho(dft_ot_functional *otf, REAL rho) {
 
-#if 0
-  REAL tmp, z, l3;
+  REAL tmp, z, l3, rl3, g32;
+
+  if(otf->model & DFT_ZERO) return 0.0;
+  if((otf->model & DFT_GP) || (otf->model & DFT_GP2)) return otf->mu0 / 2.0;
 
+  /* dP/drho = rho d^2E/drho^2 */
   tmp = otf->b * rho + 3.0 * otf->c2 * rho * rho + 4.0 * otf->c3 * rho * rho * rho;
   if(otf->c4 != 0.0) {
-   l3 = dft_common_lwl3(otf->mass, otf->temp);
-   z = dft_common_fit_z(rho * l3);
-   tmp += GRID_AUKB * otf->temp * dft_common_fit_g32(z) / dft_common_fit_g12(z);
+    l3 = dft_common_lwl3(otf->mass, otf->temp);
+    rl3 = rho * l3;
+    g32 = dft_common_fit_g32(1.0);
+    if(rl3 < g32) {  /* zero above the condensation density (dE/drho constant) */
+      z = dft_common_fit_z(rl3);
+      tmp += otf->c4 * GRID_AUKB * otf->temp * dft_common_fit_g32(z) / dft_common_fit_g12(z);
+    }
   }
   return tmp;
-#else
-  return (dft_ot_bulk_pressure(otf, rho+LOCAL_EPS) - dft_ot_bulk_pressure(otf, rho-LOCAL_EPS)) / (2.0 * LOCAL_EPS);
-#endif
+}
+
+/*
+ * Cubic Hermite interpolation on [0, h] with values y0, y1 and derivatives d0, d1 at t * h (0 <= t <= 1).
+ * If deriv is not NULL, the derivative of the interpolant is also returned.
+ *
+ */
+
+static inline REAL ot_eos_hermite(REAL y0, REAL y1, REAL d0, REAL d1, REAL h, REAL t, REAL *deriv) {
+
+  REAL t2 = t * t, t3 = t2 * t;
+
+  if(deriv)
+    *deriv = (6.0 * t2 - 6.0 * t) * (y0 - y1) / h + (3.0 * t2 - 4.0 * t + 1.0) * d0 + (3.0 * t2 - 2.0 * t) * d1;
+  return (2.0 * t3 - 3.0 * t2 + 1.0) * y0 + (t3 - 2.0 * t2 + t) * h * d0 + (-2.0 * t3 + 3.0 * t2) * y1 + (t3 - t2) * h * d1;
+}
+
+/*
+ * Fritsch-Carlson limiter: modify the derivatives d so that the Hermite interpolant of
+ * the monotonic data y (n points with step h) stays monotonic.
+ *
+ */
+
+static void ot_eos_monotone(REAL *y, REAL *d, INT n, REAL h) {
+
+  INT i;
+  REAL delta, a, b, tau;
+
+  for (i = 0; i < n - 1; i++) {
+    delta = (y[i + 1] - y[i]) / h;
+    if(delta == 0.0) {
+      d[i] = d[i + 1] = 0.0;
+      continue;
+    }
+    a = d[i] / delta;
+    b = d[i + 1] / delta;
+    if(a < 0.0) d[i] = a = 0.0;
+    if(b < 0.0) d[i + 1] = b = 0.0;
+    if(a * a + b * b > 9.0) {
+      tau = 3.0 / SQRT(a * a + b * b);
+      d[i] = tau * a * delta;
+      d[i + 1] = tau * b * delta;
+    }
+  }
+}
+
+/*
+ * Density at given pressure from the exact equation of state. Safeguarded Newton-Raphson
+ * in [lo, hi] where P(lo) <= pressure <= P(hi).
+ *
+ */
+
+static REAL ot_eos_invert(dft_ot_functional *otf, REAL pressure, REAL lo, REAL hi) {
+
+  REAL rho = 0.5 * (lo + hi), f, df, tol = 1E-14 * hi;
+  INT i;
+
+  for (i = 0; i < 200; i++) {
+    f = dft_ot_bulk_pressure(otf, rho) - pressure;
+    if(f < 0.0) lo = rho;
+    else hi = rho;
+    df = dft_ot_bulk_dPdRho(otf, rho);
+    if(df > 0.0) rho -= f / df;
+    if(df <= 0.0 || rho <= lo || rho >= hi) rho = 0.5 * (lo + hi);  /* bisection step */
+    if(hi - lo < tol || (df > 0.0 && FABS(f) < tol * df)) break;
+  }
+  return rho;
+}
+
+static void ot_eos_free_tables(dft_ot_eos *eos) {
+
+  if(eos->p) free(eos->p);
+  if(eos->dp) free(eos->dp);
+  if(eos->mu) free(eos->mu);
+  if(eos->dmu) free(eos->dmu);
+  if(eos->rho) free(eos->rho);
+  if(eos->drho) free(eos->drho);
+  eos->p = eos->dp = eos->mu = eos->dmu = eos->rho = eos->drho = NULL;
+}
+
+/*
+ * Build the density table with n points and return the estimated maximum relative
+ * interpolation error (evaluated at the midpoints).
+ *
+ */
+
+static REAL ot_eos_build(dft_ot_functional *otf, dft_ot_eos *eos, INT n) {
+
+  INT i;
+  REAL rho, pmax = 0.0, mumax = 0.0, err = 0.0, tmp;
+
+  ot_eos_free_tables(eos);
+  eos->n = n;
+  eos->h = (eos->rho_max - eos->rho_min) / (REAL) (n - 1);
+  if(!(eos->p = (REAL *) malloc(sizeof(REAL) * (size_t) n)) || !(eos->dp = (REAL *) malloc(sizeof(REAL) * (size_t) n))
+     || !(eos->mu = (REAL *) malloc(sizeof(REAL) * (size_t) n)) || !(eos->dmu = (REAL *) malloc(sizeof(REAL) * (size_t) n))) {
+    fprintf(stderr, "libdft: Error in dft_ot_eos_enable(): Could not allocate memory.\n");
+    exit(1);
+  }
+#pragma omp parallel for firstprivate(otf,eos,n) private(i,rho) default(none) schedule(runtime)
+  for (i = 0; i < n; i++) {
+    rho = eos->rho_min + eos->h * (REAL) i;
+    eos->p[i] = dft_ot_bulk_pressure(otf, rho);
+    eos->dp[i] = dft_ot_bulk_dPdRho(otf, rho);
+    eos->mu[i] = dft_ot_bulk_dEdRho(otf, rho);
+    eos->dmu[i] = eos->dp[i] / rho;   /* dmu/drho = d^2E/drho^2 */
+  }
+
+  for (i = 0; i < n; i++) {
+    if(FABS(eos->p[i]) > pmax) pmax = FABS(eos->p[i]);
+    if(FABS(eos->mu[i]) > mumax) mumax = FABS(eos->mu[i]);
+  }
+  for (i = 0; i < n - 1; i++) {
+    rho = eos->rho_min + eos->h * ((REAL) i + 0.5);
+    tmp = FABS(ot_eos_hermite(eos->p[i], eos->p[i + 1], eos->dp[i], eos->dp[i + 1], eos->h, 0.5, NULL) - dft_ot_bulk_pressure(otf, rho)) / pmax;
+    if(tmp > err) err = tmp;
+    tmp = FABS(ot_eos_hermite(eos->mu[i], eos->mu[i + 1], eos->dmu[i], eos->dmu[i + 1], eos->h, 0.5, NULL) - dft_ot_bulk_dEdRho(otf, rho)) / mumax;
+    if(tmp > err) err = tmp;
+  }
+  return err;
+}
+
+/*
+ * Build the inverse (pressure) table over the range where P(rho) increases monotonically.
+ *
+ */
+
+static void ot_eos_build_inverse(dft_ot_functional *otf, dft_ot_eos *eos) {
+
+  INT i, j, i0, n = eos->n;
+  REAL pressure;
+
+  /* Monotonic part: P increasing up to rho_max */
+  for (i0 = n - 1; i0 > 0 && eos->dp[i0 - 1] > 0.0 && eos->p[i0 - 1] < eos->p[i0]; i0--);
+  eos->np = n - i0;
+  if(eos->np < 2) {
+    eos->np = 0;
+    fprintf(stderr, "libdft: Warning - no monotonic P(rho) in the EOS table; inverse table not available.\n");
+    return;
+  }
+  eos->p_min = eos->p[i0];
+  eos->p_max = eos->p[n - 1];
+  eos->hp = (eos->p_max - eos->p_min) / (REAL) (eos->np - 1);
+  if(!(eos->rho = (REAL *) malloc(sizeof(REAL) * (size_t) eos->np)) || !(eos->drho = (REAL *) malloc(sizeof(REAL) * (size_t) eos->np))) {
+    fprintf(stderr, "libdft: Error in dft_ot_eos_enable(): Could not allocate memory.\n");
+    exit(1);
+  }
+  j = i0;
+  for (i = 0; i < eos->np; i++) {
+    pressure = eos->p_min + eos->hp * (REAL) i;
+    while(j < n - 2 && eos->p[j + 1] < pressure) j++;
+    if(i == 0) eos->rho[i] = eos->rho_min + eos->h * (REAL) i0;
+    else if(i == eos->np - 1) eos->rho[i] = eos->rho_max;
+    else eos->rho[i] = ot_eos_invert(otf, pressure, eos->rho_min + eos->h * (REAL) j, eos->rho_min + eos->h * (REAL) (j + 1));
+    eos->drho[i] = 1.0 / dft_ot_bulk_dPdRho(otf, eos->rho[i]);
+  }
+  ot_eos_monotone(eos->rho, eos->drho, eos->np, eos->hp);
+}
+
+/*
+ * Tabulate the bulk equation of state for the functional. After this call, dft_ot_bulk_density_pressurized(),
+ * dft_ot_bulk_chempot_pressurized(), dft_ot_bulk_compressibility(), dft_ot_bulk_sound_speed() and their
+ * array versions use cubic Hermite interpolation with analytic derivatives (O(1) lookups)
+ * within the tabulated range. Outside the range, the exact expressions are used.
+ *
+ * otf     = OT functional (dft_ot_functional *; input/output).
+ * rho_min = Lowest density in the table (REAL; input; > 0).
+ * rho_max = Highest density in the table (REAL; input).
+ * tol     = Maximum relative interpolation error (REAL; input). The number of points is doubled
+ *           (starting from DFT_OT_EOS_N0, up to DFT_OT_EOS_NMAX) until the estimated error is below tol.
+ *
+ * The inverse table (density vs. pressure) covers the part of the density range where
+ * the pressure increases monotonically (i.e., above the spinodal) and the interpolation is
+ * made monotonic (Fritsch-Carlson).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_eos_enable(dft_ot_functional *otf, REAL rho_min, REAL rho_max, REAL tol) {
+
+  dft_ot_eos *eos;
+  INT n;
+  REAL err;
+
+  if(otf->model & (DFT_ZERO | DFT_GP | DFT_GP2)) return;  /* trivial */
+  if(rho_min <= 0.0 || rho_max <= rho_min) {
+    fprintf(stderr, "libdft: Illegal density range in dft_ot_eos_enable().\n");
+    exit(1);
+  }
+  if(otf->eos) dft_ot_eos_disable(otf);
+  if(!(eos = (dft_ot_eos *) malloc(sizeof(dft_ot_eos)))) {
+    fprintf(stderr, "libdft: Error in dft_ot_eos_enable(): Could not allocate memory.\n");
+    exit(1);
+  }
+  eos->p = eos->dp = eos->mu = eos->dmu = eos->rho = eos->drho = NULL;
+  eos->rho_min = rho_min;
+  eos->rho_max = rho_max;
+  for (n = DFT_OT_EOS_N0; ; n *= 2) {
+    err = ot_eos_build(otf, eos, n);
+    if(err <= tol || 2 * n > DFT_OT_EOS_NMAX) break;
+  }
+  if(err > tol)
+    fprintf(stderr, "libdft: Warning - EOS table error " FMT_R " exceeds the requested tolerance.\n", err);
+  eos->error = err;
+  eos->tol = tol;
+  ot_eos_build_inverse(otf, eos);
+  otf->eos = eos;
+}
+
+/*
+ * Release the tabulated equation of state (revert to direct evaluation).
+ *
+ * otf = OT functional (dft_ot_functional *; input/output).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_eos_disable(dft_ot_functional *otf) {
+
+  if(!otf->eos) return;
+  ot_eos_free_tables(otf->eos);
+  free(otf->eos);
+  otf->eos = NULL;
+}
+
+/*
+ * Table lookup of P, dP/drho and mu at density rho. Returns 0 if rho is outside the table.
+ *
+ */
+
+static inline char ot_eos_lookup(dft_ot_eos *eos, REAL rho, REAL *p, REAL *dp, REAL *mu) {
+
+  REAL x, tmp;
+  INT i;
+
+  if(!eos || rho < eos->rho_min || rho > eos->rho_max) return 0;
+  x = (rho - eos->rho_min) / eos->h;
+  i = (INT) x;
+  if(i > eos->n - 2) i = eos->n - 2;
+  x -= (REAL) i;
+  if(p || dp) {
+    tmp = ot_eos_hermite(eos->p[i], eos->p[i + 1], eos->dp[i], eos->dp[i + 1], eos->h, x, dp);
+    if(p) *p = tmp;
+  }
+  if(mu) *mu = ot_eos_hermite(eos->mu[i], eos->mu[i + 1], eos->dmu[i], eos->dmu[i + 1], eos->h, x, NULL);
+  return 1;
+}
+
+/*
+ * Table lookup of density at given pressure. Returns 0 if pressure is outside the table.
+ * The inverse table gives the initial guess, which is polished by safeguarded Newton
+ * iteration on the interpolated P(rho) (bisection when the Newton step leaves the bracket)
+ * until the pressure residual corresponds to a relative density error below eos->tol.
+ * The result is therefore consistent with the density table.
+ *
+ */
+
+#define OT_EOS_INVERSE_MAXITER 100
+
+static inline char ot_eos_lookup_inverse(dft_ot_eos *eos, REAL pressure, REAL *rho) {
+
+  REAL x, r, p, dp, lo, hi;
+  INT i;
+
+  if(!eos || eos->np < 2 || pressure < eos->p_min || pressure > eos->p_max) return 0;
+  x = (pressure - eos->p_min) / eos->hp;
+  i = (INT) x;
+  if(i > eos->np - 2) i = eos->np - 2;
+  x -= (REAL) i;
+  r = ot_eos_hermite(eos->rho[i], eos->rho[i + 1], eos->drho[i], eos->drho[i + 1], eos->hp, x, NULL);
+
+  /* Bracket: P(lo) <= pressure <= P(hi) */
+  lo = eos->rho[i];
+  hi = eos->rho[i + 1];
+  ot_eos_lookup(eos, lo, &p, NULL, NULL);
+  if(p > pressure) lo = eos->rho[0];
+  ot_eos_lookup(eos, hi, &p, NULL, NULL);
+  if(p < pressure) hi = eos->rho_max;
+  if(r <= lo || r >= hi) r = 0.5 * (lo + hi);
+
+  for (i = 0; i < OT_EOS_INVERSE_MAXITER; i++) {
+    ot_eos_lookup(eos, r, &p, &dp, NULL);
+    if(dp > 0.0 && FABS(p - pressure) <= eos->tol * dp * r) break;
+    if(p < pressure) lo = r; else hi = r;
+    if(hi - lo <= eos->tol * r) break;
+    if(dp > 0.0) r -= (p - pressure) / dp;
+    if(dp <= 0.0 || r <= lo || r >= hi) r = 0.5 * (lo + hi);  /* bisection */
+  }
+  if(i == OT_EOS_INVERSE_MAXITER)
+    fprintf(stderr, "libdft: Warning - EOS inverse lookup did not converge.\n");
+  *rho = r;
+  return 1;
 }
 
 /*
@@ -191,18 +486,25 @@ EXPORT REAL dft_ot_bulk_dPdRho(dft_ot_functional *otf, REAL rho) {
  *
  * Returns equilibrium bulk density at given pressure.
  *
+ * If the EOS table is enabled (dft_ot_eos_enable()) and the pressure is within its range,
+ * the density is interpolated from the table.
+ *
  */
 
 EXPORT REAL dft_ot_bulk_density_pressurized(dft_ot_functional *otf, REAL pressure) {
 
   REAL rho0 = 1.0;
-  REAL misP = dft_ot_bulk_pressure(otf, rho0) - pressure;
+  REAL misP;
   REAL tol2 = 1.0E-12;
   int i, maxiter = 1000;
 
   if(otf->model & DFT_ZERO) return 0.0;
 
   if((otf->model & DFT_GP) || (otf->model & DFT_GP2)) return otf->rho0;  // no density dep.
+
+  if(ot_eos_lookup_inverse(otf->eos, pressure, &rho0)) return rho0;
+  rho0 = 1.0;
+  misP = dft_ot_bulk_pressure(otf, rho0) - pressure;
   
   /*
    * Newton-Rapson to solve for rho:
@@ -233,7 +535,11 @@ EXPORT REAL dft_ot_bulk_density_pressurized(dft_ot_functional *otf, REAL pressur
 
 EXPORT REAL dft_ot_bulk_chempot_pressurized(dft_ot_functional *otf, REAL pressure) {
 
-  return dft_ot_bulk_dEdRho(otf, dft_ot_bulk_density_pressurized(otf, pressure));
+  REAL rho, mu;
+
+  rho = dft_ot_bulk_density_pressurized(otf, pressure);
+  if(ot_eos_lookup(otf->eos, rho, NULL, NULL, &mu)) return mu;
+  return dft_ot_bulk_dEdRho(otf, rho);
 }
 
 /*
@@ -243,7 +549,10 @@ EXPORT REAL dft_ot_bulk_chempot_pressurized(dft_ot_functional *otf, REAL pressur
 
 EXPORT REAL dft_ot_bulk_compressibility(dft_ot_functional *otf, REAL rho) {
 
-  return 1.0 / (rho * dft_ot_bulk_dPdRho(otf, rho));
+  REAL dp;
+
+  if(!ot_eos_lookup(otf->eos, rho, NULL, &dp, NULL)) dp = dft_ot_bulk_dPdRho(otf, rho);
+  return 1.0 / (rho * dp);
 }
 
 /*
@@ -256,6 +565,54 @@ EXPORT REAL dft_ot_bulk_sound_speed(dft_ot_functional *otf, REAL rho) {
   return 1.0 / SQRT(otf->mass * rho * dft_ot_bulk_compressibility(otf, rho));
 }
 
+/*
+ * Array versions of the above (evaluated in parallel).
+ *
+ * otf = OT functional (dft_ot_functional *; input).
+ * in  = Input pressures or densities (REAL *; input).
+ * out = Output values (REAL *; output).
+ * n   = Number of values (INT; input).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_bulk_density_pressurized_array(dft_ot_functional *otf, REAL *in, REAL *out, INT n) {
+
+  INT i;
+
+#pragma omp parallel for firstprivate(otf,in,out,n) private(i) default(none) schedule(runtime)
+  for (i = 0; i < n; i++)
+    out[i] = dft_ot_bulk_density_pressurized(otf, in[i]);
+}
+
+EXPORT void dft_ot_bulk_chempot_pressurized_array(dft_ot_functional *otf, REAL *in, REAL *out, INT n) {
+
+  INT i;
+
+#pragma omp parallel for firstprivate(otf,in,out,n) private(i) default(none) schedule(runtime)
+  for (i = 0; i < n; i++)
+    out[i] = dft_ot_bulk_chempot_pressurized(otf, in[i]);
+}
+
+EXPORT void dft_ot_bulk_compressibility_array(dft_ot_functional *otf, REAL *in, REAL *out, INT n) {
+
+  INT i;
+
+#pragma omp parallel for firstprivate(otf,in,out,n) private(i) default(none) schedule(runtime)
+  for (i = 0; i < n; i++)
+    out[i] = dft_ot_bulk_compressibility(otf, in[i]);
+}
+
+EXPORT void dft_ot_bulk_sound_speed_array(dft_ot_functional *otf, REAL *in, REAL *out, INT n) {
+
+  INT i;
+
+#pragma omp parallel for firstprivate(otf,in,out,n) private(i) default(none) schedule(runtime)
+  for (i = 0; i < n; i++)
+    out[i] = dft_ot_bulk_sound_speed(otf, in[i]);
+}
+
 /*
  * Calculate bulk dispersion relation (omega vs. k). Numerical solution for current otf.
  *
@@ -360,6 +717,205 @@ EXPORT REAL dft_ot_dispersion(wf *gwf, dft_ot_functional *otf, REAL ts, REAL *k,
   return (omega / GRID_AUTOS) * GRID_HZTOCM1 * 1.439 /* cm-1 to K */ / GRID_AUTOK;
 }
 
+/* Superposition of plane waves for dft_ot_dispersion_multi() */
+typedef struct {
+  REAL *k;
+  INT nk;
+  REAL amp;
+  REAL rho;
+} ot_multi_wave;
+
+static REAL complex ot_multi_wave_map(void *arg, REAL x, REAL y, REAL z) {
+
+  ot_multi_wave *w = (ot_multi_wave *) arg;
+  REAL val = 1.0;
+  INT m;
+
+  for (m = 0; m < w->nk; m++)
+    val += w->amp * COS(w->k[m] * z);
+  if(val < 0.0) val = 0.0;
+  return SQRT(w->rho * val);
+}
+
+/*
+ * Magnitude of the windowed Fourier transform of signal c (n points, time step dt) at frequency omega.
+ *
+ */
+
+static REAL ot_multi_spectrum(REAL *c, INT n, REAL dt, REAL omega) {
+
+  REAL complex sum = 0.0;
+  INT t;
+
+  for (t = 0; t < n; t++)
+    sum += 0.5 * (1.0 - COS(2.0 * M_PI * (REAL) t / (REAL) (n - 1))) * c[t] * CEXP(-I * omega * dt * (REAL) t);
+  return CABS(sum);
+}
+
+/*
+ * Frequency of signal c (n points, time step dt). The zero crossings give the initial estimate,
+ * which is refined by maximizing the windowed Fourier transform within one frequency bin (golden section).
+ *
+ */
+
+#define OT_MULTI_GOLDEN 0.38196601125010515180
+#define OT_MULTI_ITER 60
+
+static REAL ot_multi_frequency(REAL *c, INT n, REAL dt) {
+
+  INT t, ncross = 0;
+  REAL t0 = 0.0, t1 = 0.0, tc, omega, dw, a, b, x1, x2, f1, f2;
+
+  for (t = 1; t < n; t++)
+    if((c[t - 1] < 0.0 && c[t] >= 0.0) || (c[t - 1] >= 0.0 && c[t] < 0.0)) {
+      tc = dt * ((REAL) (t - 1) + c[t - 1] / (c[t - 1] - c[t]));
+      if(!ncross) t0 = tc;
+      t1 = tc;
+      ncross++;
+    }
+  if(ncross < 2) return 0.0;
+  omega = M_PI * (REAL) (ncross - 1) / (t1 - t0);
+
+  dw = 2.0 * M_PI / (dt * (REAL) n);
+  a = omega - dw;
+  if(a < 0.0) a = 0.0;
+  b = omega + dw;
+  x1 = a + OT_MULTI_GOLDEN * (b - a);
+  x2 = b - OT_MULTI_GOLDEN * (b - a);
+  f1 = ot_multi_spectrum(c, n, dt, x1);
+  f2 = ot_multi_spectrum(c, n, dt, x2);
+  for (t = 0; t < OT_MULTI_ITER; t++) {
+    if(f1 > f2) {
+      b = x2;
+      x2 = x1;
+      f2 = f1;
+      x1 = a + OT_MULTI_GOLDEN * (b - a);
+      f1 = ot_multi_spectrum(c, n, dt, x1);
+    } else {
+      a = x1;
+      x1 = x2;
+      f1 = f2;
+      x2 = b - OT_MULTI_GOLDEN * (b - a);
+      f2 = ot_multi_spectrum(c, n, dt, x2);
+    }
+  }
+  return 0.5 * (a + b);
+}
+
+/*
+ * Calculate bulk dispersion relation (omega vs. k) for several wave vectors from one propagation.
+ * Numerical solution for the functional model of otf.
+ *
+ * Since the excitations are plane waves along one axis, the calculation uses the 1-D reduction
+ * (nx = ny = 1) of the system: n points along z with the given step. Small amplitude plane waves
+ * for all wave vectors are seeded at once and the density is projected onto each mode at every
+ * time step. The frequencies are then extracted from the resulting time series.
+ *
+ * otf   = Orsay-Trento functional (dft_ot_functional *; input). The model and parameters (including rho0)
+ *         are used for the 1-D functional (dft_ot_alloc_like()).
+ * step  = Spatial step in Bohr (REAL; input).
+ * n     = Number of grid points along the propagation axis (INT; input). 
+ *         The wave vectors are multiples of 2 pi / (n step).
+ * ts    = Time step in a.u. (REAL; input).
+ * nt    = Number of time steps (INT; input). This must cover at least one period of the lowest mode.
+ * k     = Requested wave vectors in a.u. (REAL *; input/output). On output, the values are rounded
+ *         to the nearest ones supported by the grid. Values above the Nyquist limit (pi / step) are
+ *         rejected.
+ * omega = Energies (omega; a.u.) for each k (REAL *; output). Zero if the frequency could not be
+ *         determined (k = 0 or too few time steps).
+ * nk    = Number of wave vectors (INT; input).
+ * amp   = Amplitude of each mode relative to rho0 (REAL; input). Use amp * nk << 1 to stay in the linear regime.
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_dispersion_multi(dft_ot_functional *otf, REAL step, INT n, REAL ts, INT nt, REAL *k, REAL *omega, INT nk, REAL amp) {
+
+  REAL dk = 2.0 * M_PI / (((REAL) n) * step), rho0, mu0, z, *c, *cs;
+  ot_multi_wave wave_params;
+  dft_ot_functional *otf1;
+  wf *gwf, *gwfp;
+  cgrid *potential;
+  rgrid *density;
+  INT l, m, i;
+
+  if(n < 2 || nt < 2 || nk < 1) {
+    fprintf(stderr, "libdft: Illegal parameters in dft_ot_dispersion_multi().\n");
+    exit(1);
+  }
+  for (m = 0; m < nk; m++) {
+    if(FABS(k[m]) > M_PI / step) {
+      fprintf(stderr, "libdft: k = " FMT_R " above the Nyquist limit (" FMT_R ") in dft_ot_dispersion_multi().\n", k[m], M_PI / step);
+      exit(1);
+    }
+    k[m] = ((REAL) (((INT) (0.5 + k[m] / dk)))) * dk;
+  }
+
+  gwf = grid_wf_alloc(1, 1, n, step, otf->mass, WF_PERIODIC_BOUNDARY, WF_2ND_ORDER_FFT, "gwf for dft_ot_dispersion_multi");
+  gwfp = grid_wf_clone(gwf, "gwfp for dft_ot_dispersion_multi");
+  potential = cgrid_clone(gwf->grid, "potential for dft_ot_dispersion_multi");
+  if(!(otf1 = dft_ot_alloc_like(otf, gwf, DFT_MIN_SUBSTEPS, DFT_MAX_SUBSTEPS))) {
+    fprintf(stderr, "libdft: Could not allocate 1-D functional in dft_ot_dispersion_multi().\n");
+    exit(1);
+  }
+  density = rgrid_clone(otf1->density, "density for dft_ot_dispersion_multi");
+  if(!(c = (REAL *) malloc(sizeof(REAL) * (size_t) (nk * nt))) || !(cs = (REAL *) malloc(sizeof(REAL) * (size_t) n))) {
+    fprintf(stderr, "libdft: Error in dft_ot_dispersion_multi(): Could not allocate memory.\n");
+    exit(1);
+  }
+  rho0 = otf1->rho0;   /* = otf->rho0 */
+  mu0 = dft_ot_bulk_chempot2(otf1);
+
+  wave_params.k = k;
+  wave_params.nk = nk;
+  wave_params.amp = amp;
+  wave_params.rho = rho0;
+  grid_wf_map(gwf, ot_multi_wave_map, &wave_params);
+
+  for(l = 0; l < nt; l++) {
+    /* Project the density onto each mode */
+    grid_wf_density(gwf, density);
+    for (i = 0; i < n; i++)
+      cs[i] = rgrid_value_at_index(density, 0, 0, i) - rho0;
+    for (m = 0; m < nk; m++) {
+      c[m * nt + l] = 0.0;
+      for (i = 0; i < n; i++) {
+        z = ((REAL) (i - n / 2)) * step - density->z0;
+        c[m * nt + l] += cs[i] * COS(k[m] * z);
+      }
+    }
+    /* Predict-correct propagation */
+    cgrid_zero(potential);
+    cgrid_copy(gwfp->grid, gwf->grid);
+    dft_ot_potential(otf1, potential, gwf);
+    cgrid_add(potential, -mu0);
+    grid_wf_propagate_predict(gwf, gwfp, potential, ts);
+    dft_ot_potential(otf1, potential, gwfp);
+    cgrid_add(potential, -mu0);
+    cgrid_multiply(potential, 0.5);
+    grid_wf_propagate_correct(gwf, potential, ts);
+  }
+
+  for (m = 0; m < nk; m++) {
+    if(k[m] == 0.0) {
+      omega[m] = 0.0;
+      continue;
+    }
+    omega[m] = ot_multi_frequency(&c[m * nt], nt, ts);
+    if(omega[m] == 0.0)
+      fprintf(stderr, "libdft: Warning - too few time steps for k = " FMT_R " in dft_ot_dispersion_multi().\n", k[m]);
+  }
+
+  free(c);
+  free(cs);
+  rgrid_free(density);
+  dft_ot_free(otf1);
+  cgrid_free(potential);
+  grid_wf_free(gwfp);
+  grid_wf_free(gwf);
+}
+
 /*
  * Calculate bulk dispersion relation (omega vs. k). Semi-analytic solution.
  *
@@ -376,18 +932,108 @@ EXPORT REAL dft_ot_dispersion(wf *gwf, dft_ot_functional *otf, REAL ts, REAL *k,
  *
  */
 
-#define FT_UL 1E3
-#define FT_STEP 1.0E-2
+#define FT_EULER 0.57721566490153286061
+#define FT_EPS 1E-15
+#define FT_MAXITER 100000
+
+/*
+ * Exponential integral E_n(-ix) = \int_1^\infty exp(ixt) t^{-n} dt for integer n > 1 and x > 0.
+ * Series expansion for x <= 1 and continued fraction (modified Lentz) otherwise.
+ *
+ */
+
+static REAL complex ft_expint(INT n, REAL x) {
+
+  REAL complex z = -I * x, b, c, d, h, del, fact, ans;
+  REAL psi, an;
+  INT i, j;
+
+  if(x > 1.0) {
+    b = z + (REAL) n;
+    c = 1.0 / 1E-300;
+    d = 1.0 / b;
+    h = d;
+    for (i = 1; i < FT_MAXITER; i++) {
+      an = -(REAL) (i * (n - 1 + i));
+      b += 2.0;
+      d = 1.0 / (an * d + b);
+      c = b + an / c;
+      del = c * d;
+      h *= del;
+      if(CABS(del - 1.0) < FT_EPS) break;
+    }
+    return h * CEXP(-z);
+  }
+  ans = 1.0 / (REAL) (n - 1);
+  fact = 1.0;
+  for (i = 1; i < FT_MAXITER; i++) {
+    fact *= -z / (REAL) i;
+    if(i != n - 1) del = -fact / (REAL) (i - n + 1);
+    else {
+      psi = -FT_EULER;
+      for (j = 1; j < n; j++) psi += 1.0 / (REAL) j;
+      del = fact * (-(LOG(x) - I * M_PI / 2.0) + psi);  /* log(-ix) */
+    }
+    ans += del;
+    if(CABS(del) < CABS(ans) * FT_EPS) break;
+  }
+  return ans;
+}
+
+/*
+ * Radial Fourier transform of the screened LJ kernel (zero for r < h):
+ *
+ * V(k) = (16 pi epsilon sigma^3 / q) \int_a^\infty sin(qx) (x^{-11} - x^{-5}) dx
+ *
+ * with q = k sigma and a = h / sigma. Since \int_a^\infty exp(iqx) x^{-n} dx = a^{1-n} E_n(-iqa),
+ * the integrals are the imaginary parts of the exponential integrals.
+ *
+ */
+
+static REAL ft_lj_direct(dft_common_lj *lj, REAL k) {
+
+  REAL sigma = lj->sigma, epsilon = lj->epsilon, a = lj->h / sigma, q = k * sigma;
+
+  if(q == 0.0) return 16.0 * M_PI * epsilon * sigma * sigma * sigma * (POW(a, -9.0) / 9.0 - POW(a, -3.0) / 3.0);
+  return (16.0 * M_PI * epsilon * sigma * sigma * sigma / q) 
+    * (POW(a, -10.0) * CIMAG(ft_expint(11, q * a)) - POW(a, -4.0) * CIMAG(ft_expint(5, q * a)));
+}
+
+/*
+ * LJ Fourier transform from the table cached in otf (cubic interpolation).
+ * The table is (re)computed when the LJ parameters change.
+ *
+ */
 
 static REAL ft_lj(dft_ot_functional *otf, REAL k) {
 
-  REAL sigma = otf->lj_params.sigma, epsilon = otf->lj_params.epsilon, h = otf->lj_params.h;
-  REAL val = 0.0, x, ks = k * sigma;
+  REAL dk = DFT_OT_LJ_TABLE_KMAX / (REAL) (DFT_OT_LJ_TABLE_N - 1), t, *y;
+  INT i;
 
-  for (x = h / sigma; x < FT_UL; x += FT_STEP) 
-    val += SIN(ks * x) * (POW(x, -11.0) - POW(x, -5.0));
-  val *= FT_STEP * 16.0 * M_PI * epsilon * sigma * sigma * sigma / ks;
-  return val;
+  if(k >= DFT_OT_LJ_TABLE_KMAX) return ft_lj_direct(&(otf->lj_params), k);
+  if(otf->lj_table && (otf->lj_table_params.h != otf->lj_params.h || otf->lj_table_params.sigma != otf->lj_params.sigma
+                       || otf->lj_table_params.epsilon != otf->lj_params.epsilon)) {
+    free(otf->lj_table);
+    otf->lj_table = NULL;
+  }
+  if(!otf->lj_table) {
+    if(!(otf->lj_table = (REAL *) malloc(sizeof(REAL) * DFT_OT_LJ_TABLE_N))) {
+      fprintf(stderr, "libdft: Error in ft_lj(): Could not allocate memory.\n");
+      exit(1);
+    }
+    for (i = 0; i < DFT_OT_LJ_TABLE_N; i++)
+      otf->lj_table[i] = ft_lj_direct(&(otf->lj_params), dk * (REAL) i);
+    otf->lj_table_params = otf->lj_params;
+  }
+
+  /* 4-point Lagrange interpolation between points i and i + 1 */
+  i = (INT) (k / dk);
+  if(i < 1) i = 1;
+  if(i > DFT_OT_LJ_TABLE_N - 3) i = DFT_OT_LJ_TABLE_N - 3;
+  t = k / dk - (REAL) i;
+  y = &(otf->lj_table[i - 1]);
+  return -t * (t - 1.0) * (t - 2.0) * y[0] / 6.0 + (t + 1.0) * (t - 1.0) * (t - 2.0) * y[1] / 2.0
+         - (t + 1.0) * t * (t - 2.0) * y[2] / 2.0 + (t + 1.0) * t * (t - 1.0) * y[3] / 6.0;
 }
 
 static REAL ft_pi(dft_ot_functional *otf, REAL k) {
@@ -411,12 +1057,16 @@ static REAL ft_vj(dft_ot_functional *otf, REAL k) {
   return val;
 }
 
-EXPORT REAL dft_ot_bulk_dispersion(dft_ot_functional *otf, REAL *k, REAL rho0) {
+/*
+ * Dispersion relation at one (k, rho0) point. vj0 = ft_vj(otf, 0.0) (only used with backflow).
+ *
+ */
+
+static REAL ot_bulk_dispersion(dft_ot_functional *otf, REAL tk, REAL rho0, REAL vj0) {
 
-  REAL tmp, lj, pi, vj, vj0, ikai, tk;
+  REAL tmp, lj, pi, vj, ikai;
 
   if(rho0 < 0.0) return 0.0;
-  tk = *k;
   if(tk < 1E-3) return 0.0;
   lj = ft_lj(otf, tk);
   pi = ft_pi(otf, tk);
@@ -430,28 +1080,54 @@ EXPORT REAL dft_ot_bulk_dispersion(dft_ot_functional *otf, REAL *k, REAL rho0) {
            * EXP(-tk * tk * otf->l_g * otf->l_g / 4.0);
   if(otf->model & DFT_OT_BACKFLOW) {
     vj = ft_vj(otf, tk);
-    vj0 = ft_vj(otf, 0.0);
     return SQRT(tmp * ikai * (1.0 - rho0 * (vj0 - vj)));
   }
   return SQRT(tmp * ikai);
 }
 
+EXPORT REAL dft_ot_bulk_dispersion(dft_ot_functional *otf, REAL *k, REAL rho0) {
+
+  return ot_bulk_dispersion(otf, *k, rho0, (otf->model & DFT_OT_BACKFLOW)?ft_vj(otf, 0.0):0.0);
+}
+
 /*
- * Calculation of the static structure factor X(q).
+ * Calculate bulk dispersion relation (omega vs. k) for arrays of k and rho0. Semi-analytic solution.
  *
- * otf  = functional (dft_ot_functional *; input).
- * k    = momentum (REAL *; input).
+ * otf   = functional (dft_ot_functional *; input).
+ * omega = energies (omega; a.u.) with omega[ir * nk + ik] corresponding to k[ik] and rho0[ir]
+ *         (REAL *; output). Must hold nk * nrho values.
+ * k     = momenta (REAL *; input).
+ * nk    = number of momenta (INT; input).
+ * rho0  = bulk densities (REAL *; input).
+ * nrho  = number of densities (INT; input).
+ *
+ * The points are evaluated in parallel (OpenMP).
+ *
+ * No return value.
  *
- * Returns -1/X(q)
- * 
  */
 
-EXPORT REAL dft_ot_bulk_istatic(dft_ot_functional *otf, REAL *k, REAL rho0) {
+EXPORT void dft_ot_bulk_dispersion_array(dft_ot_functional *otf, REAL *omega, REAL *k, INT nk, REAL *rho0, INT nrho) {
 
-  REAL lj, pi, ikai, tk;
+  INT i, n = nk * nrho;
+  REAL vj0 = (otf->model & DFT_OT_BACKFLOW)?ft_vj(otf, 0.0):0.0;
+
+  (void) ft_lj(otf, 0.0);  /* make sure that the LJ table is ready before entering the parallel region */
+#pragma omp parallel for firstprivate(otf,omega,k,nk,rho0,n,vj0) private(i) default(none) schedule(runtime)
+  for (i = 0; i < n; i++)
+    omega[i] = ot_bulk_dispersion(otf, k[i % nk], rho0[i / nk], vj0);
+}
+
+/*
+ * -1/X(q) at one (k, rho0) point.
+ *
+ */
+
+static REAL ot_bulk_istatic(dft_ot_functional *otf, REAL tk, REAL rho0) {
+
+  REAL lj, pi, ikai;
 
   if(rho0 < 0.0) return 0.0;
-  tk = *k;
   if(tk < 1E-2) return tk = 1E-2;
   lj = ft_lj(otf, tk);
   pi = ft_pi(otf, tk);
@@ -467,57 +1143,167 @@ EXPORT REAL dft_ot_bulk_istatic(dft_ot_functional *otf, REAL *k, REAL rho0) {
 }
 
 /*
- * Calculate free (flat) surface tension.
- *
- * gwf = Wave function (wf *).
- * otf = Functional structure (dft_ot_functional *).
- * ts  = Propagation time step (REAL).
- * width = Width of slab (REAL).
+ * Calculation of the static structure factor X(q).
  *
- * Returns sufrace tension.
+ * otf  = functional (dft_ot_functional *; input).
+ * k    = momentum (REAL *; input).
  *
- * TODO: Is this correct? propagate without potential??
+ * Returns -1/X(q)
  * 
  */
 
-static REAL complex Aslab(void *param, REAL x, REAL y, REAL z) {
+EXPORT REAL dft_ot_bulk_istatic(dft_ot_functional *otf, REAL *k, REAL rho0) {
+
+  return ot_bulk_istatic(otf, *k, rho0);
+}
+
+/*
+ * Calculation of the static structure factor X(q) for arrays of k and rho0.
+ *
+ * otf   = functional (dft_ot_functional *; input).
+ * ikai  = -1/X(q) with ikai[ir * nk + ik] corresponding to k[ik] and rho0[ir] (REAL *; output).
+ *         Must hold nk * nrho values.
+ * k     = momenta (REAL *; input).
+ * nk    = number of momenta (INT; input).
+ * rho0  = bulk densities (REAL *; input).
+ * nrho  = number of densities (INT; input).
+ *
+ * The points are evaluated in parallel (OpenMP).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_bulk_istatic_array(dft_ot_functional *otf, REAL *ikai, REAL *k, INT nk, REAL *rho0, INT nrho) {
+
+  INT i, n = nk * nrho;
+
+  (void) ft_lj(otf, 0.0);  /* make sure that the LJ table is ready before entering the parallel region */
+#pragma omp parallel for firstprivate(otf,ikai,k,nk,rho0,n) private(i) default(none) schedule(runtime)
+  for (i = 0; i < n; i++)
+    ikai[i] = ot_bulk_istatic(otf, k[i % nk], rho0[i / nk]);
+}
+
+/*
+ * Slab of liquid along z (1-D reduced system).
+ *
+ */
+
+static REAL complex ot_slab_z(void *param, REAL x, REAL y, REAL z) {
 
   REAL width = *((REAL *) param);
 
-  if(FABS(x) < width/2.0) return 1.0;
+  if(FABS(z) < width/2.0) return 1.0;
   else return 0.0;
 }
 
-EXPORT REAL dft_ot_bulk_surface_tension(wf *gwf, dft_ot_functional *otf, REAL ts, REAL width) {
-
-  REAL mu0, stens, prev_stens, rho0 = otf->rho0;
-  INT i, ny = gwf->grid->ny, nz = gwf->grid->nz;
-  rgrid *density;
-  cgrid *potential;
-  REAL step = gwf->grid->step;
+/*
+ * Calculate free (flat) surface tension using the 1-D reduction of the planar interface.
+ *
+ * A slab of liquid is relaxed on a 1-D grid (nx = ny = 1) along the surface normal with the
+ * effective 1-D kernels (DFT_OT_1D) using the ground state driver (dft_ot_ground_state()) at the
+ * bulk chemical potential. The surface tension is then sigma = (E - mu N) / (2 A), where the
+ * factor 2 accounts for the two interfaces of the slab.
+ *
+ * otf     = Functional structure (dft_ot_functional *; input). The model and parameters are used
+ *           for the 1-D functional (dft_ot_alloc_like()).
+ * step    = Spatial step along the surface normal (REAL; input).
+ * n       = Number of grid points along the surface normal (INT; input).
+ * width   = Initial width of the slab (REAL; input). Should be well below n * step.
+ * drv     = Ground state driver parameters (dft_ot_driver *; input/output). If NULL, the defaults
+ *           of dft_ot_ground_state_defaults() are used. The chemical potential, the number of atoms
+ *           and the external potentials are set internally in a copy of the structure (the values
+ *           given are not changed). The results (iterations, energy, residual, convergence) are
+ *           returned in this structure.
+ * profile = Density profile along the surface normal (REAL *; output). Array of n values
+ *           (index i corresponds to z = (i - n/2) * step). May be NULL if not needed.
+ *
+ * Returns surface tension (atomic units).
+ *
+ */
 
-  potential = cgrid_clone(gwf->grid, "Surface tension potential");
-  density = rgrid_clone(otf->density, "Surface tension density");
+EXPORT REAL dft_ot_bulk_surface_tension_1d(dft_ot_functional *otf, REAL step, INT n, REAL width, dft_ot_driver *drv, REAL *profile) {
+
+  dft_ot_driver ldrv;
+  dft_ot_functional *otf1;
+  wf *gwf;
+  REAL stens, rho0;
+  INT i;
+
+  if(drv) ldrv = *drv;
+  else dft_ot_ground_state_defaults(&ldrv);
+  ldrv.ext_pot = NULL;
+  ldrv.extpot = NULL;
+  ldrv.extpot_arg = NULL;
+  ldrv.natoms = -1.0;
+
+  gwf = grid_wf_alloc(1, 1, n, step, otf->mass, WF_PERIODIC_BOUNDARY, WF_2ND_ORDER_FFT, "Surface tension wf");
+  if(!(otf1 = dft_ot_alloc_like(otf, gwf, DFT_MIN_SUBSTEPS, DFT_MAX_SUBSTEPS))) {
+    fprintf(stderr, "libdft: Could not allocate 1-D functional in dft_ot_bulk_surface_tension_1d().\n");
+    exit(1);
+  }
+  rho0 = otf1->rho0;
+  ldrv.mu0 = dft_ot_bulk_chempot2(otf1);
 
-  mu0 = dft_ot_bulk_chempot2(otf);
-  grid_wf_map(gwf, &Aslab, NULL);
+  grid_wf_map(gwf, &ot_slab_z, &width);
   cgrid_multiply(gwf->grid, SQRT(rho0));
 
-  prev_stens = 1E11;
-  for(i = 1; ; i++) {
-    cgrid_zero(potential);
-    dft_ot_potential(otf, potential, gwf);
-    cgrid_add(potential, -mu0);
-    grid_wf_propagate(gwf, potential, ts);
+  dft_ot_ground_state(otf1, gwf, &ldrv);
+  stens = (ldrv.energy - ldrv.mu0 * grid_wf_norm(gwf)) / (2.0 * step * step);
+  if(drv) {
+    drv->iterations = ldrv.iterations;
+    drv->energy = ldrv.energy;
+    drv->residual = ldrv.residual;
+    drv->converged = ldrv.converged;
+  }
 
-    dft_ot_energy_density(otf, density, gwf);
-    stens = (grid_wf_energy(gwf, NULL) + rgrid_integral(density)) 
-       / (2.0 * ((REAL) ny) * ((REAL) nz) * step * step);
-    if(FABS(stens - prev_stens) / stens < 0.03) break;
-    prev_stens = stens;
+  if(profile) {
+    grid_wf_density(gwf, otf1->density);
+    for (i = 0; i < n; i++)
+      profile[i] = rgrid_value_at_index(otf1->density, 0, 0, i);
   }
-  cgrid_free(potential);
-  rgrid_free(density);
+
+  dft_ot_free(otf1);
+  grid_wf_free(gwf);
+  return stens;
+}
+
+/*
+ * Calculate free (flat) surface tension.
+ *
+ * gwf = Wave function (wf *). On exit, contains the relaxed slab along x.
+ * otf = Functional structure (dft_ot_functional *). The model and parameters are used.
+ * ts  = Initial (imaginary) time step for the ground state driver (REAL).
+ * width = Width of slab (REAL).
+ *
+ * Returns sufrace tension.
+ *
+ * The calculation is done for the 1-D reduced system (see dft_ot_bulk_surface_tension_1d())
+ * along x using the same grid step and number of points.
+ * 
+ */
+
+EXPORT REAL dft_ot_bulk_surface_tension(wf *gwf, dft_ot_functional *otf, REAL ts, REAL width) {
+
+  REAL stens, *profile;
+  INT i, j, k, nx = gwf->grid->nx, ny = gwf->grid->ny, nz = gwf->grid->nz;
+  dft_ot_driver drv;
+
+  if(!(profile = (REAL *) malloc(sizeof(REAL) * (size_t) nx))) {
+    fprintf(stderr, "libdft: Error in dft_ot_bulk_surface_tension(): Could not allocate memory.\n");
+    exit(1);
+  }
+  dft_ot_ground_state_defaults(&drv);
+  drv.step = FABS(ts);
+  if(drv.min_step > drv.step) drv.min_step = drv.step;
+  if(drv.max_step < drv.step) drv.max_step = drv.step;
+  stens = dft_ot_bulk_surface_tension_1d(otf, gwf->grid->step, nx, width, &drv, profile);
+
+  for(i = 0; i < nx; i++)
+    for(j = 0; j < ny; j++)
+      for(k = 0; k < nz; k++)
+        cgrid_value_to_index(gwf->grid, i, j, k, SQRT(profile[i]));
+  free(profile);
   return stens;
 }
 
@@ -0,0 +1,158 @@
+/*
+ * Movable potentials: rigid translation of a fixed potential by Fourier shift.
+ *
+ * The Fourier transform of the potential is computed once. The potential at
+ * displacement d is V(r - d) = IFFT[V(k) exp(-i k.d)], which is evaluated by
+ * applying the phase ramp while copying the stored transform to the workspace,
+ * followed by one inverse FFT. The displacement can be any real number
+ * (sub-grid accuracy) and the translation is periodic.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <grid/grid.h>
+#include <grid/au.h>
+#include "dft.h"
+#include "ot.h"
+
+/*
+ * Allocate movable potential.
+ *
+ * pot = Potential at zero displacement (input; rgrid *). Not modified.
+ *
+ * Returns pointer to the movable potential (NULL on error).
+ *
+ */
+
+EXPORT dft_movable *dft_movable_alloc(rgrid *pot) {
+
+  dft_movable *mov;
+
+  if(!(mov = (dft_movable *) malloc(sizeof(dft_movable)))) {
+    fprintf(stderr, "libdft: Error in dft_movable_alloc(): Could not allocate memory.\n");
+    return NULL;
+  }
+  mov->fft = rgrid_clone(pot, "dft_movable fft");
+  mov->work = rgrid_clone(pot, "dft_movable work");
+  rgrid_copy(mov->fft, pot);
+  rgrid_fft(mov->fft);
+  mov->x = mov->y = mov->z = 0.0;
+  mov->valid = 0;
+  return mov;
+}
+
+/*
+ * Free movable potential.
+ *
+ * mov = Movable potential to be freed (input; dft_movable *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_movable_free(dft_movable *mov) {
+
+  if(!mov) return;
+  rgrid_free(mov->fft);
+  rgrid_free(mov->work);
+  free(mov);
+}
+
+/*
+ * Phase factors exp(-i k d) along one axis. For the Nyquist component (even n), only the real part
+ * (cos(k d)) is used so that the translated potential stays real.
+ *
+ */
+
+static void dft_movable_phase(REAL complex *f, INT n, INT len, REAL step, REAL d) {
+
+  INT i;
+  REAL k, dk = 2.0 * M_PI / (((REAL) n) * step);
+
+  for(i = 0; i < len; i++) {
+    k = ((REAL) ((i < n / 2)?i:(i - n))) * dk;
+    if(!(n & 1) && i == n / 2) f[i] = COS(k * d);
+    else f[i] = CEXP(-I * k * d);
+  }
+}
+
+/*
+ * Potential at given displacement.
+ *
+ * mov = Movable potential (input; dft_movable *).
+ * x   = Displacement along x (input; REAL).
+ * y   = Displacement along y (input; REAL).
+ * z   = Displacement along z (input; REAL).
+ *
+ * Returns pointer to the translated potential V(r - d) in real space. This grid
+ * is owned by mov and remains valid until the next call. If the displacement
+ * is the same as in the previous call, no computation is done.
+ *
+ */
+
+EXPORT rgrid *dft_movable_potential(dft_movable *mov, REAL x, REAL y, REAL z) {
+
+  rgrid *work = mov->work, *fft = mov->fft;
+  INT i, j, k, nx = fft->nx, ny = fft->ny, nz = fft->nz, nzz = fft->nz2 / 2;
+  REAL step = fft->step;
+  REAL complex *src, *dst, *fx, *fy, *fz, fxy;
+
+  if(mov->valid && x == mov->x && y == mov->y && z == mov->z) return work;
+
+  if(!(fx = (REAL complex *) malloc(sizeof(REAL complex) * (size_t) (nx + ny + nzz)))) {
+    fprintf(stderr, "libdft: Error in dft_movable_potential(): Could not allocate memory.\n");
+    exit(1);
+  }
+  fy = fx + nx;
+  fz = fy + ny;
+  dft_movable_phase(fx, nx, nx, step, x);
+  dft_movable_phase(fy, ny, ny, step, y);
+  dft_movable_phase(fz, nz, nzz, step, z);
+
+#ifdef GRID_MGPU
+  rgrid_host_lock(fft);
+  rgrid_host_lock(work);
+#endif
+  src = (REAL complex *) fft->value;
+  dst = (REAL complex *) work->value;
+#pragma omp parallel for firstprivate(nx,ny,nzz,src,dst,fx,fy,fz) private(i,j,k,fxy) default(none) schedule(runtime)
+  for(i = 0; i < nx; i++)
+    for(j = 0; j < ny; j++) {
+      fxy = fx[i] * fy[j];
+      for(k = 0; k < nzz; k++)
+        dst[(i * ny + j) * nzz + k] = src[(i * ny + j) * nzz + k] * fxy * fz[k];
+    }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(fft);
+  rgrid_host_unlock(work);
+#endif
+  free(fx);
+  rgrid_fft_space(work, 1);
+  rgrid_inverse_fft_norm(work);
+
+  mov->x = x;
+  mov->y = y;
+  mov->z = z;
+  mov->valid = 1;
+  return work;
+}
+
+/*
+ * Add the potential at given displacement to the real part of a complex potential grid.
+ *
+ * mov       = Movable potential (input; dft_movable *).
+ * potential = Potential grid where the translated potential is added (input/output; cgrid *).
+ * x         = Displacement along x (input; REAL).
+ * y         = Displacement along y (input; REAL).
+ * z         = Displacement along z (input; REAL).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_movable_add(dft_movable *mov, cgrid *potential, REAL x, REAL y, REAL z) {
+
+  grid_add_real_to_complex_re(potential, dft_movable_potential(mov, x, y, z));
+}
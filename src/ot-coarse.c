@@ -0,0 +1,676 @@
+/*
+ * Orsay-Trento functional for superfluid helium. Evaluation of the smooth
+ * nonlocal terms (Lennard-Jones and backflow) on a coarse grid.
+ *
+ * The LJ and backflow kernels decay rapidly in k-space. Their convolutions
+ * can therefore be computed on a grid that has the step length multiplied by
+ * an integer factor (same box). The density (or wave function) is restricted
+ * to the coarse grid by truncating its spectrum, the convolutions are done
+ * there and the resulting (coarse) potential is brought back to the fine grid
+ * by spectral prolongation (zero padding of the spectrum).
+ *
+ * The coarse kernels are obtained by truncating the fine grid kernels (rather
+ * than mapping them directly on the coarse grid). For LJ, which is linear in
+ * the density, the only approximation is then the removal of the high-k
+ * components. The backflow term is nonlinear in the wave function (products of
+ * densities and currents are formed on the coarse grid), so the spectral
+ * truncation of psi introduces an additional error. This is estimated at
+ * allocation by comparing the coarse and fine BF potentials for a smooth
+ * test state (bf_error).
+ *
+ * NOTE: The coarse grid must cover exactly the same box as the fine grid.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <grid/grid.h>
+#include <grid/au.h>
+#include "dft.h"
+#include "ot.h"
+
+/*
+ * Map coarse grid index to fine grid index along one dimension (FFTW ordering).
+ * Returns -1 for the coarse Nyquist component, which is not carried over.
+ *
+ */
+
+static inline INT dft_ot_coarse_to_fine(INT ic, INT nc, INT nf) {
+
+  if(nc == nf) return ic;
+  if(ic < nc / 2) return ic;
+  if(ic == nc / 2) return -1;
+  return nf - (nc - ic);
+}
+
+/*
+ * Map fine grid index to coarse grid index along one dimension (FFTW ordering).
+ * Returns -1 if the component is outside the coarse band.
+ *
+ */
+
+static inline INT dft_ot_fine_to_coarse(INT i, INT nf, INT nc) {
+
+  if(nc == nf) return i;
+  if(i < nc / 2) return i;
+  if(i > nf - nc / 2) return nc - (nf - i);
+  return -1;
+}
+
+/*
+ * Spectral restriction of a real grid (Fourier space) to a coarser grid (Fourier space).
+ *
+ * coarse = Destination grid in Fourier space (rgrid *; output).
+ * fine   = Source grid in Fourier space (rgrid *; input).
+ *
+ * The normalization is such that the inverse transform of coarse gives the
+ * band limited version of fine sampled at the coarse grid points.
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_coarse_restrict(rgrid *coarse, rgrid *fine) {
+
+  INT i, j, k, fi, fj, nxc = coarse->nx, nyc = coarse->ny, nzc = coarse->nz, nzzc = coarse->nz2 / 2;
+  INT nxf = fine->nx, nyf = fine->ny, nzf = fine->nz, nzzf = fine->nz2 / 2;
+  REAL complex *cval, *fval;
+  REAL norm = ((REAL) (nxc * nyc * nzc)) / ((REAL) (nxf * nyf * nzf));
+
+#ifdef GRID_MGPU
+  rgrid_host_lock(coarse);
+  rgrid_host_lock(fine);
+#endif
+  cval = (REAL complex *) coarse->value;
+  fval = (REAL complex *) fine->value;
+#pragma omp parallel for firstprivate(nxc,nyc,nzc,nzzc,nxf,nyf,nzf,nzzf,cval,fval,norm) private(i,j,k,fi,fj) default(none) schedule(runtime)
+  for(i = 0; i < nxc; i++) {
+    fi = dft_ot_coarse_to_fine(i, nxc, nxf);
+    for(j = 0; j < nyc; j++) {
+      fj = dft_ot_coarse_to_fine(j, nyc, nyf);
+      for(k = 0; k < nzzc; k++) {
+        if(fi < 0 || fj < 0 || (k == nzc / 2 && nzc != nzf)) cval[(i * nyc + j) * nzzc + k] = 0.0;
+        else cval[(i * nyc + j) * nzzc + k] = norm * fval[(fi * nyf + fj) * nzzf + k];
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(coarse);
+  rgrid_host_unlock(fine);
+#endif
+  rgrid_fft_space(coarse, 1);
+}
+
+/*
+ * Spectral prolongation of a real grid (Fourier space) to a finer grid (Fourier space).
+ *
+ * fine   = Destination grid in Fourier space (rgrid *; output).
+ * coarse = Source grid in Fourier space (rgrid *; input).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_coarse_prolong(rgrid *fine, rgrid *coarse) {
+
+  INT i, j, k, ci, cj, nxc = coarse->nx, nyc = coarse->ny, nzc = coarse->nz, nzzc = coarse->nz2 / 2;
+  INT nxf = fine->nx, nyf = fine->ny, nzf = fine->nz, nzzf = fine->nz2 / 2;
+  REAL complex *cval, *fval;
+  REAL norm = ((REAL) (nxf * nyf * nzf)) / ((REAL) (nxc * nyc * nzc));
+
+#ifdef GRID_MGPU
+  rgrid_host_lock(coarse);
+  rgrid_host_lock(fine);
+#endif
+  cval = (REAL complex *) coarse->value;
+  fval = (REAL complex *) fine->value;
+#pragma omp parallel for firstprivate(nxc,nyc,nzc,nzzc,nxf,nyf,nzf,nzzf,cval,fval,norm) private(i,j,k,ci,cj) default(none) schedule(runtime)
+  for(i = 0; i < nxf; i++) {
+    ci = dft_ot_fine_to_coarse(i, nxf, nxc);
+    for(j = 0; j < nyf; j++) {
+      cj = dft_ot_fine_to_coarse(j, nyf, nyc);
+      for(k = 0; k < nzzf; k++) {
+        if(ci < 0 || cj < 0 || (k >= nzc / 2 && nzc != nzf)) fval[(i * nyf + j) * nzzf + k] = 0.0;
+        else fval[(i * nyf + j) * nzzf + k] = norm * cval[(ci * nyc + cj) * nzzc + k];
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(coarse);
+  rgrid_host_unlock(fine);
+#endif
+  rgrid_fft_space(fine, 1);
+}
+
+/*
+ * Spectral restriction of a complex grid (Fourier space) to a coarser grid (Fourier space).
+ *
+ * coarse = Destination grid in Fourier space (cgrid *; output).
+ * fine   = Source grid in Fourier space (cgrid *; input).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_coarse_restrict_complex(cgrid *coarse, cgrid *fine) {
+
+  INT i, j, k, fi, fj, fk, nxc = coarse->nx, nyc = coarse->ny, nzc = coarse->nz;
+  INT nxf = fine->nx, nyf = fine->ny, nzf = fine->nz;
+  REAL complex *cval, *fval;
+  REAL norm = ((REAL) (nxc * nyc * nzc)) / ((REAL) (nxf * nyf * nzf));
+
+#ifdef GRID_MGPU
+  cgrid_host_lock(coarse);
+  cgrid_host_lock(fine);
+#endif
+  cval = coarse->value;
+  fval = fine->value;
+#pragma omp parallel for firstprivate(nxc,nyc,nzc,nxf,nyf,nzf,cval,fval,norm) private(i,j,k,fi,fj,fk) default(none) schedule(runtime)
+  for(i = 0; i < nxc; i++) {
+    fi = dft_ot_coarse_to_fine(i, nxc, nxf);
+    for(j = 0; j < nyc; j++) {
+      fj = dft_ot_coarse_to_fine(j, nyc, nyf);
+      for(k = 0; k < nzc; k++) {
+        fk = dft_ot_coarse_to_fine(k, nzc, nzf);
+        if(fi < 0 || fj < 0 || fk < 0) cval[(i * nyc + j) * nzc + k] = 0.0;
+        else cval[(i * nyc + j) * nzc + k] = norm * fval[(fi * nyf + fj) * nzf + fk];
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  cgrid_host_unlock(coarse);
+  cgrid_host_unlock(fine);
+#endif
+  cgrid_fft_space(coarse, 1);
+}
+
+/*
+ * Spectral prolongation of a complex grid (Fourier space) to a finer grid (Fourier space).
+ *
+ * fine   = Destination grid in Fourier space (cgrid *; output).
+ * coarse = Source grid in Fourier space (cgrid *; input).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_coarse_prolong_complex(cgrid *fine, cgrid *coarse) {
+
+  INT i, j, k, ci, cj, ck, nxc = coarse->nx, nyc = coarse->ny, nzc = coarse->nz;
+  INT nxf = fine->nx, nyf = fine->ny, nzf = fine->nz;
+  REAL complex *cval, *fval;
+  REAL norm = ((REAL) (nxf * nyf * nzf)) / ((REAL) (nxc * nyc * nzc));
+
+#ifdef GRID_MGPU
+  cgrid_host_lock(coarse);
+  cgrid_host_lock(fine);
+#endif
+  cval = coarse->value;
+  fval = fine->value;
+#pragma omp parallel for firstprivate(nxc,nyc,nzc,nxf,nyf,nzf,cval,fval,norm) private(i,j,k,ci,cj,ck) default(none) schedule(runtime)
+  for(i = 0; i < nxf; i++) {
+    ci = dft_ot_fine_to_coarse(i, nxf, nxc);
+    for(j = 0; j < nyf; j++) {
+      cj = dft_ot_fine_to_coarse(j, nyf, nyc);
+      for(k = 0; k < nzf; k++) {
+        ck = dft_ot_fine_to_coarse(k, nzf, nzc);
+        if(ci < 0 || cj < 0 || ck < 0) fval[(i * nyf + j) * nzf + k] = 0.0;
+        else fval[(i * nyf + j) * nzf + k] = norm * cval[(ci * nyc + cj) * nzc + ck];
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  cgrid_host_unlock(coarse);
+  cgrid_host_unlock(fine);
+#endif
+  cgrid_fft_space(fine, 1);
+}
+
+/*
+ * Largest magnitude of a kernel (Fourier space) outside the band of the coarse grid
+ * relative to its k = 0 value. This is an a priori estimate for the relative error
+ * introduced by evaluating the convolution on the coarse grid.
+ *
+ */
+
+static REAL dft_ot_coarse_tail(rgrid *kernel, INT nxc, INT nyc, INT nzc) {
+
+  INT i, j, k, nx = kernel->nx, ny = kernel->ny, nz = kernel->nz, nzz = kernel->nz2 / 2;
+  REAL complex *val;
+  REAL mx = 0.0, k0;
+
+#ifdef GRID_MGPU
+  rgrid_host_lock(kernel);
+#endif
+  val = (REAL complex *) kernel->value;
+  k0 = CABS(val[0]);
+  for(i = 0; i < nx; i++)
+    for(j = 0; j < ny; j++)
+      for(k = 0; k < nzz; k++) {
+        if(dft_ot_fine_to_coarse(i, nx, nxc) >= 0 && dft_ot_fine_to_coarse(j, ny, nyc) >= 0 && (k < nzc / 2 || nzc == nz)) continue;
+        if(CABS(val[(i * ny + j) * nzz + k]) > mx) mx = CABS(val[(i * ny + j) * nzz + k]);
+      }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(kernel);
+#endif
+  if(k0 == 0.0) return mx;
+  return mx / k0;
+}
+
+/*
+ * Smooth test state with density modulation and flow for the backflow check:
+ * psi = sqrt(rho0) (1 + a cos(k.r)) exp(i q.r).
+ * arg = rho0, a, kx, ky, kz, qx, qy, qz (REAL [8]).
+ *
+ */
+
+static REAL complex dft_ot_coarse_test_state(void *arg, REAL x, REAL y, REAL z) {
+
+  REAL *p = (REAL *) arg;
+
+  return SQRT(p[0]) * (1.0 + p[1] * COS(p[2] * x + p[3] * y + p[4] * z)) * CEXP(I * (p[5] * x + p[6] * y + p[7] * z));
+}
+
+/*
+ * Relative L2 error of the coarse grid backflow potential with respect to the
+ * full resolution one for a smooth test state (lowest wave vectors of the box).
+ *
+ */
+
+static REAL dft_ot_coarse_bf_check(dft_ot_functional *otf, dft_ot_coarse *coarse, wf *gwf) {
+
+  dft_ot_context ctx;
+  wf *twf;
+  cgrid *fine, *crs;
+  rgrid *workspace;
+  INT nx = gwf->grid->nx, ny = gwf->grid->ny, nz = gwf->grid->nz;
+  REAL step = gwf->grid->step, params[8], norm, err;
+
+  params[0] = otf->rho0;
+  params[1] = 0.1;
+  params[2] = (nx > 1)?(2.0 * M_PI / (((REAL) nx) * step)):0.0;
+  params[3] = (ny > 1)?(2.0 * M_PI / (((REAL) ny) * step)):0.0;
+  params[4] = 2.0 * M_PI / (((REAL) nz) * step);
+  params[5] = params[6] = 0.0;
+  params[7] = 2.0 * M_PI / (((REAL) nz) * step);
+
+  twf = grid_wf_clone(gwf, "OT coarse test wf");
+  grid_wf_map(twf, dft_ot_coarse_test_state, params);
+  fine = cgrid_clone(gwf->grid, "OT coarse test fine");
+  crs = cgrid_clone(gwf->grid, "OT coarse test coarse");
+  workspace = rgrid_clone(otf->density, "OT coarse test workspace");
+  cgrid_zero(fine);
+  cgrid_zero(crs);
+
+  dft_ot_context_view(otf, &ctx);
+  grid_wf_density(twf, ctx.density);
+  dft_ot_add_backflow(otf, &ctx, fine, twf);
+
+  dft_ot_coarse_backflow_potential(coarse, twf);
+  dft_ot_coarse_add_potential(coarse, crs, workspace);
+
+  cgrid_difference(crs, crs, fine);
+  norm = cgrid_integral_of_square(fine);
+  err = (norm == 0.0)?0.0:SQRT(cgrid_integral_of_square(crs) / norm);
+
+  grid_wf_free(twf);
+  cgrid_free(fine);
+  cgrid_free(crs);
+  rgrid_free(workspace);
+  return err;
+}
+
+/*
+ * Allocate coarse grid evaluation of the nonlocal terms for a given OT functional.
+ * After this call, dft_ot_potential() evaluates the selected terms on the coarse grid.
+ *
+ * otf    = OT functional structure (dft_ot_functional *; input/output).
+ * gwf    = Wave function used with the functional (wf *; input).
+ * factor = Coarsening factor for the grid step (INT; input). The grid dimensions
+ *          must be divisible by this (except dimensions of length one).
+ * terms  = Terms to be evaluated on the coarse grid (INT; input):
+ *          DFT_OT_COARSE_LJ  Lennard-Jones.
+ *          DFT_OT_COARSE_BF  Backflow.
+ *          Use bitwise or to combine.
+ *
+ * Returns a pointer to the coarse grid structure (also stored in otf->coarse).
+ *
+ * The relative magnitude of the discarded kernel components is printed and
+ * stored in the structure (lj_tail and bf_tail). For backflow, the relative error
+ * of the coarse potential for a smooth test state is also printed and stored (bf_error).
+ * Use dft_ot_coarse_error() to compare against the full resolution evaluation.
+ *
+ * NOTE: The energy density (dft_ot_energy_density()) is always evaluated
+ *       on the fine grid.
+ *
+ */
+
+EXPORT dft_ot_coarse *dft_ot_coarse_alloc(dft_ot_functional *otf, wf *gwf, INT factor, INT terms) {
+
+  dft_ot_coarse *coarse;
+  dft_ot_functional *cotf;
+  INT nx = gwf->grid->nx, ny = gwf->grid->ny, nz = gwf->grid->nz, nxc, nyc, nzc;
+  REAL step = gwf->grid->step, cstep = step * (REAL) factor;
+
+  if(otf->model & (DFT_GP | DFT_GP2 | DFT_ZERO)) {
+    fprintf(stderr, "libdft: Coarse grid evaluation not available for GP or zero functionals.\n");
+    exit(1);
+  }
+  if(!(otf->model & DFT_OT_BACKFLOW)) terms &= ~DFT_OT_COARSE_BF;
+  if(factor < 2 || !terms) {
+    fprintf(stderr, "libdft: Coarse grid evaluation requested with factor < 2 or no terms.\n");
+    exit(1);
+  }
+  if((nx > 1 && nx % factor) || (ny > 1 && ny % factor) || nz % factor) {
+    fprintf(stderr, "libdft: Grid dimensions must be divisible by the coarse grid factor.\n");
+    exit(1);
+  }
+  nxc = (nx > 1)?(nx / factor):1;
+  nyc = (ny > 1)?(ny / factor):1;
+  nzc = nz / factor;
+
+  if(otf->coarse) dft_ot_coarse_free(otf);
+
+  if(!(coarse = (dft_ot_coarse *) malloc(sizeof(dft_ot_coarse))) || !(cotf = (dft_ot_functional *) malloc(sizeof(dft_ot_functional)))) {
+    fprintf(stderr, "libdft: Error in dft_ot_coarse_alloc(): Could not allocate memory.\n");
+    return NULL;
+  }
+  coarse->factor = factor;
+  coarse->terms = terms;
+  coarse->otf = cotf;
+  coarse->gwf = NULL;
+  coarse->potential = NULL;
+  coarse->cworkspace = NULL;
+  coarse->lj_tail = coarse->bf_tail = coarse->bf_error = 0.0;
+  coarse->shared = 0;
+
+  /* Coarse functional: same parameters, kernels truncated from the fine grid */
+  *cotf = *otf;
+  cotf->coarse = NULL;
+  cotf->kernels = NULL;
+  cotf->lag = NULL;
+  cotf->lj_table = NULL;
+  cotf->eos = NULL;
+  cotf->coupling = NULL;
+  cotf->spherical_avg = cotf->gaussian_tf = cotf->gaussian_x_tf = cotf->gaussian_y_tf = cotf->gaussian_z_tf = NULL;
+  cotf->lennard_jones = cotf->backflow_pot = NULL;
+  cotf->workspace1 = cotf->workspace2 = cotf->workspace3 = cotf->workspace4 = cotf->workspace5 = NULL;
+  cotf->workspace6 = cotf->workspace7 = cotf->workspace8 = cotf->workspace9 = NULL;
+  cotf->model &= ~DFT_OT_KC;
+  if(!(terms & DFT_OT_COARSE_BF)) cotf->model &= ~DFT_OT_BACKFLOW;
+
+  cotf->density = rgrid_alloc(nxc, nyc, nzc, cstep, RGRID_PERIODIC_BOUNDARY, 0, "OT coarse density");
+  rgrid_set_origin(cotf->density, otf->density->x0, otf->density->y0, otf->density->z0);
+  cotf->workspace1 = rgrid_clone(cotf->density, "OT coarse workspace 1");
+  cotf->workspace2 = rgrid_clone(cotf->density, "OT coarse workspace 2");
+  coarse->lj = rgrid_clone(cotf->density, "OT coarse LJ potential");
+
+  if(terms & DFT_OT_COARSE_LJ) {
+    cotf->lennard_jones = rgrid_clone(cotf->density, "OT coarse Lennard-Jones");
+    dft_ot_coarse_restrict(cotf->lennard_jones, otf->lennard_jones);
+    coarse->lj_tail = dft_ot_coarse_tail(otf->lennard_jones, nxc, nyc, nzc);
+    fprintf(stderr, "libdft: Coarse grid LJ (factor " FMT_I "), max. relative kernel tail = " FMT_R ".\n", factor, coarse->lj_tail);
+  }
+
+  if(terms & DFT_OT_COARSE_BF) {
+    cotf->backflow_pot = rgrid_clone(cotf->density, "OT coarse backflow");
+    dft_ot_coarse_restrict(cotf->backflow_pot, otf->backflow_pot);
+    coarse->bf_tail = dft_ot_coarse_tail(otf->backflow_pot, nxc, nyc, nzc);
+    fprintf(stderr, "libdft: Coarse grid BF (factor " FMT_I "), max. relative kernel tail = " FMT_R ".\n", factor, coarse->bf_tail);
+    cotf->workspace3 = rgrid_clone(cotf->density, "OT coarse workspace 3");
+    cotf->workspace4 = rgrid_clone(cotf->density, "OT coarse workspace 4");
+    cotf->workspace5 = rgrid_clone(cotf->density, "OT coarse workspace 5");
+    cotf->workspace6 = rgrid_clone(cotf->density, "OT coarse workspace 6");
+    cotf->workspace7 = rgrid_clone(cotf->density, "OT coarse workspace 7");
+    cotf->workspace8 = rgrid_clone(cotf->density, "OT coarse workspace 8");
+    cotf->workspace9 = rgrid_clone(cotf->density, "OT coarse workspace 9");
+    coarse->gwf = grid_wf_alloc(nxc, nyc, nzc, cstep, gwf->mass, WF_PERIODIC_BOUNDARY, WF_2ND_ORDER_FFT, "OT coarse wf");
+    cgrid_set_origin(coarse->gwf->grid, gwf->grid->x0, gwf->grid->y0, gwf->grid->z0);
+    cgrid_set_momentum(coarse->gwf->grid, gwf->grid->kx0, gwf->grid->ky0, gwf->grid->kz0);
+    coarse->potential = cgrid_clone(coarse->gwf->grid, "OT coarse potential");
+    coarse->cworkspace = cgrid_clone(gwf->grid, "OT coarse fine workspace");
+  }
+
+  rgrid_zero(coarse->lj);
+  if(coarse->potential) cgrid_zero(coarse->potential);
+
+  if(terms & DFT_OT_COARSE_BF) {
+    coarse->bf_error = dft_ot_coarse_bf_check(otf, coarse, gwf);
+    fprintf(stderr, "libdft: Coarse grid BF (factor " FMT_I "), relative error for smooth test state = " FMT_R ".\n", factor, coarse->bf_error);
+  }
+
+  otf->coarse = coarse;
+  return coarse;
+}
+
+/*
+ * Release the grids held by a coarse grid structure.
+ *
+ */
+
+static void dft_ot_coarse_destroy(dft_ot_coarse *coarse) {
+
+  if(coarse->shared) { /* kernels belong to the original structure */
+    coarse->otf->lennard_jones = NULL;
+    coarse->otf->backflow_pot = NULL;
+  }
+  dft_ot_free(coarse->otf);
+  if(coarse->gwf) grid_wf_free(coarse->gwf);
+  if(coarse->lj) rgrid_free(coarse->lj);
+  if(coarse->potential) cgrid_free(coarse->potential);
+  if(coarse->cworkspace) cgrid_free(coarse->cworkspace);
+  free(coarse);
+}
+
+/*
+ * Free coarse grid evaluation structure (and revert to full resolution evaluation).
+ *
+ * otf = OT functional structure (dft_ot_functional *; input/output).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_coarse_free(dft_ot_functional *otf) {
+
+  if(!otf->coarse) return;
+  dft_ot_coarse_destroy(otf->coarse);
+  otf->coarse = NULL;
+}
+
+/*
+ * Clone a grid (NULL if the model grid is NULL).
+ *
+ */
+
+static rgrid *dft_ot_coarse_clone_grid(rgrid *model, char *id) {
+
+  rgrid *grid;
+
+  if(!model) return NULL;
+  grid = rgrid_clone(model, id);
+  rgrid_fft(grid);            /* create FFT plans now */
+  rgrid_inverse_fft(grid);
+  return grid;
+}
+
+/*
+ * Make a copy of coarse grid structure that has its own workspaces but shares
+ * the coarse kernels with the original (used by evaluation contexts).
+ *
+ * coarse = Coarse grid structure to copy (dft_ot_coarse *; input).
+ *
+ * Returns pointer to the new structure. Free with dft_ot_coarse_clone_free()
+ * before freeing the original.
+ *
+ */
+
+EXPORT dft_ot_coarse *dft_ot_coarse_clone(dft_ot_coarse *coarse) {
+
+  dft_ot_coarse *copy;
+  dft_ot_functional *cotf;
+
+  if(!(copy = (dft_ot_coarse *) malloc(sizeof(dft_ot_coarse))) || !(cotf = (dft_ot_functional *) malloc(sizeof(dft_ot_functional)))) {
+    fprintf(stderr, "libdft: Error in dft_ot_coarse_clone(): Could not allocate memory.\n");
+    return NULL;
+  }
+  *copy = *coarse;
+  *cotf = *(coarse->otf);
+  copy->otf = cotf;
+  copy->shared = 1;
+  cotf->density = dft_ot_coarse_clone_grid(coarse->otf->density, "OT coarse density");
+  cotf->workspace1 = dft_ot_coarse_clone_grid(coarse->otf->workspace1, "OT coarse workspace 1");
+  cotf->workspace2 = dft_ot_coarse_clone_grid(coarse->otf->workspace2, "OT coarse workspace 2");
+  cotf->workspace3 = dft_ot_coarse_clone_grid(coarse->otf->workspace3, "OT coarse workspace 3");
+  cotf->workspace4 = dft_ot_coarse_clone_grid(coarse->otf->workspace4, "OT coarse workspace 4");
+  cotf->workspace5 = dft_ot_coarse_clone_grid(coarse->otf->workspace5, "OT coarse workspace 5");
+  cotf->workspace6 = dft_ot_coarse_clone_grid(coarse->otf->workspace6, "OT coarse workspace 6");
+  cotf->workspace7 = dft_ot_coarse_clone_grid(coarse->otf->workspace7, "OT coarse workspace 7");
+  cotf->workspace8 = dft_ot_coarse_clone_grid(coarse->otf->workspace8, "OT coarse workspace 8");
+  cotf->workspace9 = dft_ot_coarse_clone_grid(coarse->otf->workspace9, "OT coarse workspace 9");
+  copy->lj = dft_ot_coarse_clone_grid(coarse->lj, "OT coarse LJ potential");
+  rgrid_zero(copy->lj);
+  rgrid_fft_space(copy->lj, 0);
+  copy->gwf = coarse->gwf?grid_wf_clone(coarse->gwf, "OT coarse wf"):NULL;
+  copy->potential = coarse->potential?cgrid_clone(coarse->potential, "OT coarse potential"):NULL;
+  copy->cworkspace = coarse->cworkspace?cgrid_clone(coarse->cworkspace, "OT coarse fine workspace"):NULL;
+  if(copy->potential) { /* create FFT plans now */
+    cgrid_fft(copy->potential); cgrid_inverse_fft(copy->potential);
+    cgrid_fft(copy->cworkspace); cgrid_inverse_fft(copy->cworkspace);
+    cgrid_fft(copy->gwf->grid); cgrid_inverse_fft(copy->gwf->grid);
+    cgrid_zero(copy->potential);
+  }
+
+  return copy;
+}
+
+/*
+ * Free coarse grid structure allocated by dft_ot_coarse_clone().
+ *
+ * coarse = Structure to be freed (dft_ot_coarse *; input).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_coarse_clone_free(dft_ot_coarse *coarse) {
+
+  if(coarse) dft_ot_coarse_destroy(coarse);
+}
+
+/*
+ * Lennard-Jones potential on the coarse grid. The result is accumulated in coarse->lj
+ * and transferred to the fine grid by dft_ot_coarse_add_potential().
+ *
+ * coarse = Coarse grid structure (dft_ot_coarse *; input/output).
+ * rho_tf = FFT of the liquid density on the fine grid (rgrid *; input).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_coarse_lennard_jones_potential(dft_ot_coarse *coarse, rgrid *rho_tf) {
+
+  dft_ot_functional *cotf = coarse->otf;
+
+  rgrid_claim(cotf->workspace1); rgrid_claim(cotf->workspace2);
+  dft_ot_coarse_restrict(cotf->workspace1, rho_tf);
+  rgrid_fft_convolute(cotf->workspace2, cotf->workspace1, cotf->lennard_jones);
+  rgrid_inverse_fft_norm2(cotf->workspace2);
+  rgrid_sum(coarse->lj, coarse->lj, cotf->workspace2);
+  rgrid_release(cotf->workspace1); rgrid_release(cotf->workspace2);
+}
+
+/*
+ * Backflow potential on the coarse grid. The result is accumulated in coarse->potential
+ * and transferred to the fine grid by dft_ot_coarse_add_potential().
+ *
+ * coarse = Coarse grid structure (dft_ot_coarse *; input/output).
+ * gwf    = Wave function on the fine grid (wf *; input).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_coarse_backflow_potential(dft_ot_coarse *coarse, wf *gwf) {
+
+  dft_ot_context ctx;
+
+  cgrid_claim(coarse->cworkspace);
+  cgrid_copy(coarse->cworkspace, gwf->grid);
+  cgrid_fft(coarse->cworkspace);
+  dft_ot_coarse_restrict_complex(coarse->gwf->grid, coarse->cworkspace);
+  cgrid_inverse_fft_norm(coarse->gwf->grid);
+  cgrid_release(coarse->cworkspace);
+
+  dft_ot_context_view(coarse->otf, &ctx);
+  grid_wf_density(coarse->gwf, ctx.density);
+  dft_ot_add_backflow(coarse->otf, &ctx, coarse->potential, coarse->gwf);
+}
+
+/*
+ * Transfer the potential accumulated on the coarse grid to the fine grid (spectral
+ * prolongation) and reset the coarse grid accumulators.
+ *
+ * coarse     = Coarse grid structure (dft_ot_coarse *; input/output).
+ * potential  = Potential on the fine grid (cgrid *; output). The coarse grid contribution is added to this.
+ * workspace1 = Workspace on the fine grid (rgrid *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_coarse_add_potential(dft_ot_coarse *coarse, cgrid *potential, rgrid *workspace1) {
+
+  if(coarse->potential) { /* One complex prolongation for both LJ and BF */
+    if(coarse->terms & DFT_OT_COARSE_LJ) grid_add_real_to_complex_re(coarse->potential, coarse->lj);
+    cgrid_fft(coarse->potential);
+    cgrid_claim(coarse->cworkspace);
+    dft_ot_coarse_prolong_complex(coarse->cworkspace, coarse->potential);
+    cgrid_inverse_fft_norm(coarse->cworkspace);
+    cgrid_sum(potential, potential, coarse->cworkspace);
+    cgrid_release(coarse->cworkspace);
+    cgrid_zero(coarse->potential);
+    cgrid_fft_space(coarse->potential, 0);
+  } else {
+    rgrid_fft(coarse->lj);
+    dft_ot_coarse_prolong(workspace1, coarse->lj);
+    rgrid_inverse_fft_norm(workspace1);
+    grid_add_real_to_complex_re(potential, workspace1);
+  }
+  rgrid_zero(coarse->lj);
+  rgrid_fft_space(coarse->lj, 0);
+}
+
+/*
+ * Estimate the error of the coarse grid evaluation by comparing against the full
+ * resolution potential.
+ *
+ * otf        = OT functional structure with coarse evaluation enabled (dft_ot_functional *; input).
+ * gwf        = Wave function (wf *; input).
+ * workspace1 = Workspace (cgrid *).
+ * workspace2 = Workspace (cgrid *).
+ *
+ * Returns the relative L2 error || V_coarse - V_full || / || V_full ||.
+ *
+ */
+
+EXPORT REAL dft_ot_coarse_error(dft_ot_functional *otf, wf *gwf, cgrid *workspace1, cgrid *workspace2) {
+
+  dft_ot_coarse *coarse = otf->coarse;
+  REAL norm;
+
+  if(!coarse) return 0.0;
+  cgrid_zero(workspace1);
+  dft_ot_potential(otf, workspace1, gwf);
+  otf->coarse = NULL;
+  cgrid_zero(workspace2);
+  dft_ot_potential(otf, workspace2, gwf);
+  otf->coarse = coarse;
+
+  cgrid_difference(workspace1, workspace1, workspace2);
+  norm = cgrid_integral_of_square(workspace2);
+  if(norm == 0.0) return 0.0;
+  return SQRT(cgrid_integral_of_square(workspace1) / norm);
+}
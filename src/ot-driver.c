@@ -0,0 +1,789 @@
+/*
+ * Ground state driver for the Orsay-Trento functional (imaginary time).
+ *
+ * The wave function is propagated in imaginary time with one evaluation
+ * of the OT potential per iteration. At every drv->check iterations the
+ * energy (grand potential E - mu N) and the residual are evaluated:
+ *
+ * - If the energy decreased, the state is accepted (stored) and the time
+ *   step is increased by drv->step_grow (up to drv->max_step).
+ * - If the energy increased, the state is rolled back to the last accepted
+ *   state and the time step is reduced by drv->step_shrink (down to
+ *   drv->min_step). The acceleration history is also reset.
+ *
+ * The residual || (H - mu) psi || / || psi || is evaluated at the check steps
+ * from the OT potential and the kinetic energy operator (FFT) at the current
+ * wave function (for fixed number of atoms, mu = <psi|H|psi> / N). Unlike the
+ * change of the wave function over one step, it vanishes only at the true
+ * ground state and not at the fixed point of the split operator step (which
+ * differs by O(dt^2)).
+ *
+ * Optional acceleration: Nesterov momentum extrapolation or Anderson (Pulay)
+ * mixing of the fixed point map psi -> exp(-dt (H - mu)) psi.
+ *
+ * dft_ot_minimize() uses the same parameters but minimizes the energy
+ * directly by preconditioned nonlinear conjugate gradients.
+ *
+ * If lagged refresh of the non-local terms is enabled (dft_ot_lag_enable()),
+ * both drivers continue after convergence with the full functional until
+ * the convergence criteria are met again.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <grid/grid.h>
+#include <grid/au.h>
+#include "dft.h"
+#include "ot.h"
+
+static void dft_ot_driver_kinetic(cgrid *grid, REAL mass, REAL shift, char inverse);
+
+/*
+ * Set default parameters for the ground state driver.
+ *
+ * drv = Driver parameters to initialize (output; dft_ot_driver *).
+ *
+ * No return value.
+ *
+ * Note: the chemical potential (mu0) or the number of atoms (natoms) must be set by the caller.
+ *
+ */
+
+EXPORT void dft_ot_ground_state_defaults(dft_ot_driver *drv) {
+
+  drv->step = 10.0 / GRID_AUTOFS;
+  drv->min_step = 1.0 / GRID_AUTOFS;
+  drv->max_step = 200.0 / GRID_AUTOFS;
+  drv->step_grow = 1.1;
+  drv->step_shrink = 0.5;
+  drv->accel = DFT_DRIVER_ACCEL_ANDERSON;
+  drv->momentum = 0.5;
+  drv->anderson_depth = 4;
+  drv->anderson_beta = 1.0;
+  drv->mu0 = 0.0;
+  drv->natoms = -1.0;
+  drv->max_iter = 100000;
+  drv->check = 20;
+  drv->energy_tol = 1E-6 / GRID_AUTOK;
+  drv->residual_tol = 1E-5;
+  drv->ext_pot = NULL;
+  drv->extpot = NULL;
+  drv->extpot_arg = NULL;
+  drv->precond = -1.0;
+  drv->verbose = 0;
+  drv->iterations = 0;
+  drv->energy = 0.0;
+  drv->residual = 0.0;
+  drv->converged = 0;
+}
+
+/*
+ * Total potential: external + OT - mu. The external potential given by the callback is left in cext.
+ *
+ */
+
+static void dft_ot_driver_potential(dft_ot_functional *otf, wf *gwf, dft_ot_driver *drv, cgrid *potential, cgrid *cext, REAL mu, INT iter) {
+
+  if(drv->ext_pot) grid_real_to_complex_re(potential, drv->ext_pot);
+  else cgrid_zero(potential);
+  if(drv->extpot) {
+    cgrid_zero(cext);
+    (*drv->extpot)(drv->extpot_arg, cext, gwf, iter);
+    cgrid_sum(potential, potential, cext);
+  }
+  dft_ot_potential(otf, potential, gwf);
+  if(mu != 0.0) cgrid_add(potential, -mu);
+}
+
+/*
+ * Total energy including the external potentials (cext must hold the callback potential).
+ *
+ */
+
+static REAL dft_ot_driver_energy(dft_ot_functional *otf, wf *gwf, dft_ot_driver *drv, cgrid *cext, rgrid *density, rgrid *edens) {
+
+  REAL energy;
+
+  dft_ot_energy_density(otf, edens, gwf);
+  energy = grid_wf_energy(gwf, NULL) + rgrid_integral(edens);
+  if(drv->ext_pot || drv->extpot) {
+    grid_wf_density(gwf, density);
+    if(drv->ext_pot) {
+      rgrid_product(edens, density, drv->ext_pot);
+      energy += rgrid_integral(edens);
+    }
+    if(drv->extpot) {
+      grid_complex_re_to_real(edens, cext);
+      rgrid_product(edens, edens, density);
+      energy += rgrid_integral(edens);
+    }
+  }
+  return energy;
+}
+
+/*
+ * Solve the (small) Anderson normal equations a x = b by Gaussian elimination with partial pivoting.
+ * Returns 0 if the system is (numerically) singular, 1 otherwise.
+ *
+ */
+
+static INT dft_ot_driver_solve(REAL a[DFT_DRIVER_ANDERSON_MAX][DFT_DRIVER_ANDERSON_MAX], REAL *b, REAL *x, INT n) {
+
+  REAL m[DFT_DRIVER_ANDERSON_MAX][DFT_DRIVER_ANDERSON_MAX + 1], tmp, scale = 0.0;
+  INT i, j, k, p;
+
+  for(i = 0; i < n; i++) {
+    for(j = 0; j < n; j++)
+      m[i][j] = a[i][j];
+    m[i][n] = b[i];
+    if(a[i][i] > scale) scale = a[i][i];
+  }
+  if(scale == 0.0) return 0;
+  for(i = 0; i < n; i++) m[i][i] += 1E-10 * scale;  /* Tikhonov regularization */
+
+  for(k = 0; k < n; k++) {
+    p = k;
+    for(i = k + 1; i < n; i++)
+      if(FABS(m[i][k]) > FABS(m[p][k])) p = i;
+    if(FABS(m[p][k]) < 1E-14 * scale) return 0;
+    if(p != k)
+      for(j = k; j <= n; j++) {
+        tmp = m[k][j];
+        m[k][j] = m[p][j];
+        m[p][j] = tmp;
+      }
+    for(i = k + 1; i < n; i++) {
+      tmp = m[i][k] / m[k][k];
+      for(j = k; j <= n; j++)
+        m[i][j] -= tmp * m[k][j];
+    }
+  }
+  for(i = n - 1; i >= 0; i--) {
+    tmp = m[i][n];
+    for(j = i + 1; j < n; j++)
+      tmp -= m[i][j] * x[j];
+    x[i] = tmp / m[i][i];
+  }
+  return 1;
+}
+
+/*
+ * Find the ground state of helium (OT functional) with optional external potentials by imaginary
+ * time propagation with adaptive time step, optional acceleration and convergence test.
+ *
+ * otf = OT functional structure (input; dft_ot_functional *).
+ * gwf = Wave function: initial guess on entry, ground state on exit (input/output; wf *).
+ *       The propagator of gwf must be one of the FFT based propagators.
+ * drv = Driver parameters (input) and results (output) (dft_ot_driver *).
+ *       Initialize with dft_ot_ground_state_defaults().
+ *
+ * Returns the total energy (also in drv->energy). The number of iterations, the last residual
+ * and convergence status are returned in drv->iterations, drv->residual and drv->converged.
+ *
+ * Note: The potential is evaluated only once per iteration, so the fixed point of the
+ *       iteration carries an O(dt^2) splitting error. The residual test (drv->residual_tol)
+ *       measures the distance from the true ground state including this error (at the cost of
+ *       one additional potential evaluation per check); if it cannot be met, use a smaller
+ *       drv->max_step. If the run does not converge, gwf holds the last propagated state
+ *       (never an extrapolated or mixed one).
+ *
+ */
+
+EXPORT REAL dft_ot_ground_state(dft_ot_functional *otf, wf *gwf, dft_ot_driver *drv) {
+
+  cgrid *potential, *prev, *saved, *work, *cext = NULL, *last = NULL, *xprev = NULL, *fprev = NULL;
+  cgrid *dx[DFT_DRIVER_ANDERSON_MAX], *df[DFT_DRIVER_ANDERSON_MAX];
+  rgrid *density, *edens;
+  REAL a[DFT_DRIVER_ANDERSON_MAX][DFT_DRIVER_ANDERSON_MAX], b[DFT_DRIVER_ANDERSON_MAX], gamma[DFT_DRIVER_ANDERSON_MAX];
+  REAL dt, mu, energy = 0.0, omega, omega_saved = 0.0, natoms, residual = -1.0, lambda;
+  INT iter, i, j, depth = 0, nhist = 0, pos = 0;
+  char chk, have_saved = 0, have_prev = 0, have_last = 0, converged = 0, have_energy = 0, mixed = 0;
+  dft_ot_lag *lag = NULL;
+
+  if(drv->step <= 0.0 || drv->min_step <= 0.0 || drv->max_step < drv->min_step || drv->check < 1) {
+    fprintf(stderr, "libdft: Illegal time step parameters in dft_ot_ground_state().\n");
+    exit(1);
+  }
+
+  potential = cgrid_clone(gwf->grid, "dft_ot_ground_state potential");
+  prev = cgrid_clone(gwf->grid, "dft_ot_ground_state prev");
+  saved = cgrid_clone(gwf->grid, "dft_ot_ground_state saved");
+  work = cgrid_clone(gwf->grid, "dft_ot_ground_state work");
+  if(drv->extpot) cext = cgrid_clone(gwf->grid, "dft_ot_ground_state cext");
+  density = rgrid_clone(otf->density, "dft_ot_ground_state density");
+  edens = rgrid_clone(otf->density, "dft_ot_ground_state edens");
+  switch(drv->accel) {
+    case DFT_DRIVER_ACCEL_NONE:
+      break;
+    case DFT_DRIVER_ACCEL_NESTEROV:
+      last = cgrid_clone(gwf->grid, "dft_ot_ground_state last");
+      break;
+    case DFT_DRIVER_ACCEL_ANDERSON:
+      depth = drv->anderson_depth;
+      if(depth < 1) depth = 1;
+      if(depth > DFT_DRIVER_ANDERSON_MAX) depth = DFT_DRIVER_ANDERSON_MAX;
+      xprev = cgrid_clone(gwf->grid, "dft_ot_ground_state xprev");
+      fprev = cgrid_clone(gwf->grid, "dft_ot_ground_state fprev");
+      for(i = 0; i < depth; i++) {
+        dx[i] = cgrid_clone(gwf->grid, "dft_ot_ground_state dx");
+        df[i] = cgrid_clone(gwf->grid, "dft_ot_ground_state df");
+      }
+      break;
+    default:
+      fprintf(stderr, "libdft: Unknown acceleration method in dft_ot_ground_state().\n");
+      exit(1);
+  }
+
+  if(drv->natoms > 0.0) {
+    mu = 0.0;
+    gwf->norm = drv->natoms;
+    grid_wf_normalize(gwf);
+  } else mu = drv->mu0;
+  dt = drv->step;
+  if(dt < drv->min_step) dt = drv->min_step;
+  if(dt > drv->max_step) dt = drv->max_step;
+
+  for(iter = 0; iter < drv->max_iter; iter++) {
+
+    chk = !((iter + 1) % drv->check);
+    if(depth) cgrid_copy(prev, gwf->grid);
+    mixed = 0;
+
+    /* Imaginary time step */
+    dft_ot_driver_potential(otf, gwf, drv, potential, cext, mu, iter);
+    grid_wf_propagate(gwf, potential, -I * dt);
+    if(drv->natoms > 0.0) grid_wf_normalize(gwf);
+
+    if(chk) {
+      /* Residual || (T + V - lambda) psi || / || psi || at the new state (also leaves the callback potential in cext) */
+      dft_ot_driver_potential(otf, gwf, drv, potential, cext, 0.0, iter);
+      cgrid_product(potential, potential, gwf->grid);
+      cgrid_copy(work, gwf->grid);
+      dft_ot_driver_kinetic(work, gwf->mass, 0.0, 0);
+      cgrid_sum(work, work, potential);
+      natoms = grid_wf_norm(gwf);
+      if(drv->natoms > 0.0) lambda = CREAL(cgrid_integral_of_conjugate_product(gwf->grid, work)) / natoms;
+      else lambda = drv->mu0;
+      cgrid_add_scaled(work, -lambda, gwf->grid);
+      residual = SQRT(cgrid_integral_of_square(work) / natoms);
+
+      /* Energy (grand potential for fixed mu) */
+      energy = dft_ot_driver_energy(otf, gwf, drv, cext, density, edens);
+      have_energy = 1;
+      omega = energy - drv->mu0 * natoms;
+      if(drv->natoms > 0.0) omega = energy;
+      if(drv->verbose)
+        printf("libdft: Iteration " FMT_I ": E = " FMT_R " K, E - mu N = " FMT_R " K, N = " FMT_R ", residual = " FMT_R ", step = " FMT_R " fs.\n",
+               iter + 1, energy * GRID_AUTOK, omega * GRID_AUTOK, natoms, residual, dt * GRID_AUTOFS);
+
+      if(have_saved && omega > omega_saved + 1E-12 * FABS(omega_saved) && dt > drv->min_step) {
+        /* Energy went up: roll back and reduce time step */
+        cgrid_copy(gwf->grid, saved);
+        dt *= drv->step_shrink;
+        if(dt < drv->min_step) dt = drv->min_step;
+        have_prev = have_last = 0;
+        nhist = pos = 0;
+        have_energy = 0;
+        if(drv->verbose) printf("libdft: Energy increased - time step reduced to " FMT_R " fs.\n", dt * GRID_AUTOFS);
+        continue;
+      }
+
+      if(have_saved && (drv->energy_tol > 0.0 || drv->residual_tol > 0.0)
+         && (drv->energy_tol <= 0.0 || FABS(omega - omega_saved) / natoms < drv->energy_tol)
+         && (drv->residual_tol <= 0.0 || residual < drv->residual_tol)) {
+        if(otf->lag && !lag) {
+          /* Converged with lagged terms: continue with the full functional to verify */
+          lag = otf->lag;
+          otf->lag = NULL;
+          have_saved = have_prev = have_last = 0;
+          nhist = pos = 0;
+          if(drv->verbose) printf("libdft: Converged with lagged terms - verifying with the full functional.\n");
+          continue;
+        }
+        converged = 1;
+        iter++;
+        break;
+      }
+      cgrid_copy(saved, gwf->grid);
+      omega_saved = omega;
+      have_saved = 1;
+      dt *= drv->step_grow;
+      if(dt > drv->max_step) dt = drv->max_step;
+    }
+
+    switch(drv->accel) {
+      case DFT_DRIVER_ACCEL_NESTEROV:
+        /* y = psi_new + momentum * (psi_new - psi_old) */
+        if(have_last) {
+          cgrid_difference(potential, gwf->grid, last);
+          cgrid_copy(last, gwf->grid);
+          cgrid_add_scaled(gwf->grid, drv->momentum, potential);
+          if(drv->natoms > 0.0) grid_wf_normalize(gwf);
+        } else {
+          cgrid_copy(last, gwf->grid);
+          have_last = 1;
+        }
+        break;
+      case DFT_DRIVER_ACCEL_ANDERSON:
+        /* f = G(x) - x where x = prev and G(x) = gwf */
+        cgrid_difference(potential, gwf->grid, prev);
+        if(have_prev) {
+          cgrid_difference(dx[pos], prev, xprev);
+          cgrid_difference(df[pos], potential, fprev);
+          if(nhist < depth) nhist++;
+          for(j = 0; j < nhist; j++)
+            a[pos][j] = a[j][pos] = CREAL(cgrid_integral_of_conjugate_product(df[pos], df[j]));
+          pos = (pos + 1) % depth;
+        }
+        cgrid_copy(xprev, prev);
+        cgrid_copy(fprev, potential);
+        have_prev = 1;
+        if(!nhist) break;
+        for(j = 0; j < nhist; j++)
+          b[j] = CREAL(cgrid_integral_of_conjugate_product(df[j], potential));
+        if(!dft_ot_driver_solve(a, b, gamma, nhist)) {
+          nhist = pos = 0;
+          break;
+        }
+        /* x_new = x + beta f - sum_j gamma_j (dx_j + beta df_j) */
+        cgrid_copy(gwf->grid, prev);
+        cgrid_add_scaled(gwf->grid, drv->anderson_beta, potential);
+        for(j = 0; j < nhist; j++) {
+          cgrid_add_scaled(gwf->grid, -gamma[j], dx[j]);
+          cgrid_add_scaled(gwf->grid, -gamma[j] * drv->anderson_beta, df[j]);
+        }
+        if(drv->natoms > 0.0) grid_wf_normalize(gwf);
+        mixed = 1;
+        break;
+    }
+  }
+
+  /* Do not leave an extrapolated or mixed state: restore the last propagated state (G(x) = x + f) */
+  if(!converged && have_last) cgrid_copy(gwf->grid, last);
+  if(!converged && mixed) {
+    cgrid_sum(gwf->grid, xprev, fprev);
+    if(drv->natoms > 0.0) grid_wf_normalize(gwf);
+  }
+  if(!converged || !have_energy) {
+    if(drv->extpot) {
+      cgrid_zero(cext);
+      (*drv->extpot)(drv->extpot_arg, cext, gwf, iter);
+    }
+    energy = dft_ot_driver_energy(otf, gwf, drv, cext, density, edens);
+  }
+  if(lag) { /* restore lagged evaluation */
+    otf->lag = lag;
+    dft_ot_lag_refresh(otf);
+  }
+  drv->iterations = iter;
+  drv->energy = energy;
+  drv->residual = residual;
+  drv->converged = converged;
+  drv->step = dt;
+
+  cgrid_free(potential);
+  cgrid_free(prev);
+  cgrid_free(saved);
+  cgrid_free(work);
+  if(cext) cgrid_free(cext);
+  if(last) cgrid_free(last);
+  if(xprev) cgrid_free(xprev);
+  if(fprev) cgrid_free(fprev);
+  for(i = 0; i < depth; i++) {
+    cgrid_free(dx[i]);
+    cgrid_free(df[i]);
+  }
+  rgrid_free(density);
+  rgrid_free(edens);
+
+  return energy;
+}
+
+/*
+ * Multiply grid by (hbar^2 k^2 / (2 mass) + shift) (inverse = 0) or by its inverse (inverse = 1)
+ * in Fourier space.
+ *
+ */
+
+static void dft_ot_driver_kinetic(cgrid *grid, REAL mass, REAL shift, char inverse) {
+
+  INT i, j, k, ij, nx = grid->nx, ny = grid->ny, nz = grid->nz, nxy = nx * ny;
+  REAL kx, ky, kz, e, lx, ly, lz, c = HBAR * HBAR / (2.0 * mass);
+  REAL complex *value;
+
+  lx = 2.0 * M_PI / (((REAL) nx) * grid->step);
+  ly = 2.0 * M_PI / (((REAL) ny) * grid->step);
+  lz = 2.0 * M_PI / (((REAL) nz) * grid->step);
+  cgrid_fft(grid);
+#ifdef GRID_MGPU
+  cgrid_host_lock(grid);
+#endif
+  value = grid->value;
+#pragma omp parallel for firstprivate(nx,ny,nz,nxy,lx,ly,lz,c,shift,inverse,value) private(i,j,k,ij,kx,ky,kz,e) default(none) schedule(runtime)
+  for(ij = 0; ij < nxy; ij++) {
+    i = ij / ny;
+    j = ij % ny;
+    kx = ((i < nx / 2) ? (REAL) i : (REAL) (i - nx)) * lx;
+    ky = ((j < ny / 2) ? (REAL) j : (REAL) (j - ny)) * ly;
+    for(k = 0; k < nz; k++) {
+      kz = ((k < nz / 2) ? (REAL) k : (REAL) (k - nz)) * lz;
+      e = c * (kx * kx + ky * ky + kz * kz) + shift;
+      if(inverse) value[ij * nz + k] /= e;
+      else value[ij * nz + k] *= e;
+    }
+  }
+#ifdef GRID_MGPU
+  cgrid_host_unlock(grid);
+#endif
+  cgrid_inverse_fft_norm(grid);
+}
+
+/*
+ * Objective for the minimizer at the wave function gwf: E (fixed number of atoms) or E - mu N.
+ * The total energy is returned in energy.
+ *
+ */
+
+static REAL dft_ot_driver_objective(dft_ot_functional *otf, wf *gwf, dft_ot_driver *drv, cgrid *cext, rgrid *density, rgrid *edens, INT iter, REAL *energy) {
+
+  if(drv->extpot) {
+    cgrid_zero(cext);
+    (*drv->extpot)(drv->extpot_arg, cext, gwf, iter);
+  }
+  *energy = dft_ot_driver_energy(otf, gwf, drv, cext, density, edens);
+  if(drv->natoms > 0.0) return *energy;
+  return *energy - drv->mu0 * grid_wf_norm(gwf);
+}
+
+/*
+ * Point on the search line: dst = psi + alpha d (fixed mu) or the corresponding point on the
+ * sphere || psi ||^2 = natoms (fixed number of atoms; d must be orthogonal to psi).
+ *
+ */
+
+static void dft_ot_driver_line(cgrid *dst, cgrid *psi, cgrid *d, REAL alpha, REAL dnorm, REAL natoms) {
+
+  REAL theta;
+
+  cgrid_copy(dst, psi);
+  if(natoms > 0.0) {
+    theta = alpha * dnorm / SQRT(natoms);
+    cgrid_multiply(dst, COS(theta));
+    cgrid_add_scaled(dst, SIN(theta) * SQRT(natoms) / dnorm, d);
+  } else cgrid_add_scaled(dst, alpha, d);
+}
+
+/*
+ * Find the ground state of helium (OT functional) with optional external potentials by direct
+ * minimization of the energy with preconditioned nonlinear conjugate gradients (Polak-Ribiere).
+ *
+ * The gradient (H - lambda) psi is obtained from dft_ot_potential() and the kinetic energy
+ * operator (FFT). It is preconditioned by 1 / (hbar^2 k^2 / (2m) + shift). For fixed number
+ * of atoms (drv->natoms > 0), lambda = <psi|H|psi> / N and the search directions are kept
+ * orthogonal to psi (the line search follows the sphere || psi ||^2 = N). Otherwise
+ * lambda = drv->mu0 and E - mu0 N is minimized. The line search fits a parabola using the
+ * directional derivative and one or two trial energies.
+ *
+ * otf = OT functional structure (input; dft_ot_functional *).
+ * gwf = Wave function: initial guess on entry, ground state on exit (input/output; wf *).
+ * drv = Driver parameters (input) and results (output) (dft_ot_driver *).
+ *       Initialize with dft_ot_ground_state_defaults(). The time step and acceleration
+ *       parameters are not used; drv->check sets the interval for progress output.
+ *
+ * Returns the total energy (also in drv->energy). The number of iterations, the last residual
+ * || (H - lambda) psi || / || psi || and convergence status are returned in drv->iterations,
+ * drv->residual and drv->converged.
+ *
+ */
+
+EXPORT REAL dft_ot_minimize(dft_ot_functional *otf, wf *gwf, dft_ot_driver *drv) {
+
+  cgrid *potential, *g, *gold, *z, *d, *cext = NULL;
+  rgrid *density, *edens;
+  wf *trial;
+  REAL natoms, lambda, shift, kmin, gz, gz_old = 0.0, beta, slope, dnorm, alpha = 1.0, alpha2, curv;
+  REAL omega, omega_t, omega_t2, energy = 0.0, energy_t, energy_t2, residual = -1.0, tmp;
+  INT iter, k;
+  char converged = 0, have_dir = 0, fresh = 1, ok;
+  dft_ot_lag *lag = NULL;
+
+  if(drv->check < 1) {
+    fprintf(stderr, "libdft: Illegal check interval in dft_ot_minimize().\n");
+    exit(1);
+  }
+  potential = cgrid_clone(gwf->grid, "dft_ot_minimize potential");
+  g = cgrid_clone(gwf->grid, "dft_ot_minimize g");
+  gold = cgrid_clone(gwf->grid, "dft_ot_minimize gold");
+  z = cgrid_clone(gwf->grid, "dft_ot_minimize z");
+  d = cgrid_clone(gwf->grid, "dft_ot_minimize d");
+  if(drv->extpot) cext = cgrid_clone(gwf->grid, "dft_ot_minimize cext");
+  density = rgrid_clone(otf->density, "dft_ot_minimize density");
+  edens = rgrid_clone(otf->density, "dft_ot_minimize edens");
+  trial = grid_wf_clone(gwf, "dft_ot_minimize trial");
+
+  if(drv->natoms > 0.0) {
+    gwf->norm = drv->natoms;
+    grid_wf_normalize(gwf);
+  }
+  /* Lowest non-zero kinetic energy on the grid (lower bound for the preconditioner shift) */
+  tmp = (REAL) gwf->grid->nx;
+  if(gwf->grid->ny > tmp) tmp = (REAL) gwf->grid->ny;
+  if(gwf->grid->nz > tmp) tmp = (REAL) gwf->grid->nz;
+  kmin = 2.0 * M_PI / (tmp * gwf->grid->step);
+  kmin = HBAR * HBAR * kmin * kmin / (2.0 * gwf->mass);
+
+  omega = dft_ot_driver_objective(otf, gwf, drv, cext, density, edens, 0, &energy);
+  omega_t = omega;
+
+  for(iter = 0; iter < drv->max_iter; iter++) {
+
+    /* Gradient: g = (T + V - lambda) psi */
+    dft_ot_driver_potential(otf, gwf, drv, potential, cext, 0.0, iter);
+    cgrid_copy(z, gwf->grid);
+    dft_ot_driver_kinetic(z, gwf->mass, 0.0, 0);                 /* z = T psi */
+    natoms = grid_wf_norm(gwf);
+    shift = CREAL(cgrid_integral_of_conjugate_product(gwf->grid, z)) / natoms;  /* <T> per atom */
+    cgrid_product(g, potential, gwf->grid);
+    cgrid_sum(g, g, z);
+    if(drv->natoms > 0.0) lambda = CREAL(cgrid_integral_of_conjugate_product(gwf->grid, g)) / natoms;
+    else lambda = drv->mu0;
+    cgrid_add_scaled(g, -lambda, gwf->grid);
+    residual = SQRT(cgrid_integral_of_square(g) / natoms);
+
+    /* Preconditioned gradient */
+    if(drv->precond > 0.0) shift = drv->precond;
+    else {
+      shift += FABS(lambda);
+      if(shift < kmin) shift = kmin;
+    }
+    cgrid_copy(z, g);
+    dft_ot_driver_kinetic(z, gwf->mass, shift, 1);
+    if(drv->natoms > 0.0) /* project out psi */
+      cgrid_add_scaled(z, -cgrid_integral_of_conjugate_product(gwf->grid, z) / natoms, gwf->grid);
+
+    /* Search direction (Polak-Ribiere with automatic restart) */
+    gz = CREAL(cgrid_integral_of_conjugate_product(z, g));
+    if(have_dir && gz_old > 0.0) {
+      beta = (gz - CREAL(cgrid_integral_of_conjugate_product(z, gold))) / gz_old;
+      if(beta < 0.0) beta = 0.0;
+    } else beta = 0.0;
+    if(beta == 0.0) {
+      cgrid_copy(d, z);
+      cgrid_multiply(d, -1.0);
+    } else {
+      cgrid_multiply(d, beta);
+      cgrid_add_scaled(d, -1.0, z);
+    }
+    if(drv->natoms > 0.0)
+      cgrid_add_scaled(d, -cgrid_integral_of_conjugate_product(gwf->grid, d) / natoms, gwf->grid);
+    slope = 2.0 * CREAL(cgrid_integral_of_conjugate_product(g, d));
+    if(slope >= 0.0) { /* not a descent direction: restart from steepest descent */
+      cgrid_copy(d, z);
+      cgrid_multiply(d, -1.0);
+      slope = -2.0 * gz;
+    }
+    cgrid_copy(gold, g);
+    gz_old = gz;
+    have_dir = 1;
+
+    if(drv->verbose && !(iter % drv->check))
+      printf("libdft: Iteration " FMT_I ": E = " FMT_R " K, objective = " FMT_R " K, residual = " FMT_R ".\n",
+             iter, energy * GRID_AUTOK, omega * GRID_AUTOK, residual);
+
+    /* Convergence (the energy change is not available right after a start or restart) */
+    if((drv->energy_tol > 0.0 || drv->residual_tol > 0.0)
+       && (drv->energy_tol <= 0.0 || (!fresh && FABS(omega - omega_t) / natoms < drv->energy_tol))
+       && (drv->residual_tol <= 0.0 || residual < drv->residual_tol)) {
+      if(otf->lag && !lag) {
+        /* Converged with lagged terms: continue with the full functional to verify */
+        lag = otf->lag;
+        otf->lag = NULL;
+        have_dir = 0;
+        fresh = 1;
+        omega = dft_ot_driver_objective(otf, gwf, drv, cext, density, edens, iter, &energy);
+        if(drv->verbose) printf("libdft: Converged with lagged terms - verifying with the full functional.\n");
+        continue;
+      }
+      converged = 1;
+      break;
+    }
+    omega_t = omega;  /* previous objective (for the energy test) */
+    if(slope >= 0.0) break;  /* zero gradient */
+
+    /* Line search */
+    dnorm = SQRT(cgrid_integral_of_square(d));
+    ok = 0;
+    for(k = 0; k < 8 && !ok; k++) {
+      dft_ot_driver_line(trial->grid, gwf->grid, d, alpha, dnorm, drv->natoms);
+      omega_t2 = dft_ot_driver_objective(otf, trial, drv, cext, density, edens, iter, &energy_t2);
+      curv = (omega_t2 - omega - slope * alpha) / (alpha * alpha);
+      if(curv > 0.0) {
+        alpha2 = -slope / (2.0 * curv);
+        if(alpha2 > 4.0 * alpha) alpha2 = 4.0 * alpha;
+      } else alpha2 = 2.0 * alpha;
+      if(FABS(alpha2 - alpha) > 0.1 * alpha) {
+        cgrid_copy(potential, trial->grid);  /* keep first trial point */
+        dft_ot_driver_line(trial->grid, gwf->grid, d, alpha2, dnorm, drv->natoms);
+        omega_t = dft_ot_driver_objective(otf, trial, drv, cext, density, edens, iter, &energy_t);
+        if(omega_t2 < omega_t) {
+          cgrid_copy(trial->grid, potential);
+          omega_t = omega_t2;
+          energy_t = energy_t2;
+        } else alpha = alpha2;
+      } else {
+        omega_t = omega_t2;
+        energy_t = energy_t2;
+      }
+      if(omega_t < omega) ok = 1;
+      else alpha *= 0.25;
+    }
+    if(!ok) {
+      if(beta == 0.0) break;   /* steepest descent failed as well */
+      have_dir = 0;            /* restart */
+      fresh = 1;
+      continue;
+    }
+    fresh = 0;
+    cgrid_copy(gwf->grid, trial->grid);
+    tmp = omega;
+    omega = omega_t;
+    omega_t = tmp;
+    energy = energy_t;
+  }
+
+  if(lag) { /* restore lagged evaluation */
+    otf->lag = lag;
+    dft_ot_lag_refresh(otf);
+  }
+  drv->iterations = iter;
+  drv->energy = energy;
+  drv->residual = residual;
+  drv->converged = converged;
+
+  cgrid_free(potential);
+  cgrid_free(g);
+  cgrid_free(gold);
+  cgrid_free(z);
+  cgrid_free(d);
+  if(cext) cgrid_free(cext);
+  rgrid_free(density);
+  rgrid_free(edens);
+  grid_wf_free(trial);
+
+  return energy;
+}
+
+/*
+ * Find the ground state using coarse-to-fine grid continuation. The ground state is first
+ * solved on a grid with step length multiplied by 2^(levels-1) (same box), then spectrally
+ * interpolated to the next finer level, and so on until the final grid of gwf.
+ * On the coarse levels the tolerances are multiplied by DFT_DRIVER_COARSE_TOL.
+ *
+ * otf      = OT functional structure for the final grid (input; dft_ot_functional *).
+ *            The functionals for the coarse levels are allocated with dft_ot_alloc_like()
+ *            using the model and parameters of otf (kernels shared between functionals with identical grids are reused).
+ * gwf      = Wave function: initial guess on entry, ground state on exit (input/output; wf *).
+ * drv      = Driver parameters (input) and results (output) (dft_ot_driver *).
+ *            drv->ext_pot (if given) is spectrally restricted to the coarse levels.
+ *            drv->extpot (if given) must accept wave functions and potentials on any grid.
+ *            The results refer to the final grid.
+ * levels   = Number of grid levels including the final grid (input; INT). The grid dimensions
+ *            must be divisible by 2^(levels-1) (except dimensions of length one).
+ * minimize = 0: use dft_ot_ground_state(), 1: use dft_ot_minimize() (input; char).
+ *
+ * Returns the total energy on the final grid.
+ *
+ */
+
+EXPORT REAL dft_ot_ground_state_multilevel(dft_ot_functional *otf, wf *gwf, dft_ot_driver *drv, INT levels, char minimize) {
+
+  INT l, f, nx = gwf->grid->nx, ny = gwf->grid->ny, nz = gwf->grid->nz, nxc, nyc, nzc;
+  wf *cwf, *pwf = NULL;
+  cgrid *cwork;
+  rgrid *rwork = NULL, *cext_pot = NULL;
+  dft_ot_functional *cotf;
+  dft_ot_driver cdrv;
+  REAL step = gwf->grid->step;
+
+  if(levels < 1) levels = 1;
+  f = 1 << (levels - 1);
+  if((nx > 1 && nx % f) || (ny > 1 && ny % f) || nz % f) {
+    fprintf(stderr, "libdft: Grid dimensions must be divisible by 2^(levels-1) in dft_ot_ground_state_multilevel().\n");
+    exit(1);
+  }
+  if(drv->ext_pot && levels > 1) rwork = rgrid_clone(drv->ext_pot, "multilevel rwork");
+
+  for(l = levels - 1; l > 0; l--) {
+    f = 1 << l;
+    nxc = (nx > 1)?(nx / f):1;
+    nyc = (ny > 1)?(ny / f):1;
+    nzc = nz / f;
+    cwf = grid_wf_alloc(nxc, nyc, nzc, step * (REAL) f, gwf->mass, gwf->boundary, gwf->propagator, "multilevel wf");
+    cgrid_set_origin(cwf->grid, gwf->grid->x0, gwf->grid->y0, gwf->grid->z0);
+    cgrid_set_momentum(cwf->grid, gwf->grid->kx0, gwf->grid->ky0, gwf->grid->kz0);
+
+    /* Initial guess: restriction of the input wave function or prolongation from the previous level */
+    if(!pwf) {
+      cwork = cgrid_clone(gwf->grid, "multilevel cwork");
+      cgrid_copy(cwork, gwf->grid);
+      cgrid_fft(cwork);
+      dft_ot_coarse_restrict_complex(cwf->grid, cwork);
+      cgrid_inverse_fft_norm(cwf->grid);
+    } else {
+      cwork = cgrid_clone(pwf->grid, "multilevel cwork");
+      cgrid_copy(cwork, pwf->grid);
+      cgrid_fft(cwork);
+      dft_ot_coarse_prolong_complex(cwf->grid, cwork);
+      cgrid_inverse_fft_norm(cwf->grid);
+      grid_wf_free(pwf);
+    }
+    cgrid_free(cwork);
+
+    if(!(cotf = dft_ot_alloc_like(otf, cwf, DFT_MIN_SUBSTEPS, DFT_MAX_SUBSTEPS))) {
+      fprintf(stderr, "libdft: Could not allocate functional for level " FMT_I " in dft_ot_ground_state_multilevel().\n", l);
+      exit(1);
+    }
+
+    cdrv = *drv;
+    cdrv.energy_tol *= DFT_DRIVER_COARSE_TOL;
+    cdrv.residual_tol *= DFT_DRIVER_COARSE_TOL;
+    if(drv->ext_pot) {
+      cext_pot = rgrid_alloc(nxc, nyc, nzc, step * (REAL) f, RGRID_PERIODIC_BOUNDARY, 0, "multilevel ext_pot");
+      rgrid_set_origin(cext_pot, drv->ext_pot->x0, drv->ext_pot->y0, drv->ext_pot->z0);
+      rgrid_copy(rwork, drv->ext_pot);
+      rgrid_fft(rwork);
+      dft_ot_coarse_restrict(cext_pot, rwork);
+      rgrid_inverse_fft_norm(cext_pot);
+      cdrv.ext_pot = cext_pot;
+    }
+
+    if(minimize) dft_ot_minimize(cotf, cwf, &cdrv);
+    else dft_ot_ground_state(cotf, cwf, &cdrv);
+    if(drv->verbose)
+      printf("libdft: Level " FMT_I " (step " FMT_R " Bohr): " FMT_I " iterations, E = " FMT_R " K.\n", l, step * (REAL) f, cdrv.iterations, cdrv.energy * GRID_AUTOK);
+
+    dft_ot_free(cotf);
+    if(cext_pot) {
+      rgrid_free(cext_pot);
+      cext_pot = NULL;
+    }
+    pwf = cwf;
+  }
+  if(rwork) rgrid_free(rwork);
+
+  /* Final grid */
+  if(pwf) {
+    cwork = cgrid_clone(pwf->grid, "multilevel cwork");
+    cgrid_copy(cwork, pwf->grid);
+    cgrid_fft(cwork);
+    dft_ot_coarse_prolong_complex(gwf->grid, cwork);
+    cgrid_inverse_fft_norm(gwf->grid);
+    cgrid_free(cwork);
+    grid_wf_free(pwf);
+  }
+
+  if(minimize) return dft_ot_minimize(otf, gwf, drv);
+  return dft_ot_ground_state(otf, gwf, drv);
+}
@@ -16,34 +16,28 @@
 #include "dft.h"
 #include "ot.h"
 
+static REAL dft_ot_energy_kc(dft_ot_functional *otf, rgrid *energy_density, wf *wf, rgrid *density, char integrate);
+static REAL dft_ot_energy_bf(dft_ot_functional *otf, rgrid *energy_density, wf *wf, rgrid *density, char integrate);
+
 /*
- * Evaluate the potential part to the energy density. Integrate to get the total energy.
- * Note: the single particle kinetic portion is NOT included.
- *       (use grid_wf_kinetic_energy() to calculate this separately)
- *
- * otf            = OT functional structure (dft_ot_functional *; input).
- * energy_density = Energy density grid (rgrid *; output).
- * wf             = Wafe function (wf *; input).
- *
- * Workspace usage (uses density as well):
- * GP: none
- * Plain OT: workspace1 - workspace2
- * KC: workspace1 - workspace8
- * BF: workspace1 - workspace7
+ * Energy density and/or the integrals of the individual terms.
  *
- * No return value.
+ * energy_density = Energy density grid or NULL if not needed (rgrid *; output).
+ * terms          = Energy components or NULL if not needed (dft_ot_energy_terms *; output).
  *
  */
 
-EXPORT void dft_ot_energy_density(dft_ot_functional *otf, rgrid *energy_density, wf *wf) {
+static void dft_ot_energy_eval(dft_ot_functional *otf, rgrid *energy_density, dft_ot_energy_terms *terms, wf *wf) {
 
   rgrid *workspace1, *workspace2;
   rgrid *density;
+  REAL tmp;
 
   density = otf->density;  
   grid_wf_density(wf, density);
 
-  rgrid_zero(energy_density);
+  if(energy_density) rgrid_zero(energy_density);
+  if(terms) terms->lj = terms->c2 = terms->c3 = terms->hd = terms->thermal = terms->kc = terms->bf = terms->gp = terms->total = 0.0;
 
   if(otf->model & DFT_ZERO) {
     fprintf(stderr, "libdft: Warning - zero potential used.\n");
@@ -52,7 +46,8 @@ EXPORT void dft_ot_energy_density(dft_ot_functional *otf, rgrid *energy_density,
 
   if((otf->model & DFT_GP) || (otf->model & DFT_GP2)) {
     /* the energy functional is: (\lambda/2)\int \left|\psi\right|^4 d\tau */
-    rgrid_add_scaled_product(energy_density, 0.5 * otf->mu0 / otf->rho0, density, density);
+    if(energy_density) rgrid_add_scaled_product(energy_density, 0.5 * otf->mu0 / otf->rho0, density, density);
+    if(terms) terms->total = terms->gp = 0.5 * (otf->mu0 / otf->rho0) * rgrid_integral_of_product(density, density);
     return;
   }
 
@@ -69,7 +64,8 @@ EXPORT void dft_ot_energy_density(dft_ot_functional *otf, rgrid *energy_density,
   /* (1/2) rho(r) int V_lj(|r-r'|) rho(r') dr' */
   rgrid_fft_convolute(workspace2, workspace1, otf->lennard_jones);
   rgrid_inverse_fft_norm2(workspace2);
-  rgrid_add_scaled_product(energy_density, 0.5, density, workspace2);
+  if(energy_density) rgrid_add_scaled_product(energy_density, 0.5, density, workspace2);
+  if(terms) terms->lj = 0.5 * rgrid_integral_of_product(density, workspace2);
 
   /* non-local correlation */
   /* wrk1 = \bar{\rho} */
@@ -82,7 +78,8 @@ EXPORT void dft_ot_energy_density(dft_ot_functional *otf, rgrid *energy_density,
   else
     rgrid_ipower(workspace2, workspace1, (INT) otf->c2_exp);
   rgrid_product(workspace2, workspace2, density);
-  rgrid_add_scaled(energy_density, otf->c2 / 2.0, workspace2);
+  if(energy_density) rgrid_add_scaled(energy_density, otf->c2 / 2.0, workspace2);
+  if(terms) terms->c2 = (otf->c2 / 2.0) * rgrid_integral(workspace2);
 
   /* C3 term */
   if(otf->model & DFT_DR) 
@@ -90,23 +87,82 @@ EXPORT void dft_ot_energy_density(dft_ot_functional *otf, rgrid *energy_density,
   else
     rgrid_ipower(workspace2, workspace1, (INT) otf->c3_exp);
   rgrid_product(workspace2, workspace2, density);
-  rgrid_add_scaled(energy_density, otf->c3 / 3.0, workspace2);
+  if(energy_density) rgrid_add_scaled(energy_density, otf->c3 / 3.0, workspace2);
+  if(terms) terms->c3 = (otf->c3 / 3.0) * rgrid_integral(workspace2);
 
   /* Barranco's contribution (high density) */
   if((otf->model & DFT_OT_HD) || (otf->model & DFT_OT_HD2)) {
     grid_func5_operate_one(workspace1, density, otf->beta, otf->rhom, otf->C);
-    rgrid_sum(energy_density, energy_density, workspace1);
+    if(energy_density) rgrid_sum(energy_density, energy_density, workspace1);
+    if(terms) terms->hd = rgrid_integral(workspace1);
   }
 
   /* Ideal gas contribution (thermal) */
   if(otf->model >= DFT_OT_T400MK && otf->model < DFT_GP) { /* do not add this for DR */
     grid_func6b_operate_one(workspace1, density, otf->mass, otf->temp, otf->c4);
-    rgrid_sum(energy_density, energy_density, workspace1);
+    if(energy_density) rgrid_sum(energy_density, energy_density, workspace1);
+    if(terms) terms->thermal = rgrid_integral(workspace1);
+  }
+
+  if(otf->model & DFT_OT_KC) {
+    tmp = dft_ot_energy_kc(otf, energy_density, wf, density, terms != NULL);
+    if(terms) terms->kc = tmp;
   }
 
-  if(otf->model & DFT_OT_KC) dft_ot_energy_density_kc(otf, energy_density, wf, density);
+  if(otf->model & DFT_OT_BACKFLOW) {
+    tmp = dft_ot_energy_bf(otf, energy_density, wf, density, terms != NULL);
+    if(terms) terms->bf = tmp;
+  }
+
+  if(terms) terms->total = terms->lj + terms->c2 + terms->c3 + terms->hd + terms->thermal + terms->kc + terms->bf;
+}
+
+/*
+ * Evaluate the potential part to the energy density. Integrate to get the total energy.
+ * Note: the single particle kinetic portion is NOT included.
+ *       (use grid_wf_kinetic_energy() to calculate this separately)
+ *
+ * otf            = OT functional structure (dft_ot_functional *; input).
+ * energy_density = Energy density grid (rgrid *; output).
+ * wf             = Wafe function (wf *; input).
+ *
+ * Workspace usage (uses density as well):
+ * GP: none
+ * Plain OT: workspace1 - workspace2
+ * KC: workspace1 - workspace8
+ * BF: workspace1 - workspace7
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_energy_density(dft_ot_functional *otf, rgrid *energy_density, wf *wf) {
 
-  if(otf->model & DFT_OT_BACKFLOW) dft_ot_energy_density_bf(otf, energy_density, wf, density);
+  dft_ot_energy_eval(otf, energy_density, NULL, wf);
+}
+
+/*
+ * Evaluate the integrals of the individual terms of the functional (LJ, C2, C3, HD, thermal,
+ * KC, BF or GP) in one pass. No energy density grid is needed: each term is integrated
+ * directly from the workspace where it is formed.
+ * Note: the single particle kinetic portion is NOT included.
+ *       (use grid_wf_kinetic_energy() to calculate this separately)
+ *
+ * otf   = OT functional structure (dft_ot_functional *; input).
+ * terms = Energy components (dft_ot_energy_terms *; output). Terms not included
+ *         in the model are set to zero. terms->total is the sum of all terms, which
+ *         equals the integral of dft_ot_energy_density().
+ * wf    = Wave function (wf *; input).
+ *
+ * Workspace usage: same as dft_ot_energy_density().
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_energy_terms_eval(dft_ot_functional *otf, dft_ot_energy_terms *terms, wf *wf) {
+
+  dft_ot_energy_eval(otf, NULL, terms, wf);
 }
 
 /*
@@ -121,6 +177,17 @@ EXPORT void dft_ot_energy_density(dft_ot_functional *otf, rgrid *energy_density,
 
 EXPORT void dft_ot_energy_density_kc(dft_ot_functional *otf, rgrid *energy_density, wf *wf, rgrid *density) {
 
+  dft_ot_energy_kc(otf, energy_density, wf, density, 0);
+}
+
+/*
+ * KC energy density (added to energy_density if not NULL) and its integral (if integrate != 0).
+ *
+ */
+
+static REAL dft_ot_energy_kc(dft_ot_functional *otf, rgrid *energy_density, wf *wf, rgrid *density, char integrate) {
+
+  REAL tmp = 0.0;
   rgrid *workspace1, *workspace2, *workspace3, *workspace4, *workspace5, *workspace6, *workspace7, *workspace8;
 
   if(!otf->workspace1) otf->workspace1 = rgrid_clone(density, "OTF workspace 1");
@@ -143,7 +210,7 @@ EXPORT void dft_ot_energy_density_kc(dft_ot_functional *otf, rgrid *energy_densi
   /* 1. convolute density with F to get \tilde{\rho} (wrk1) */
   rgrid_copy(workspace2, density);
   rgrid_fft(workspace2);
-  rgrid_fft_convolute(workspace1, workspace2, otf->gaussian_tf);   /* otf->gaussian_tf is already in Fourier space */    
+  dft_common_bandlimit_convolute(workspace1, workspace2, otf->gaussian_tf, otf->gaussian_kmax);   /* otf->gaussian_tf is already in Fourier space */    
   rgrid_inverse_fft_norm2(workspace1);
 
   /* 2. modify wrk1 from \tilde{\rho} to (1 - \tilde{\rho}/\rho_{0s} */
@@ -165,9 +232,9 @@ EXPORT void dft_ot_energy_density_kc(dft_ot_functional *otf, rgrid *energy_densi
   rgrid_fft(workspace6);
   rgrid_fft(workspace7);
   rgrid_fft(workspace8);
-  rgrid_fft_convolute(workspace6, workspace6, otf->gaussian_tf);
-  rgrid_fft_convolute(workspace7, workspace7, otf->gaussian_tf);
-  rgrid_fft_convolute(workspace8, workspace8, otf->gaussian_tf);
+  dft_common_bandlimit_convolute(workspace6, workspace6, otf->gaussian_tf, otf->gaussian_kmax);
+  dft_common_bandlimit_convolute(workspace7, workspace7, otf->gaussian_tf, otf->gaussian_kmax);
+  dft_common_bandlimit_convolute(workspace8, workspace8, otf->gaussian_tf, otf->gaussian_kmax);
   rgrid_inverse_fft_norm2(workspace6);
   rgrid_inverse_fft_norm2(workspace7);
   rgrid_inverse_fft_norm2(workspace8);
@@ -184,9 +251,13 @@ EXPORT void dft_ot_energy_density_kc(dft_ot_functional *otf, rgrid *energy_densi
     
   /* 7. add wrk6 + wrk7 + wrk8 (components from the dot product) */
   /* 8. multiply by -\hbar^2\alpha_s/(4M_{He}) */    
-  rgrid_add_scaled(energy_density, -otf->alpha_s / (4.0 * otf->mass), workspace6);
-  rgrid_add_scaled(energy_density, -otf->alpha_s / (4.0 * otf->mass), workspace7);
-  rgrid_add_scaled(energy_density, -otf->alpha_s / (4.0 * otf->mass), workspace8);
+  if(energy_density) {
+    rgrid_add_scaled(energy_density, -otf->alpha_s / (4.0 * otf->mass), workspace6);
+    rgrid_add_scaled(energy_density, -otf->alpha_s / (4.0 * otf->mass), workspace7);
+    rgrid_add_scaled(energy_density, -otf->alpha_s / (4.0 * otf->mass), workspace8);
+  }
+  if(integrate) tmp = -(otf->alpha_s / (4.0 * otf->mass)) * (rgrid_integral(workspace6) + rgrid_integral(workspace7) + rgrid_integral(workspace8));
+  return tmp;
 }
 
 /*
@@ -201,6 +272,17 @@ EXPORT void dft_ot_energy_density_kc(dft_ot_functional *otf, rgrid *energy_densi
 
 EXPORT void dft_ot_energy_density_bf(dft_ot_functional *otf, rgrid *energy_density, wf *wf, rgrid *density) {
 
+  dft_ot_energy_bf(otf, energy_density, wf, density, 0);
+}
+
+/*
+ * BF energy density (added to energy_density if not NULL) and its integral (if integrate != 0).
+ *
+ */
+
+static REAL dft_ot_energy_bf(dft_ot_functional *otf, rgrid *energy_density, wf *wf, rgrid *density, char integrate) {
+
+  REAL tmp = 0.0;
   rgrid *workspace1, *workspace2, *workspace3, *workspace4, *workspace5, *workspace6, *workspace7;
 
   if(!otf->workspace1) otf->workspace1 = rgrid_clone(density, "OTF workspace 1");
@@ -244,45 +326,51 @@ EXPORT void dft_ot_energy_density_bf(dft_ot_functional *otf, rgrid *energy_densi
   /* Term 1: -(M/4) * rho(r) * v(r)^2 \int U_j(|r - r'|) * rho(r') d3r' */
   rgrid_copy(workspace5, workspace7);   /* wrk7 = density */
   rgrid_fft(workspace5);                        /* This was done before - TODO: save previous rho FFT and reuse here */
-  rgrid_fft_convolute(workspace6, otf->backflow_pot, workspace5);
+  dft_common_bandlimit_convolute(workspace6, workspace5, otf->backflow_pot, otf->backflow_kmax);
   rgrid_inverse_fft_norm2(workspace6);
   rgrid_product(workspace6, workspace6, workspace4); /* x v(r)^2 */
   rgrid_product(workspace6, workspace6, workspace7); /* x rho(r) */
-  rgrid_add_scaled(energy_density, -otf->mass / 4.0, workspace6);
+  if(energy_density) rgrid_add_scaled(energy_density, -otf->mass / 4.0, workspace6);
+  if(integrate) tmp += (-otf->mass / 4.0) * rgrid_integral(workspace6);
 
   /* Term 2 (cross term, 2x): +(M/2) * rho(r) v(r) . \int U_j(|r - r'|) * rho(r') v(r') d3r' */
   /* x contribution */
   rgrid_product(workspace5, workspace7, workspace1);   /* wrk5 = rho(r') * v_x(r') */
   rgrid_fft(workspace5);
-  rgrid_fft_convolute(workspace6, otf->backflow_pot, workspace5);
+  dft_common_bandlimit_convolute(workspace6, workspace5, otf->backflow_pot, otf->backflow_kmax);
   rgrid_inverse_fft_norm2(workspace6);
   rgrid_product(workspace6, workspace6, workspace7); /* x density(wrk7) */
   rgrid_product(workspace6, workspace6, workspace1); /* x v_x(wrk1) */
-  rgrid_add_scaled(energy_density, otf->mass / 2.0, workspace6);
+  if(energy_density) rgrid_add_scaled(energy_density, otf->mass / 2.0, workspace6);
+  if(integrate) tmp += (otf->mass / 2.0) * rgrid_integral(workspace6);
 
   /* y contribution */
   rgrid_product(workspace5, workspace7, workspace2);   /* rho(r') * v_y(r') */
   rgrid_fft(workspace5);
-  rgrid_fft_convolute(workspace6, otf->backflow_pot, workspace5);
+  dft_common_bandlimit_convolute(workspace6, workspace5, otf->backflow_pot, otf->backflow_kmax);
   rgrid_inverse_fft_norm2(workspace6);
   rgrid_product(workspace6, workspace6, workspace7); /* x density(wrk7) */
   rgrid_product(workspace6, workspace6, workspace2); /* x v_y(wrk2) */
-  rgrid_add_scaled(energy_density, otf->mass / 2.0, workspace6);
+  if(energy_density) rgrid_add_scaled(energy_density, otf->mass / 2.0, workspace6);
+  if(integrate) tmp += (otf->mass / 2.0) * rgrid_integral(workspace6);
 
   /* z contribution */
   rgrid_product(workspace5, workspace7, workspace3);   /* rho(r') * v_z(r') */
   rgrid_fft(workspace5);
-  rgrid_fft_convolute(workspace6, otf->backflow_pot, workspace5);
+  dft_common_bandlimit_convolute(workspace6, workspace5, otf->backflow_pot, otf->backflow_kmax);
   rgrid_inverse_fft_norm2(workspace6);
   rgrid_product(workspace6, workspace6, workspace7); /* x density(wrk7) */
   rgrid_product(workspace6, workspace6, workspace3); /* x v_z(wrk3) */
-  rgrid_add_scaled(energy_density, otf->mass / 2.0, workspace6);
+  if(energy_density) rgrid_add_scaled(energy_density, otf->mass / 2.0, workspace6);
+  if(integrate) tmp += (otf->mass / 2.0) * rgrid_integral(workspace6);
 
   /* Term 3: -(M/4) rho(r) \int U_j(|r - r'|) rho(r') v^2(r') d3r' */
   rgrid_product(workspace5, workspace7, workspace4); /* wrk5 = density x |v|^2 */
   rgrid_fft(workspace5);
-  rgrid_fft_convolute(workspace6, otf->backflow_pot, workspace5);
+  dft_common_bandlimit_convolute(workspace6, workspace5, otf->backflow_pot, otf->backflow_kmax);
   rgrid_inverse_fft_norm2(workspace6);
   rgrid_product(workspace6, workspace6, workspace7);
-  rgrid_add_scaled(energy_density, -otf->mass / 4.0, workspace6);
+  if(energy_density) rgrid_add_scaled(energy_density, -otf->mass / 4.0, workspace6);
+  if(integrate) tmp += (-otf->mass / 4.0) * rgrid_integral(workspace6);
+  return tmp;
 }
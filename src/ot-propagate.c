@@ -0,0 +1,323 @@
+/*
+ * Self-consistent time propagation with the Orsay-Trento potential.
+ *
+ * The propagators in libgrid (grid_wf_propagate_predict/correct) provide
+ * predictor-corrector only for the 2nd order FFT splitting. The routines
+ * below use complete time steps of grid_wf_propagate() for both the
+ * predictor and the corrector, so that any propagator of the wave function
+ * (including WF_4TH_ORDER_FFT and WF_4TH_ORDER_CFFT) can be used:
+ *
+ * 1. V_n = V[psi(t), t]
+ * 2. psi* = U(V_n) psi(t)                                (predictor)
+ * 3. psi(t + dt) = U((V_n + V[psi*, t + dt]) / 2) psi(t)  (corrector; may be iterated)
+ *
+ * where U(V) denotes one step of the wave function propagator with potential V.
+ *
+ * NOTE: This is the trapezoidal predictor-corrector, so the self-consistent treatment
+ *       of the potential (nonlinear OT and time dependent external) remains second
+ *       order in the time step even with a 4th order propagator. The higher order
+ *       splitting reduces only the error from the kinetic/potential splitting within
+ *       each step, which dominates for stiff kinetic terms (small grid step).
+ *
+ * dft_ot_propagate_adaptive() adjusts the time step using the difference between
+ * the predicted and corrected wave functions as the local error estimate and
+ * monitors the norm and energy drifts.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <grid/grid.h>
+#include <grid/au.h>
+#include "dft.h"
+#include "ot.h"
+
+/*
+ * Allocate self-consistent propagator.
+ *
+ * otf     = OT functional structure (input; dft_ot_functional *).
+ * gwf     = Wave function to be propagated (input; wf *). Its propagator
+ *           (gwf->propagator) defines the splitting used.
+ * ext_pot = Static external potential (input; rgrid *). NULL if none.
+ * mu0     = Chemical potential subtracted from the potential (input; REAL).
+ *
+ * Returns pointer to the propagator structure. The callback for a time dependent external
+ * potential (extpot, extpot_arg) and the number of corrector iterations (correct; default 1)
+ * may be set in the structure after this call.
+ *
+ */
+
+EXPORT dft_ot_propagator *dft_ot_propagator_alloc(dft_ot_functional *otf, wf *gwf, rgrid *ext_pot, REAL mu0) {
+
+  dft_ot_propagator *prop;
+
+  if(!(prop = (dft_ot_propagator *) malloc(sizeof(dft_ot_propagator)))) {
+    fprintf(stderr, "libdft: Error in dft_ot_propagator_alloc(): Could not allocate memory.\n");
+    return NULL;
+  }
+  prop->otf = otf;
+  prop->gwfp = grid_wf_clone(gwf, "OT propagator gwfp");
+  prop->potential = cgrid_clone(gwf->grid, "OT propagator potential");
+  prop->potential2 = cgrid_clone(gwf->grid, "OT propagator potential2");
+  prop->predict = NULL;
+  prop->ext_pot = ext_pot;
+  prop->extpot = NULL;
+  prop->extpot_arg = NULL;
+  prop->mu0 = mu0;
+  prop->correct = 1;
+  prop->iter = 0;
+  return prop;
+}
+
+/*
+ * Free self-consistent propagator.
+ *
+ * prop = Propagator to be freed (input; dft_ot_propagator *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_propagator_free(dft_ot_propagator *prop) {
+
+  if(!prop) return;
+  grid_wf_free(prop->gwfp);
+  cgrid_free(prop->potential);
+  cgrid_free(prop->potential2);
+  if(prop->predict) cgrid_free(prop->predict);
+  free(prop);
+}
+
+/*
+ * Evaluate the total potential (external + OT - mu0) for the given wave function.
+ * The time dependent external potential (extpot) is evaluated at time step prop->iter.
+ *
+ * prop      = Propagator (input; dft_ot_propagator *).
+ * potential = Potential (output; cgrid *).
+ * gwf       = Wave function (input; wf *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_propagator_potential(dft_ot_propagator *prop, cgrid *potential, wf *gwf) {
+
+  if(prop->ext_pot) grid_real_to_complex_re(potential, prop->ext_pot);
+  else cgrid_zero(potential);
+  if(prop->extpot) (*prop->extpot)(prop->extpot_arg, potential, gwf, prop->iter);
+  dft_ot_potential(prop->otf, potential, gwf);
+  if(prop->mu0 != 0.0) cgrid_add(potential, -prop->mu0);
+}
+
+/*
+ * Propagate wave function by one time step with self-consistent (predictor-corrector)
+ * treatment of the OT potential. Works with any propagator of the wave function.
+ *
+ * prop  = Propagator (input/output; dft_ot_propagator *).
+ * gwf   = Wave function to be propagated (input/output; wf *).
+ * tstep = Time step (input; REAL complex). Use -I * dt for imaginary time.
+ *
+ * No return value.
+ *
+ * On exit, prop->potential holds the potential at the beginning of the step
+ * and prop->potential2 the potential used in the last corrector. If prop->predict
+ * is allocated, it holds the predicted wave function (prop->gwfp holds the last
+ * corrector iterate when prop->correct > 1).
+ *
+ */
+
+EXPORT void dft_ot_propagate(dft_ot_propagator *prop, wf *gwf, REAL complex tstep) {
+
+  INT c;
+
+  /* Predictor */
+  dft_ot_propagator_potential(prop, prop->potential, gwf);
+  cgrid_copy(prop->gwfp->grid, gwf->grid);
+  grid_wf_propagate(prop->gwfp, prop->potential, tstep);
+  if(prop->predict) cgrid_copy(prop->predict, prop->gwfp->grid);
+
+  /* Corrector(s): potential2 = (V_n + V*) / 2 with V* at the end of the step (iter + 1) */
+  prop->iter++;
+  for(c = 0; c < prop->correct || c == 0; c++) {
+    dft_ot_propagator_potential(prop, prop->potential2, prop->gwfp);
+    cgrid_sum(prop->potential2, prop->potential2, prop->potential);
+    cgrid_multiply(prop->potential2, 0.5);
+    if(c < prop->correct - 1) {
+      cgrid_copy(prop->gwfp->grid, gwf->grid);
+      grid_wf_propagate(prop->gwfp, prop->potential2, tstep);
+    } else grid_wf_propagate(gwf, prop->potential2, tstep);
+  }
+}
+
+/*
+ * Allocate adaptive time step controller.
+ *
+ * prop   = Propagator to be used with the controller (input; dft_ot_propagator *).
+ * dt     = Initial time step (input; REAL).
+ * min_dt = Smallest time step allowed (input; REAL).
+ * max_dt = Largest time step allowed (input; REAL).
+ * tol    = Tolerance for the local error estimate per step (input; REAL).
+ *
+ * Returns pointer to the controller. The remaining parameters (norm_tol, energy_tol,
+ * energy_check, safety, grow_max, shrink_min, log) may be changed in the structure
+ * after this call.
+ *
+ */
+
+EXPORT dft_ot_stepper *dft_ot_stepper_alloc(dft_ot_propagator *prop, REAL dt, REAL min_dt, REAL max_dt, REAL tol) {
+
+  dft_ot_stepper *st;
+
+  if(min_dt <= 0.0 || max_dt < min_dt || tol <= 0.0) {
+    fprintf(stderr, "libdft: Illegal parameters in dft_ot_stepper_alloc().\n");
+    return NULL;
+  }
+  if(!(st = (dft_ot_stepper *) malloc(sizeof(dft_ot_stepper)))) {
+    fprintf(stderr, "libdft: Error in dft_ot_stepper_alloc(): Could not allocate memory.\n");
+    return NULL;
+  }
+  if(dt < min_dt) dt = min_dt;
+  if(dt > max_dt) dt = max_dt;
+  st->dt = dt;
+  st->min_dt = min_dt;
+  st->max_dt = max_dt;
+  st->tol = tol;
+  st->norm_tol = 1E-8;
+  st->energy_tol = -1.0;
+  st->energy_check = 100;
+  st->safety = 0.9;
+  st->grow_max = 1.5;
+  st->shrink_min = 0.2;
+  st->time = 0.0;
+  st->error = 0.0;
+  st->energy0 = 0.0;
+  st->accepted = st->rejected = 0;
+  st->log = NULL;
+  st->save = cgrid_clone(prop->gwfp->grid, "OT stepper save");
+  st->density = st->edens = NULL;
+  return st;
+}
+
+/*
+ * Free adaptive time step controller.
+ *
+ * st = Controller to be freed (input; dft_ot_stepper *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_stepper_free(dft_ot_stepper *st) {
+
+  if(!st) return;
+  cgrid_free(st->save);
+  if(st->density) rgrid_free(st->density);
+  if(st->edens) rgrid_free(st->edens);
+  free(st);
+}
+
+/*
+ * Energy for the drift check (OT + kinetic + static external potential).
+ *
+ */
+
+static REAL dft_ot_stepper_energy(dft_ot_propagator *prop, dft_ot_stepper *st, wf *gwf) {
+
+  REAL energy;
+
+  if(!st->density) {
+    st->density = rgrid_clone(prop->otf->density, "OT stepper density");
+    st->edens = rgrid_clone(prop->otf->density, "OT stepper edens");
+  }
+  dft_ot_energy_density(prop->otf, st->edens, gwf);
+  energy = grid_wf_energy(gwf, NULL) + rgrid_integral(st->edens);
+  if(prop->ext_pot) {
+    grid_wf_density(gwf, st->density);
+    rgrid_product(st->edens, st->density, prop->ext_pot);
+    energy += rgrid_integral(st->edens);
+  }
+  return energy;
+}
+
+/*
+ * Take one accepted real time step with adaptive step length. Steps are repeated with
+ * a shorter time step until the local error estimate (difference between the predicted and
+ * corrected wave functions) and the norm drift are below tolerance. The next step length
+ * is chosen from the error estimate (local error of the predictor ~ dt^2).
+ * Every st->energy_check accepted steps the energy drift is checked and the step
+ * is reduced if it exceeds st->energy_tol (meaningful only for a time independent Hamiltonian).
+ *
+ * prop  = Propagator (input/output; dft_ot_propagator *).
+ * st    = Step controller (input/output; dft_ot_stepper *).
+ * gwf   = Wave function to be propagated (input/output; wf *).
+ * t_end = Do not step past this time (input; REAL). Set to < 0 for no limit.
+ *
+ * Returns the time step taken (st->time is advanced by this amount).
+ *
+ */
+
+EXPORT REAL dft_ot_propagate_adaptive(dft_ot_propagator *prop, dft_ot_stepper *st, wf *gwf, REAL t_end) {
+
+  REAL dt, norm0, norm, drift, err, fac, energy;
+
+  if(t_end >= 0.0 && st->time >= t_end) return 0.0;
+  if(st->energy_tol > 0.0 && !st->accepted) st->energy0 = dft_ot_stepper_energy(prop, st, gwf);
+  norm0 = cgrid_integral_of_square(gwf->grid);
+  while(1) {
+    dt = st->dt;
+    if(t_end >= 0.0 && st->time + dt > t_end) dt = t_end - st->time;
+    cgrid_copy(st->save, gwf->grid);
+    /* With several corrector iterations gwfp is not the predictor: keep a copy of it */
+    if(prop->correct > 1 && !prop->predict) prop->predict = cgrid_clone(gwf->grid, "OT propagator predict");
+    dft_ot_propagate(prop, gwf, (REAL complex) dt);
+
+    /* Local error estimate (corrected - predicted) and norm drift */
+    norm = cgrid_integral_of_square(gwf->grid);
+    cgrid_difference(prop->gwfp->grid, gwf->grid, (prop->correct > 1)?prop->predict:prop->gwfp->grid);
+    err = SQRT(cgrid_integral_of_square(prop->gwfp->grid) / norm);
+    drift = FABS(norm - norm0) / norm0;
+    st->error = err;
+
+    /* New step length */
+    if(err > 0.0) fac = st->safety * SQRT(st->tol / err);
+    else fac = st->grow_max;
+    if(st->norm_tol > 0.0 && drift > st->norm_tol && fac > st->safety * SQRT(st->norm_tol / drift))
+      fac = st->safety * SQRT(st->norm_tol / drift);
+    if(fac > st->grow_max) fac = st->grow_max;
+    if(fac < st->shrink_min) fac = st->shrink_min;
+
+    if((err <= st->tol && (st->norm_tol <= 0.0 || drift <= st->norm_tol)) || st->dt <= st->min_dt) {
+      if(err > st->tol) fprintf(stderr, "libdft: Warning - error tolerance not met with the minimum time step in dft_ot_propagate_adaptive().\n");
+      break;
+    }
+    /* Reject */
+    cgrid_copy(gwf->grid, st->save);
+    prop->iter--;
+    st->rejected++;
+    st->dt *= fac;
+    if(st->dt < st->min_dt) st->dt = st->min_dt;
+  }
+
+  st->time += dt;
+  st->accepted++;
+  if(dt == st->dt) {   /* do not grow based on a truncated step */
+    st->dt *= fac;
+    if(st->dt < st->min_dt) st->dt = st->min_dt;
+    if(st->dt > st->max_dt) st->dt = st->max_dt;
+  }
+
+  if(st->energy_tol > 0.0 && st->energy_check > 0 && !(st->accepted % st->energy_check)) {
+    energy = dft_ot_stepper_energy(prop, st, gwf);
+    if(FABS(energy - st->energy0) > st->energy_tol * FABS(st->energy0)) {
+      st->dt *= st->shrink_min;
+      if(st->dt < st->min_dt) st->dt = st->min_dt;
+      st->energy0 = energy;  /* new reference for the drift */
+      if(st->log) fprintf(st->log, "# Energy drift exceeded at t = " FMT_R " fs - step reduced to " FMT_R " fs.\n", st->time * GRID_AUTOFS, st->dt * GRID_AUTOFS);
+    }
+  }
+
+  if(st->log) fprintf(st->log, FMT_R " " FMT_R " " FMT_R " " FMT_R "\n", st->time * GRID_AUTOFS, dt * GRID_AUTOFS, err, drift);
+
+  return dt;
+}
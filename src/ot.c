@@ -18,12 +18,22 @@
 
 /* Local functions */
 
-static void dft_ot_add_nonlocal_correlation_potential(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3, rgrid *workspace4, rgrid *workspace5);
-static void dft_ot_add_nonlocal_correlation_potential_x(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3, rgrid *workspace4);
-static void dft_ot_add_nonlocal_correlation_potential_y(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3, rgrid *workspace4);
-static void dft_ot_add_nonlocal_correlation_potential_z(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3, rgrid *workspace4);
+static void dft_ot_add_nonlocal_correlation_potential(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3, rgrid *workspace4, rgrid *workspace5, rgrid *workspace6);
+static void dft_ot_add_nonlocal_correlation_potential_x(dft_ot_functional *otf, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *acc_fg, rgrid *acc_h, cgrid *potential, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3);
+static void dft_ot_add_nonlocal_correlation_potential_y(dft_ot_functional *otf, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *acc_fg, rgrid *acc_h, cgrid *potential, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3);
+static void dft_ot_add_nonlocal_correlation_potential_z(dft_ot_functional *otf, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *acc_fg, rgrid *acc_h, cgrid *potential, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3);
 static void dft_ot_add_barranco(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *workspace1);
 static void dft_ot_add_ancilotto(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *workspace1);
+static void dft_ot_add_local_correlation_direct(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *workspace1, rgrid *workspace2);
+static void dft_ot_potential_rest(dft_ot_functional *otf, dft_ot_context *ctx, cgrid *potential, wf *wf);
+static char dft_ot_lag_update(dft_ot_lag *lag, rgrid *density, rgrid *workspace);
+static char dft_ot_kernels_attach(dft_ot_functional *otf, wf *gwf, INT min_substeps, INT max_substeps);
+static void dft_ot_kernels_register(dft_ot_functional *otf, wf *gwf, INT min_substeps, INT max_substeps);
+static void dft_ot_kernels_release(dft_ot_kernels *kernels);
+static dft_ot_functional *dft_ot_alloc_params(INT model, dft_ot_functional *params, wf *gwf, INT min_substeps, INT max_substeps);
+
+/* Registry of kernel sets (shared between functionals) */
+static dft_ot_kernels *dft_ot_kernel_registry = NULL;
 
 /*
  * Allocate OT functional. This must be called first.
@@ -59,13 +69,79 @@ static void dft_ot_add_ancilotto(dft_ot_functional *otf, cgrid *potential, rgrid
  * Return value: pointer to the allocated OT DFT structure.
  *
  * Basic OT allocates 2 real grids
- *       KC adds 4 real grids
- *       BF adds 3 real grids
+ *       KC adds 5 real grids
+ *       BF adds 2 real grids (+ 4 if KC not included)
+ *
+ * Functionals with identical grids and kernel parameters share the kernel
+ * grids (reference counted; released by dft_ot_free()).
+ *
+ * The effective k-space support of the KC and BF kernels is determined
+ * using tolerance DFT_OT_BANDLIMIT_TOL (see dft_ot_bandlimit()).
  *
  */
 
 EXPORT dft_ot_functional *dft_ot_alloc(INT model, wf *gwf, INT min_substeps, INT max_substeps) {
 
+  return dft_ot_alloc_params(model, NULL, gwf, min_substeps, max_substeps);
+}
+
+/*
+ * Allocate OT functional for another grid using the model and the parameters of an existing
+ * functional (e.g., after the caller has modified the parameters set by dft_ot_alloc()).
+ * The kernels are computed with these parameters.
+ *
+ * otf          = Functional whose model and parameters are used (dft_ot_functional *; input).
+ * gwf          = Wavefunction to be used with the new functional (wf *; input).
+ * min_substeps = minimum substeps for function smoothing over the grid.
+ * max_substeps = maximum substeps for function smoothing over the grid.
+ *
+ * Return value: pointer to the allocated OT DFT structure.
+ *
+ */
+
+EXPORT dft_ot_functional *dft_ot_alloc_like(dft_ot_functional *otf, wf *gwf, INT min_substeps, INT max_substeps) {
+
+  return dft_ot_alloc_params(otf->model, otf, gwf, min_substeps, max_substeps);
+}
+
+/*
+ * Copy the functional parameters (not the grids) from src to dst.
+ *
+ */
+
+static void dft_ot_copy_params(dft_ot_functional *dst, dft_ot_functional *src) {
+
+  dst->b = src->b;
+  dst->c2 = src->c2;
+  dst->c2_exp = src->c2_exp;
+  dst->c3 = src->c3;
+  dst->c3_exp = src->c3_exp;
+  dst->c4 = src->c4;
+  dst->rho_0s = src->rho_0s;
+  dst->alpha_s = src->alpha_s;
+  dst->l_g = src->l_g;
+  dst->mass = src->mass;
+  dst->rho0 = src->rho0;
+  dst->temp = src->temp;
+  dst->lj_params = src->lj_params;
+  dst->bf_params = src->bf_params;
+  dst->beta = src->beta;
+  dst->rhom = src->rhom;
+  dst->C = src->C;
+  dst->mu0 = src->mu0;
+  dst->xi = src->xi;
+  dst->rhobf = src->rhobf;
+  dst->div_epsilon = src->div_epsilon;
+}
+
+/*
+ * Allocation for dft_ot_alloc() and dft_ot_alloc_like(). params = functional to copy the
+ * parameters from (NULL = defaults for the model).
+ *
+ */
+
+static dft_ot_functional *dft_ot_alloc_params(INT model, dft_ot_functional *params, wf *gwf, INT min_substeps, INT max_substeps) {
+
   REAL radius, inv_width;
   dft_ot_functional *otf;
   REAL x0 = gwf->grid->x0, y0 = gwf->grid->y0, z0 = gwf->grid->z0;
@@ -79,20 +155,29 @@ EXPORT dft_ot_functional *dft_ot_alloc(INT model, wf *gwf, INT min_substeps, INT
   }
 
   otf = (dft_ot_functional *) malloc(sizeof(dft_ot_functional));
-  otf->model = model;
   if (!otf) {
     fprintf(stderr, "libdft: Error in dft_ot_alloc(): Could not allocate memory for dft_ot_functional.\n");
     return NULL;
   }
+  otf->model = model;
+  otf->coarse = NULL;
+  otf->kernels = NULL;
+  otf->lag = NULL;
+  otf->lj_table = NULL;
+  otf->eos = NULL;
+  otf->coupling = NULL;
+  otf->lennard_jones = otf->spherical_avg = otf->backflow_pot = NULL;
+  otf->gaussian_tf = otf->gaussian_x_tf = otf->gaussian_y_tf = otf->gaussian_z_tf = NULL;
  
   fprintf(stderr, "libdft: GIT version ID %s\n", VERSION);
   fprintf(stderr, "libdft: Grid " FMT_I " x " FMT_I " x " FMT_I " with step " FMT_R " Bohr.\n", nx, ny, nz, step);
   fprintf(stderr, "libdft: Functional = " FMT_I ".\n", model);
 
   dft_ot_init_params(otf, model);
+  if(params) dft_ot_copy_params(otf, params);
 
-  /* these grids are not needed for GP */
-  if(!(model & DFT_GP) && !(model & DFT_ZERO) && !(model & DFT_GP2)) {
+  /* these grids are not needed for GP (and may already exist in the registry) */
+  if(!(model & DFT_GP) && !(model & DFT_ZERO) && !(model & DFT_GP2) && !dft_ot_kernels_attach(otf, gwf, min_substeps, max_substeps)) {
     otf->lennard_jones = rgrid_alloc(nx, ny, nz, step, RGRID_PERIODIC_BOUNDARY, 0, "OT Lennard-Jones");
     rgrid_set_origin(otf->lennard_jones, x0, y0, z0);
     otf->spherical_avg = rgrid_alloc(nx, ny, nz, step, RGRID_PERIODIC_BOUNDARY, 0, "OT Sph. average");
@@ -216,8 +301,12 @@ EXPORT dft_ot_functional *dft_ot_alloc(INT model, wf *gwf, INT min_substeps, INT
       rgrid_fft(otf->backflow_pot);
       fprintf(stderr, "Done.\n");
     }
+    dft_ot_kernels_register(otf, gwf, min_substeps, max_substeps);
   }
 
+  otf->gaussian_kmax = otf->backflow_kmax = -1.0;
+  if(!(model & DFT_GP) && !(model & DFT_ZERO) && !(model & DFT_GP2)) dft_ot_bandlimit(otf, DFT_OT_BANDLIMIT_TOL);
+
   /* Allocate workspaces based on the functional */
   otf->density = rgrid_alloc(nx, ny, nz, step, RGRID_PERIODIC_BOUNDARY, 0, "OT Density");
   otf->workspace1 = NULL;
@@ -239,8 +328,8 @@ EXPORT dft_ot_functional *dft_ot_alloc(INT model, wf *gwf, INT min_substeps, INT
   otf->workspace4 = rgrid_alloc(nx, ny, nz, step, RGRID_PERIODIC_BOUNDARY, 0, "OT Workspace 4");
   otf->workspace5 = rgrid_alloc(nx, ny, nz, step, RGRID_PERIODIC_BOUNDARY, 0, "OT Workspace 5");
   otf->workspace6 = rgrid_alloc(nx, ny, nz, step, RGRID_PERIODIC_BOUNDARY, 0, "OT Workspace 6");
-  if(!(model & DFT_OT_BACKFLOW)) return otf;
   otf->workspace7 = rgrid_alloc(nx, ny, nz, step, RGRID_PERIODIC_BOUNDARY, 0, "OT Workspace 7");
+  if(!(model & DFT_OT_BACKFLOW)) return otf;
   otf->workspace8 = rgrid_alloc(nx, ny, nz, step, RGRID_PERIODIC_BOUNDARY, 0, "OT Workspace 8");
   otf->workspace9 = rgrid_alloc(nx, ny, nz, step, RGRID_PERIODIC_BOUNDARY, 0, "OT Workspace 9");
 
@@ -260,13 +349,21 @@ EXPORT dft_ot_functional *dft_ot_alloc(INT model, wf *gwf, INT min_substeps, INT
 EXPORT void dft_ot_free(dft_ot_functional *otf) {
 
   if (otf) {
-    if (otf->lennard_jones) rgrid_free(otf->lennard_jones);
-    if (otf->spherical_avg) rgrid_free(otf->spherical_avg);
-    if (otf->gaussian_tf) rgrid_free(otf->gaussian_tf);
-    if (otf->gaussian_x_tf) rgrid_free(otf->gaussian_x_tf);
-    if (otf->gaussian_y_tf) rgrid_free(otf->gaussian_y_tf);
-    if (otf->gaussian_z_tf) rgrid_free(otf->gaussian_z_tf);
-    if (otf->backflow_pot) rgrid_free(otf->backflow_pot);
+    if (otf->coarse) dft_ot_coarse_free(otf);
+    if (otf->lag) dft_ot_lag_disable(otf);
+    if (otf->lj_table) free(otf->lj_table);
+    if (otf->eos) dft_ot_eos_disable(otf);
+    if (otf->coupling) otf->coupling->otf = NULL;
+    if (otf->kernels) dft_ot_kernels_release(otf->kernels);
+    else {
+      if (otf->lennard_jones) rgrid_free(otf->lennard_jones);
+      if (otf->spherical_avg) rgrid_free(otf->spherical_avg);
+      if (otf->gaussian_tf) rgrid_free(otf->gaussian_tf);
+      if (otf->gaussian_x_tf) rgrid_free(otf->gaussian_x_tf);
+      if (otf->gaussian_y_tf) rgrid_free(otf->gaussian_y_tf);
+      if (otf->gaussian_z_tf) rgrid_free(otf->gaussian_z_tf);
+      if (otf->backflow_pot) rgrid_free(otf->backflow_pot);
+    }
     if (otf->density) rgrid_free(otf->density);
     if (otf->workspace1) rgrid_free(otf->workspace1);
     if (otf->workspace2) rgrid_free(otf->workspace2);
@@ -281,6 +378,395 @@ EXPORT void dft_ot_free(dft_ot_functional *otf) {
   }
 }
 
+/*
+ * Fill in the key (grid and kernel parameters) for the kernel registry.
+ *
+ */
+
+static void dft_ot_kernels_key(dft_ot_functional *otf, wf *gwf, INT min_substeps, INT max_substeps, dft_ot_kernels *key) {
+
+  key->nx = gwf->grid->nx;
+  key->ny = gwf->grid->ny;
+  key->nz = gwf->grid->nz;
+  key->step = gwf->grid->step;
+  key->x0 = gwf->grid->x0;
+  key->y0 = gwf->grid->y0;
+  key->z0 = gwf->grid->z0;
+  key->min_substeps = min_substeps;
+  key->max_substeps = max_substeps;
+  key->flags = otf->model & (DFT_DR | DFT_OT_KC | DFT_OT_BACKFLOW);
+  key->b = otf->b;
+  key->lj_params = otf->lj_params;
+  key->radius = (otf->model & DFT_OT_HD2)?(otf->lj_params.h * 1.065):otf->lj_params.h;
+  key->l_g = (otf->model & DFT_OT_KC)?otf->l_g:0.0;
+  if(otf->model & DFT_OT_BACKFLOW) key->bf_params = otf->bf_params;
+  else key->bf_params.g11 = key->bf_params.g12 = key->bf_params.g21 = key->bf_params.g22 = key->bf_params.a1 = key->bf_params.a2 = 0.0;
+}
+
+/*
+ * Compare two registry keys. Returns 1 if they match, 0 otherwise.
+ *
+ */
+
+static char dft_ot_kernels_match(dft_ot_kernels *a, dft_ot_kernels *b) {
+
+  if(a->nx != b->nx || a->ny != b->ny || a->nz != b->nz) return 0;
+  if(a->step != b->step || a->x0 != b->x0 || a->y0 != b->y0 || a->z0 != b->z0) return 0;
+  if(a->min_substeps != b->min_substeps || a->max_substeps != b->max_substeps || a->flags != b->flags) return 0;
+  if(a->b != b->b || a->radius != b->radius || a->l_g != b->l_g) return 0;
+  if(a->lj_params.h != b->lj_params.h || a->lj_params.sigma != b->lj_params.sigma || a->lj_params.epsilon != b->lj_params.epsilon || a->lj_params.cval != b->lj_params.cval) return 0;
+  if(a->bf_params.g11 != b->bf_params.g11 || a->bf_params.g12 != b->bf_params.g12 || a->bf_params.g21 != b->bf_params.g21
+     || a->bf_params.g22 != b->bf_params.g22 || a->bf_params.a1 != b->bf_params.a1 || a->bf_params.a2 != b->bf_params.a2) return 0;
+  return 1;
+}
+
+/*
+ * Look up kernel set matching otf and gwf from the registry. If found, the kernels
+ * are attached to otf (reference count increased) and 1 is returned. Otherwise returns 0.
+ *
+ */
+
+static char dft_ot_kernels_attach(dft_ot_functional *otf, wf *gwf, INT min_substeps, INT max_substeps) {
+
+  dft_ot_kernels key, *kernels;
+
+  dft_ot_kernels_key(otf, gwf, min_substeps, max_substeps, &key);
+#pragma omp critical (dft_ot_kernels)
+  {
+    for(kernels = dft_ot_kernel_registry; kernels; kernels = kernels->next)
+      if(dft_ot_kernels_match(kernels, &key)) break;
+    if(kernels) kernels->refcount++;
+  }
+  if(!kernels) return 0;
+
+  otf->kernels = kernels;
+  otf->lennard_jones = kernels->lennard_jones;
+  otf->spherical_avg = kernels->spherical_avg;
+  otf->gaussian_tf = kernels->gaussian_tf;
+  otf->gaussian_x_tf = kernels->gaussian_x_tf;
+  otf->gaussian_y_tf = kernels->gaussian_y_tf;
+  otf->gaussian_z_tf = kernels->gaussian_z_tf;
+  otf->backflow_pot = kernels->backflow_pot;
+  fprintf(stderr, "libdft: Using shared kernels (" FMT_I " references).\n", kernels->refcount);
+  return 1;
+}
+
+/*
+ * Add the kernels computed for otf to the registry.
+ *
+ */
+
+static void dft_ot_kernels_register(dft_ot_functional *otf, wf *gwf, INT min_substeps, INT max_substeps) {
+
+  dft_ot_kernels *kernels;
+
+  if(!(kernels = (dft_ot_kernels *) malloc(sizeof(dft_ot_kernels)))) {
+    fprintf(stderr, "libdft: Error in dft_ot_alloc(): Could not allocate memory for kernel registry (kernels not shared).\n");
+    return;
+  }
+  dft_ot_kernels_key(otf, gwf, min_substeps, max_substeps, kernels);
+  kernels->refcount = 1;
+  kernels->lennard_jones = otf->lennard_jones;
+  kernels->spherical_avg = otf->spherical_avg;
+  kernels->gaussian_tf = otf->gaussian_tf;
+  kernels->gaussian_x_tf = otf->gaussian_x_tf;
+  kernels->gaussian_y_tf = otf->gaussian_y_tf;
+  kernels->gaussian_z_tf = otf->gaussian_z_tf;
+  kernels->backflow_pot = otf->backflow_pot;
+  otf->kernels = kernels;
+#pragma omp critical (dft_ot_kernels)
+  {
+    kernels->next = dft_ot_kernel_registry;
+    dft_ot_kernel_registry = kernels;
+  }
+}
+
+/*
+ * Release one reference to a kernel set. The kernels are freed when
+ * the last reference is released.
+ *
+ */
+
+static void dft_ot_kernels_release(dft_ot_kernels *kernels) {
+
+  dft_ot_kernels **prev;
+  char last = 0;
+
+#pragma omp critical (dft_ot_kernels)
+  {
+    if(!--kernels->refcount) {
+      for(prev = &dft_ot_kernel_registry; *prev; prev = &((*prev)->next))
+        if(*prev == kernels) {
+          *prev = kernels->next;
+          break;
+        }
+      last = 1;
+    }
+  }
+  if(!last) return;
+
+  if(kernels->lennard_jones) rgrid_free(kernels->lennard_jones);
+  if(kernels->spherical_avg) rgrid_free(kernels->spherical_avg);
+  if(kernels->gaussian_tf) rgrid_free(kernels->gaussian_tf);
+  if(kernels->gaussian_x_tf) rgrid_free(kernels->gaussian_x_tf);
+  if(kernels->gaussian_y_tf) rgrid_free(kernels->gaussian_y_tf);
+  if(kernels->gaussian_z_tf) rgrid_free(kernels->gaussian_z_tf);
+  if(kernels->backflow_pot) rgrid_free(kernels->backflow_pot);
+  free(kernels);
+}
+
+/*
+ * Set up an evaluation context that refers to the density and workspaces
+ * stored in the functional structure itself (this is what dft_ot_potential() uses).
+ * Nothing is allocated and the context must not be freed.
+ *
+ * otf = OT functional structure (dft_ot_functional *; input).
+ * ctx = Context to be initialized (dft_ot_context *; output).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_context_view(dft_ot_functional *otf, dft_ot_context *ctx) {
+
+  ctx->density = otf->density;
+  ctx->workspace1 = otf->workspace1;
+  ctx->workspace2 = otf->workspace2;
+  ctx->workspace3 = otf->workspace3;
+  ctx->workspace4 = otf->workspace4;
+  ctx->workspace5 = otf->workspace5;
+  ctx->workspace6 = otf->workspace6;
+  ctx->workspace7 = otf->workspace7;
+  ctx->workspace8 = otf->workspace8;
+  ctx->workspace9 = otf->workspace9;
+  ctx->coarse = otf->coarse;
+  ctx->coupling = otf->coupling;
+  ctx->owner = 0;
+}
+
+/*
+ * Clone a grid (NULL if the model grid is NULL).
+ *
+ */
+
+static rgrid *dft_ot_context_grid(rgrid *model, char *id) {
+
+  rgrid *grid;
+
+  if(!model) return NULL;
+  grid = rgrid_clone(model, id);
+  rgrid_fft(grid);            /* create FFT plans now */
+  rgrid_inverse_fft(grid);
+  return grid;
+}
+
+/*
+ * Allocate evaluation context for dft_ot_potential_context(). The context holds
+ * its own density and workspaces, whereas the kernels are shared with otf.
+ *
+ * otf = OT functional structure (dft_ot_functional *; input).
+ *
+ * Returns pointer to the context.
+ *
+ * NOTE: Allocate the contexts before entering a parallel region (FFT plans
+ *       are created here and planning is not thread safe). The contexts must
+ *       be freed before otf.
+ *
+ */
+
+EXPORT dft_ot_context *dft_ot_context_alloc(dft_ot_functional *otf) {
+
+  dft_ot_context *ctx;
+
+  if(!(ctx = (dft_ot_context *) malloc(sizeof(dft_ot_context)))) {
+    fprintf(stderr, "libdft: Error in dft_ot_context_alloc(): Could not allocate memory.\n");
+    return NULL;
+  }
+  ctx->density = dft_ot_context_grid(otf->density, "OT context density");
+  ctx->workspace1 = dft_ot_context_grid(otf->workspace1, "OT context workspace 1");
+  ctx->workspace2 = dft_ot_context_grid(otf->workspace2, "OT context workspace 2");
+  ctx->workspace3 = dft_ot_context_grid(otf->workspace3, "OT context workspace 3");
+  ctx->workspace4 = dft_ot_context_grid(otf->workspace4, "OT context workspace 4");
+  ctx->workspace5 = dft_ot_context_grid(otf->workspace5, "OT context workspace 5");
+  ctx->workspace6 = dft_ot_context_grid(otf->workspace6, "OT context workspace 6");
+  ctx->workspace7 = dft_ot_context_grid(otf->workspace7, "OT context workspace 7");
+  ctx->workspace8 = dft_ot_context_grid(otf->workspace8, "OT context workspace 8");
+  ctx->workspace9 = dft_ot_context_grid(otf->workspace9, "OT context workspace 9");
+  ctx->coarse = otf->coarse?dft_ot_coarse_clone(otf->coarse):NULL;
+  ctx->coupling = NULL;
+  ctx->owner = 1;
+
+  return ctx;
+}
+
+/*
+ * Free evaluation context.
+ *
+ * ctx = Context to be freed (dft_ot_context *; input). Allocated by dft_ot_context_alloc().
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_context_free(dft_ot_context *ctx) {
+
+  if(!ctx || !ctx->owner) return;
+  if(ctx->density) rgrid_free(ctx->density);
+  if(ctx->workspace1) rgrid_free(ctx->workspace1);
+  if(ctx->workspace2) rgrid_free(ctx->workspace2);
+  if(ctx->workspace3) rgrid_free(ctx->workspace3);
+  if(ctx->workspace4) rgrid_free(ctx->workspace4);
+  if(ctx->workspace5) rgrid_free(ctx->workspace5);
+  if(ctx->workspace6) rgrid_free(ctx->workspace6);
+  if(ctx->workspace7) rgrid_free(ctx->workspace7);
+  if(ctx->workspace8) rgrid_free(ctx->workspace8);
+  if(ctx->workspace9) rgrid_free(ctx->workspace9);
+  if(ctx->coarse) dft_ot_coarse_clone_free(ctx->coarse);
+  free(ctx);
+}
+
+/*
+ * Determine the effective support of the KC (gaussian) and BF kernels in
+ * k-space. Components of the kernels outside the support are skipped in the
+ * convolutions (see dft_common_bandlimit_convolute()). This is called
+ * by dft_ot_alloc() with tolerance DFT_OT_BANDLIMIT_TOL.
+ *
+ * otf = OT functional structure (dft_ot_functional *; input/output).
+ * tol = Relative tolerance for the kernel magnitude (REAL; input).
+ *       Zero disables the band limit (full convolutions).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_bandlimit(dft_ot_functional *otf, REAL tol) {
+
+  REAL kmax;
+
+  otf->gaussian_kmax = otf->backflow_kmax = -1.0;
+  if(otf->model & DFT_OT_KC) {
+    otf->gaussian_kmax = dft_common_kernel_support(otf->gaussian_tf, tol);
+    if(otf->gaussian_kmax >= 0.0 && otf->gaussian_x_tf) {
+      kmax = dft_common_kernel_support(otf->gaussian_x_tf, tol);
+      if(kmax < 0.0 || kmax > otf->gaussian_kmax) otf->gaussian_kmax = kmax;
+    }
+    if(otf->gaussian_kmax >= 0.0 && otf->gaussian_y_tf) {
+      kmax = dft_common_kernel_support(otf->gaussian_y_tf, tol);
+      if(kmax < 0.0 || kmax > otf->gaussian_kmax) otf->gaussian_kmax = kmax;
+    }
+    if(otf->gaussian_kmax >= 0.0) {
+      kmax = dft_common_kernel_support(otf->gaussian_z_tf, tol);
+      if(kmax < 0.0 || kmax > otf->gaussian_kmax) otf->gaussian_kmax = kmax;
+    }
+    if(otf->gaussian_kmax >= 0.0)
+      fprintf(stderr, "libdft: KC kernel band limit = " FMT_R " Bohr^-1.\n", otf->gaussian_kmax);
+  }
+  if(otf->model & DFT_OT_BACKFLOW) {
+    otf->backflow_kmax = dft_common_kernel_support(otf->backflow_pot, tol);
+    if(otf->backflow_kmax >= 0.0)
+      fprintf(stderr, "libdft: BF kernel band limit = " FMT_R " Bohr^-1.\n", otf->backflow_kmax);
+  }
+}
+
+/*
+ * Enable lagged refresh of the expensive non-local terms (KC and/or backflow). The selected
+ * terms are cached by dft_ot_potential() and recomputed only every interval calls or when
+ * the relative change of the density since the last refresh exceeds threshold.
+ * The energy routines (dft_ot_energy_density()) always use the exact terms.
+ *
+ * Only dft_ot_potential() (i.e., the default context of otf) uses the cache; private
+ * contexts (dft_ot_context_alloc()) always evaluate all terms. Backflow evaluated on
+ * the coarse grid is not lagged.
+ *
+ * otf       = OT functional structure (input/output; dft_ot_functional *).
+ * gwf       = Wave function defining the grid (input; wf *).
+ * terms     = Terms to lag: DFT_OT_LAG_KC, DFT_OT_LAG_BF or both (input; char).
+ * interval  = Maximum number of calls between refreshes (input; INT).
+ * threshold = Refresh when || rho - rho_lag || / || rho_lag || exceeds this (input; REAL).
+ *             Set to <= 0 to use only the interval.
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_lag_enable(dft_ot_functional *otf, wf *gwf, char terms, INT interval, REAL threshold) {
+
+  dft_ot_lag *lag;
+
+  if(!otf->lag) {
+    if(!(lag = (dft_ot_lag *) malloc(sizeof(dft_ot_lag)))) {
+      fprintf(stderr, "libdft: Error in dft_ot_lag_enable(): Could not allocate memory.\n");
+      exit(1);
+    }
+    lag->potential = cgrid_clone(gwf->grid, "OT lag potential");
+    lag->density = rgrid_clone(otf->density, "OT lag density");
+    otf->lag = lag;
+  } else lag = otf->lag;
+  if(interval < 1) interval = 1;
+  lag->terms = terms;
+  lag->interval = interval;
+  lag->threshold = threshold;
+  lag->count = 0;
+  lag->refresh = 1;
+}
+
+/*
+ * Disable lagged refresh of the non-local terms (see dft_ot_lag_enable()).
+ *
+ * otf = OT functional structure (input/output; dft_ot_functional *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_lag_disable(dft_ot_functional *otf) {
+
+  if(!otf->lag) return;
+  cgrid_free(otf->lag->potential);
+  rgrid_free(otf->lag->density);
+  free(otf->lag);
+  otf->lag = NULL;
+}
+
+/*
+ * Force refresh of the lagged terms at the next call to dft_ot_potential().
+ *
+ * otf = OT functional structure (input/output; dft_ot_functional *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_lag_refresh(dft_ot_functional *otf) {
+
+  if(otf->lag) otf->lag->refresh = 1;
+}
+
+/*
+ * Decide whether the lagged terms must be refreshed. If so, the cache is cleared and
+ * the current density is stored. Returns 1 for refresh and 0 for using the cache.
+ *
+ */
+
+static char dft_ot_lag_update(dft_ot_lag *lag, rgrid *density, rgrid *workspace) {
+
+  char refresh = lag->refresh || lag->count >= lag->interval;
+
+  if(!refresh && lag->threshold > 0.0) {
+    rgrid_claim(workspace);
+    rgrid_difference(workspace, density, lag->density);
+    refresh = rgrid_integral_of_square(workspace) > lag->threshold * lag->threshold * rgrid_integral_of_square(lag->density);
+    rgrid_release(workspace);
+  }
+  lag->count++;
+  if(!refresh) return 0;
+  cgrid_zero(lag->potential);
+  rgrid_copy(lag->density, density);
+  lag->count = 1;
+  lag->refresh = 0;
+  return 1;
+}
+
 /*
  * Calculate the non-linear potential grid.
  *
@@ -298,29 +784,52 @@ EXPORT void dft_ot_free(dft_ot_functional *otf) {
  * workspace3 = Workspace grid. Basic OT access up to this point.
  * workspace4 = Workspace grid.
  * workspace5 = Workspace grid.
- * workspace6 = Workspace grid. KC access up to this point.
- * workspace7 = Workspace grid. 
+ * workspace6 = Workspace grid.
+ * workspace7 = Workspace grid. KC access up to this point.
  * workspace8 = Workspace grid. 
  * workspace9 = Workspace grid. BF access up to this point.
  *
+ * To evaluate several potentials concurrently with the same otf, use
+ * dft_ot_potential_context() with separate evaluation contexts.
+ *
  */
 
 EXPORT void dft_ot_potential(dft_ot_functional *otf, cgrid *potential, wf *wf) {
 
-  rgrid *workspace1, *workspace2, *workspace3, *workspace4, *workspace5, *workspace6, *workspace7, *workspace8, *workspace9;
+  dft_ot_context ctx;
+
+  dft_ot_context_view(otf, &ctx);
+  dft_ot_potential_context(otf, &ctx, potential, wf);
+}
+
+/*
+ * Calculate the non-linear potential grid using a given evaluation context.
+ * The functional (otf) is only read, so several threads may call this
+ * simultaneously with the same otf as long as each uses its own context.
+ *
+ * otf        = OT functional structure (input; dft_ot_functional *).
+ * ctx        = Evaluation context holding the density and workspaces (input/output; dft_ot_context *).
+ *              Allocated by dft_ot_context_alloc().
+ * potential  = Potential grid where the result will be stored (output; cgrid *).
+ *              NOTE: the potential will be added to this (may want to zero it first)
+ * wf         = Wavefunction (input; wf *).
+ *
+ * No return value.
+ *
+ * The workspace usage in ctx is the same as for dft_ot_potential().
+ *
+ */
+
+EXPORT void dft_ot_potential_context(dft_ot_functional *otf, dft_ot_context *ctx, cgrid *potential, wf *wf) {
+
+  rgrid *workspace1, *workspace2, *workspace3;
   rgrid *density;
 
-  density = otf->density;
+  density = ctx->density;
   grid_wf_density(wf, density);
-  workspace1 = otf->workspace1;
-  workspace2 = otf->workspace2;
-  workspace3 = otf->workspace3;
-  workspace4 = otf->workspace4;
-  workspace5 = otf->workspace5;
-  workspace6 = otf->workspace6;
-  workspace7 = otf->workspace7;
-  workspace8 = otf->workspace8;
-  workspace9 = otf->workspace9;
+  workspace1 = ctx->workspace1;
+  workspace2 = ctx->workspace2;
+  workspace3 = ctx->workspace3;
 
   if(otf->model & DFT_ZERO) {
     fprintf(stderr, "libdft: Warning - zero potential used.\n");
@@ -342,9 +851,21 @@ EXPORT void dft_ot_potential(dft_ot_functional *otf, cgrid *potential, wf *wf) {
   /* workspace1 = FFT of density */
   rgrid_claim(workspace1);
   rgrid_claim(workspace2);
-  dft_ot_add_lennard_jones_potential(otf, potential, density, workspace1 /* rho_tf */, workspace2);
+  if(ctx->coarse && (ctx->coarse->terms & DFT_OT_COARSE_LJ)) {
+    rgrid_copy(workspace1, density);
+    rgrid_fft(workspace1);
+    dft_ot_coarse_lennard_jones_potential(ctx->coarse, workspace1 /* rho_tf */);
+  } else
+    dft_ot_add_lennard_jones_potential(otf, potential, density, workspace1 /* rho_tf */, workspace2);
   rgrid_release(workspace2);
 
+  /* Pass FFT(rho) to the coupling object (saves one FFT in dft_coupling_potential()) */
+  if(ctx->coupling) {
+    rgrid_copy(ctx->coupling->rho_tf, workspace1);
+    rgrid_fft_space(ctx->coupling->rho_tf, 1);
+    ctx->coupling->valid = 1;
+  }
+
   /* Non-linear local correlation */
   /* note workspace1 = fft of \rho */
   rgrid_claim(workspace2);
@@ -353,13 +874,41 @@ EXPORT void dft_ot_potential(dft_ot_functional *otf, cgrid *potential, wf *wf) {
   rgrid_release(workspace2);
   rgrid_release(workspace3);
 
+  dft_ot_potential_rest(otf, ctx, potential, wf);
+}
+
+/*
+ * Potential terms following the local correlation (KC, HD, BF, thermal and
+ * coarse grid contributions). On entry ctx->workspace1 holds FFT(rho) and is
+ * claimed; it is released here.
+ *
+ */
+
+static void dft_ot_potential_rest(dft_ot_functional *otf, dft_ot_context *ctx, cgrid *potential, wf *wf) {
+
+  rgrid *workspace1 = ctx->workspace1, *workspace2 = ctx->workspace2, *workspace3 = ctx->workspace3, *workspace4 = ctx->workspace4;
+  rgrid *workspace5 = ctx->workspace5, *workspace6 = ctx->workspace6, *workspace7 = ctx->workspace7;
+  rgrid *density = ctx->density;
+  cgrid *lag_pot = NULL;
+  char lag_kc = 0, lag_bf = 0, cached = 0;
+
+  /* Lagged terms: refresh into the cache or use the cached values */
+  if(otf->lag && !ctx->owner) {
+    lag_kc = (otf->lag->terms & DFT_OT_LAG_KC) && (otf->model & DFT_OT_KC);
+    lag_bf = (otf->lag->terms & DFT_OT_LAG_BF) && (otf->model & DFT_OT_BACKFLOW) && !(ctx->coarse && (ctx->coarse->terms & DFT_OT_COARSE_BF));
+    if(lag_kc || lag_bf) {
+      lag_pot = otf->lag->potential;
+      cached = !dft_ot_lag_update(otf->lag, density, workspace2);
+    }
+  }
+
   /* Non-local correlation for kinetic energy (workspace1 = FFT(rho)) */
-  if(otf->model & DFT_OT_KC) {
+  if((otf->model & DFT_OT_KC) && !(lag_kc && cached)) {
     rgrid_claim(workspace2); rgrid_claim(workspace3); rgrid_claim(workspace4);
-    rgrid_claim(workspace5); rgrid_claim(workspace6);
-    dft_ot_add_nonlocal_correlation_potential(otf, potential, density, workspace1 /* rho_tf */, workspace2, workspace3, workspace4, workspace5, workspace6);
+    rgrid_claim(workspace5); rgrid_claim(workspace6); rgrid_claim(workspace7);
+    dft_ot_add_nonlocal_correlation_potential(otf, lag_kc?lag_pot:potential, density, workspace1 /* rho_tf */, workspace2, workspace3, workspace4, workspace5, workspace6, workspace7);
     rgrid_release(workspace2); rgrid_release(workspace3); rgrid_release(workspace4);
-    rgrid_release(workspace5); rgrid_release(workspace6);
+    rgrid_release(workspace5); rgrid_release(workspace6); rgrid_release(workspace7);
   }
   /* workspace1 no longer needed */
   rgrid_release(workspace1);
@@ -371,26 +920,11 @@ EXPORT void dft_ot_potential(dft_ot_functional *otf, cgrid *potential, wf *wf) {
     rgrid_release(workspace1);
   }
 
-  if(otf->model & DFT_OT_BACKFLOW) {
-    /* wf, veloc_x(1), veloc_y(2), veloc_z(3), wrk(4) */
-    rgrid_claim(workspace1); rgrid_claim(workspace2); rgrid_claim(workspace3);
-    rgrid_claim(workspace4); rgrid_claim(workspace5); rgrid_claim(workspace6);
-    rgrid_claim(workspace7); rgrid_claim(workspace8); rgrid_claim(workspace9);
-#ifdef DFT_OT_1D
-    if(density->nx == 1 && density->ny == 1) 
-      grid_wf_velocity_z(wf, workspace3, DFT_EPS);
+  if((otf->model & DFT_OT_BACKFLOW) && !(lag_bf && cached)) {
+    if(ctx->coarse && (ctx->coarse->terms & DFT_OT_COARSE_BF))
+      dft_ot_coarse_backflow_potential(ctx->coarse, wf);
     else
-#endif
-      grid_wf_velocity(wf, workspace1, workspace2, workspace3, DFT_EPS);
-#ifdef DFT_MAX_VELOC
-    rgrid_threshold_clear(workspace1, workspace1, DFT_MAX_VELOC, -DFT_MAX_VELOC, DFT_MAX_VELOC, -DFT_MAX_VELOC);
-    rgrid_threshold_clear(workspace2, workspace2, DFT_MAX_VELOC, -DFT_MAX_VELOC, DFT_MAX_VELOC, -DFT_MAX_VELOC);
-    rgrid_threshold_clear(workspace3, workspace3, DFT_MAX_VELOC, -DFT_MAX_VELOC, DFT_MAX_VELOC, -DFT_MAX_VELOC);
-#endif
-    dft_ot_backflow_potential(otf, potential, density, workspace1 /* veloc_x */, workspace2 /* veloc_y */, workspace3 /* veloc_z */, workspace4, workspace5, workspace6, workspace7, workspace8, workspace9);
-    rgrid_release(workspace1); rgrid_release(workspace2); rgrid_release(workspace3);
-    rgrid_release(workspace4); rgrid_release(workspace5); rgrid_release(workspace6);
-    rgrid_release(workspace7); rgrid_release(workspace8); rgrid_release(workspace9);
+      dft_ot_add_backflow(otf, ctx, lag_bf?lag_pot:potential, wf);
   }
 
   if(otf->model >= DFT_OT_T400MK && !(otf->model & DFT_DR)) {
@@ -399,6 +933,103 @@ EXPORT void dft_ot_potential(dft_ot_functional *otf, cgrid *potential, wf *wf) {
     dft_ot_add_ancilotto(otf, potential, density, workspace1);
     rgrid_release(workspace1);
   }
+
+  if(lag_pot) cgrid_sum(potential, potential, lag_pot);
+
+  /* Bring the coarse grid contributions to the fine grid */
+  if(ctx->coarse) {
+    rgrid_claim(workspace1);
+    dft_ot_coarse_add_potential(ctx->coarse, potential, workspace1);
+    rgrid_release(workspace1);
+  }
+}
+
+/*
+ * Calculate the non-linear potentials for a batch of wave functions (e.g., ensemble of small grids).
+ * The convolutions with the LJ and spherical average kernels are done for the whole batch at once
+ * (each kernel is read once per batch) and the remaining per wave function operations run
+ * in parallel over the batch members.
+ *
+ * otf        = OT functional structure (input; dft_ot_functional *).
+ * ctx        = Array of evaluation contexts, one for each wave function (input/output; dft_ot_context **).
+ *              Allocate with dft_ot_context_alloc().
+ * potential  = Array of potential grids (output; cgrid **).
+ *              NOTE: the potentials will be added to these (may want to zero them first)
+ * wf         = Array of wavefunctions (input; wf **).
+ * n          = Number of wave functions in the batch (input; INT).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_potential_batch(dft_ot_functional *otf, dft_ot_context **ctx, cgrid **potential, wf **wf, INT n) {
+
+  INT i;
+  rgrid **rho_tf, **wrk;
+
+  if(n < 1) return;
+  if((otf->model & DFT_ZERO) || (otf->model & DFT_GP) || (otf->model & DFT_GP2)) {
+#pragma omp parallel for firstprivate(otf,ctx,potential,wf,n) private(i) default(none) schedule(dynamic)
+    for(i = 0; i < n; i++)
+      dft_ot_potential_context(otf, ctx[i], potential[i], wf[i]);
+    return;
+  }
+
+  if(!(rho_tf = (rgrid **) malloc(sizeof(rgrid *) * (size_t) n)) || !(wrk = (rgrid **) malloc(sizeof(rgrid *) * (size_t) n))) {
+    fprintf(stderr, "libdft: Error in dft_ot_potential_batch(): Could not allocate memory.\n");
+    exit(1);
+  }
+
+  /* workspace1 = FFT of density */
+#pragma omp parallel for firstprivate(ctx,wf,n,rho_tf,wrk) private(i) default(none) schedule(dynamic)
+  for(i = 0; i < n; i++) {
+    grid_wf_density(wf[i], ctx[i]->density);
+    rgrid_claim(ctx[i]->workspace1);
+    rgrid_claim(ctx[i]->workspace2);
+    rgrid_claim(ctx[i]->workspace3);
+    rgrid_copy(ctx[i]->workspace1, ctx[i]->density);
+    rgrid_fft(ctx[i]->workspace1);
+    rho_tf[i] = ctx[i]->workspace1;
+    wrk[i] = ctx[i]->workspace2;
+  }
+
+  /* Lennard-Jones */
+  if(ctx[0]->coarse && (ctx[0]->coarse->terms & DFT_OT_COARSE_LJ)) {
+#pragma omp parallel for firstprivate(ctx,n) private(i) default(none) schedule(dynamic)
+    for(i = 0; i < n; i++)
+      dft_ot_coarse_lennard_jones_potential(ctx[i]->coarse, ctx[i]->workspace1);
+  } else {
+    dft_common_convolute_batch(wrk, rho_tf, otf->lennard_jones, n);
+#pragma omp parallel for firstprivate(ctx,potential,n) private(i) default(none) schedule(dynamic)
+    for(i = 0; i < n; i++) {
+      rgrid_inverse_fft_norm2(ctx[i]->workspace2);
+      grid_add_real_to_complex_re(potential[i], ctx[i]->workspace2);
+    }
+  }
+
+  /* Local correlation: workspace2 = \bar{\rho}, workspace3 = function to be convoluted */
+  dft_common_convolute_batch(wrk, rho_tf, otf->spherical_avg, n);
+#pragma omp parallel for firstprivate(otf,ctx,potential,n,wrk) private(i) default(none) schedule(dynamic)
+  for(i = 0; i < n; i++) {
+    rgrid_inverse_fft_norm2(ctx[i]->workspace2);
+    dft_ot_add_local_correlation_direct(otf, potential[i], ctx[i]->density, ctx[i]->workspace2, ctx[i]->workspace3);
+    rgrid_fft(ctx[i]->workspace3);
+    wrk[i] = ctx[i]->workspace3;
+  }
+  dft_common_convolute_batch(wrk, wrk, otf->spherical_avg, n);
+
+  /* Remaining terms */
+#pragma omp parallel for firstprivate(otf,ctx,potential,wf,n) private(i) default(none) schedule(dynamic)
+  for(i = 0; i < n; i++) {
+    rgrid_inverse_fft_norm2(ctx[i]->workspace3);
+    grid_add_real_to_complex_re(potential[i], ctx[i]->workspace3);
+    rgrid_release(ctx[i]->workspace2);
+    rgrid_release(ctx[i]->workspace3);
+    dft_ot_potential_rest(otf, ctx[i], potential[i], wf[i]);
+  }
+
+  free(rho_tf);
+  free(wrk);
 }
 
 /*
@@ -416,17 +1047,75 @@ EXPORT inline void dft_ot_add_lennard_jones_potential(dft_ot_functional *otf, cg
   /* leave FFT(rho) in workspace1 (used later in local correlation potential as rho_tf) */
 }
 
+/*
+ * Backflow potential (computes the velocity field and calls dft_ot_backflow_potential()).
+ *
+ * otf       = OT functional structure (dft_ot_functional *; input).
+ * ctx       = Evaluation context (dft_ot_context *; input). ctx->density must hold
+ *             the density corresponding to wf. Uses workspaces 1 - 9.
+ * potential = Potential grid where the result is added (cgrid *; output).
+ * wf        = Wave function (wf *; input).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_ot_add_backflow(dft_ot_functional *otf, dft_ot_context *ctx, cgrid *potential, wf *wf) {
+
+  rgrid *workspace1 = ctx->workspace1, *workspace2 = ctx->workspace2, *workspace3 = ctx->workspace3;
+  rgrid *workspace4 = ctx->workspace4, *workspace5 = ctx->workspace5, *workspace6 = ctx->workspace6;
+  rgrid *workspace7 = ctx->workspace7, *workspace8 = ctx->workspace8, *workspace9 = ctx->workspace9;
+  rgrid *density = ctx->density;
+
+  /* wf, veloc_x(1), veloc_y(2), veloc_z(3), wrk(4) */
+  rgrid_claim(workspace1); rgrid_claim(workspace2); rgrid_claim(workspace3);
+  rgrid_claim(workspace4); rgrid_claim(workspace5); rgrid_claim(workspace6);
+  rgrid_claim(workspace7); rgrid_claim(workspace8); rgrid_claim(workspace9);
+#ifdef DFT_OT_1D
+  if(density->nx == 1 && density->ny == 1) 
+    grid_wf_velocity_z(wf, workspace3, DFT_EPS);
+  else
+#endif
+    grid_wf_velocity(wf, workspace1, workspace2, workspace3, DFT_EPS);
+#ifdef DFT_MAX_VELOC
+  rgrid_threshold_clear(workspace1, workspace1, DFT_MAX_VELOC, -DFT_MAX_VELOC, DFT_MAX_VELOC, -DFT_MAX_VELOC);
+  rgrid_threshold_clear(workspace2, workspace2, DFT_MAX_VELOC, -DFT_MAX_VELOC, DFT_MAX_VELOC, -DFT_MAX_VELOC);
+  rgrid_threshold_clear(workspace3, workspace3, DFT_MAX_VELOC, -DFT_MAX_VELOC, DFT_MAX_VELOC, -DFT_MAX_VELOC);
+#endif
+  dft_ot_backflow_potential(otf, potential, density, workspace1 /* veloc_x */, workspace2 /* veloc_y */, workspace3 /* veloc_z */, workspace4, workspace5, workspace6, workspace7, workspace8, workspace9);
+  rgrid_release(workspace1); rgrid_release(workspace2); rgrid_release(workspace3);
+  rgrid_release(workspace4); rgrid_release(workspace5); rgrid_release(workspace6);
+  rgrid_release(workspace7); rgrid_release(workspace8); rgrid_release(workspace9);
+}
+
 /*
  * Local correlation potential.
  *
  */
 
-EXPORT inline void dft_ot_add_local_correlation_potential(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *workspace1, rgrid *workspace2) {
+EXPORT void dft_ot_add_local_correlation_potential(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *workspace1, rgrid *workspace2) {
 
   /* workspace1 = \bar{\rho} */
   rgrid_fft_convolute(workspace1, rho_tf, otf->spherical_avg);
   rgrid_inverse_fft_norm2(workspace1); 
 
+  dft_ot_add_local_correlation_direct(otf, potential, rho, workspace1, workspace2);
+
+  rgrid_fft(workspace2);
+  rgrid_fft_convolute(workspace2, workspace2, otf->spherical_avg);
+  rgrid_inverse_fft_norm2(workspace2);
+  grid_add_real_to_complex_re(potential, workspace2);
+}
+
+/*
+ * Local correlation potential terms that do not involve the second convolution.
+ * On exit, workspace2 holds the function that must still be convoluted with
+ * the spherical average and added to the potential (workspace1 is overwritten).
+ *
+ */
+
+static inline void dft_ot_add_local_correlation_direct(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *workspace1, rgrid *workspace2) {
+
   /* C2.1 */
   if(otf->model & DFT_DR)
     rgrid_power(workspace2, workspace1, otf->c2_exp);
@@ -456,38 +1145,63 @@ EXPORT inline void dft_ot_add_local_correlation_potential(dft_ot_functional *otf
   rgrid_sum(workspace2, workspace2, workspace1);
 
   rgrid_product(workspace2, workspace2, rho);
-  rgrid_fft(workspace2);
-  rgrid_fft_convolute(workspace2, workspace2, otf->spherical_avg);
-  rgrid_inverse_fft_norm2(workspace2);
-  grid_add_real_to_complex_re(potential, workspace2);
 }
 
 /* 
  * Nonlocal correlation potential.
  *
+ * The first and second terms are summed over the Cartesian components before
+ * the (common) inverse transforms:
+ *
+ * sum_i c rho_st IFFT[(d/dx_i)F . G_i] and sum_i c F * ((d/dx_i)rho J_i)
+ *
  */
 
-static inline void dft_ot_add_nonlocal_correlation_potential(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3, rgrid *workspace4, rgrid *workspace5) {
+static inline void dft_ot_add_nonlocal_correlation_potential(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3, rgrid *workspace4, rgrid *workspace5, rgrid *workspace6) {
+
+  REAL c = otf->alpha_s / (2.0 * otf->mass);
 
   /* rho^tilde(r) = int F(r-r') rho(r') dr' */
   /* NOTE: rho_tf from LJ (workspace1 there). */
-  rgrid_fft_convolute(workspace1, otf->gaussian_tf, rho_tf);
+  dft_common_bandlimit_convolute(workspace1, rho_tf, otf->gaussian_tf, otf->gaussian_kmax);
   rgrid_inverse_fft_norm2(workspace1);
   /* workspace1 = rho_st = 1 - 1/\tilde{\rho}/\rho_{0s} */
   rgrid_multiply(workspace1, -1.0 / otf->rho_0s);
   rgrid_add(workspace1, 1.0);
 
-  if(rho->nx > 1) dft_ot_add_nonlocal_correlation_potential_x(otf, potential, rho, rho_tf, workspace1 /* rho_st */, workspace2, workspace3, workspace4, workspace5);
-  if(rho->ny > 1) dft_ot_add_nonlocal_correlation_potential_y(otf, potential, rho, rho_tf, workspace1 /* rho_st */, workspace2, workspace3, workspace4, workspace5);
-  dft_ot_add_nonlocal_correlation_potential_z(otf, potential, rho, rho_tf, workspace1 /* rho_st */, workspace2, workspace3, workspace4, workspace5);
+  /* workspace5 = sum of 1st terms (Fourier space), workspace6 = sum of H (real space) */
+  rgrid_zero(workspace5);
+  rgrid_fft_space(workspace5, 1);
+  rgrid_zero(workspace6);
+
+  if(rho->nx > 1) dft_ot_add_nonlocal_correlation_potential_x(otf, rho, rho_tf, workspace1 /* rho_st */, workspace5, workspace6, potential, workspace2, workspace3, workspace4);
+  if(rho->ny > 1) dft_ot_add_nonlocal_correlation_potential_y(otf, rho, rho_tf, workspace1 /* rho_st */, workspace5, workspace6, potential, workspace2, workspace3, workspace4);
+  dft_ot_add_nonlocal_correlation_potential_z(otf, rho, rho_tf, workspace1 /* rho_st */, workspace5, workspace6, potential, workspace2, workspace3, workspace4);
+
+  /*** 1st term: c rho_st sum_i convolute [((d/dx_i) F) . G_i] ***/
+  rgrid_inverse_fft_norm2(workspace5);
+  rgrid_product(workspace5, workspace5, workspace1);
+
+  /*** 2nd term: c convolute(F H), H = sum_i (d/dx_i) rho J_i ***/
+  rgrid_fft(workspace6);
+  dft_common_bandlimit_convolute(workspace6, workspace6, otf->gaussian_tf, otf->gaussian_kmax);
+  rgrid_inverse_fft_norm2(workspace6);
+
+  rgrid_sum(workspace5, workspace5, workspace6);
+  rgrid_multiply(workspace5, c);
+  grid_add_real_to_complex_re(potential, workspace5);
 }
 
 /*
  * X component to nonlocal correlation potential.
  *
+ * acc_fg = Sum of ((d/dx)F) . G (1st term) accumulated here (Fourier space).
+ * acc_h  = Sum of H = (d/dx) \rho * J (2nd term) accumulated here (real space).
+ * The 3rd term is added directly to potential.
+ *
  */
 
-static inline void dft_ot_add_nonlocal_correlation_potential_x(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3, rgrid *workspace4) {
+static inline void dft_ot_add_nonlocal_correlation_potential_x(dft_ot_functional *otf, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *acc_fg, rgrid *acc_h, cgrid *potential, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3) {
 
   REAL c;
 
@@ -503,38 +1217,27 @@ static inline void dft_ot_add_nonlocal_correlation_potential_x(dft_ot_functional
   rgrid_product(workspace2, workspace1, rho_st); // rho_st = (1 - \tilde{\rho(r_1)} / \rho_{0s})
   rgrid_fft(workspace2);
 
-  /* 1st term: c convolute [((d/dx) F) . G] */
-  rgrid_fft_convolute(workspace3, otf->gaussian_x_tf, workspace2);
-  rgrid_inverse_fft_norm2(workspace3);
-  rgrid_product(workspace3, workspace3, rho_st);
-  rgrid_multiply(workspace3, c);
-  grid_add_real_to_complex_re(potential, workspace3);  
+  /* 1st term: accumulate [((d/dx) F) . G] */
+  dft_common_bandlimit_convolute(workspace3, workspace2, otf->gaussian_x_tf, otf->gaussian_kmax);
+  rgrid_fft_sum(acc_fg, acc_fg, workspace3);
 
   /* in use: workspace1 (grad rho), workspace2 (FFT(G)) */
 
   /*** 2nd term ***/
   
   /* Construct workspace3 = J = convolution(F G) */
-  rgrid_fft_convolute(workspace3, otf->gaussian_tf, workspace2);
+  dft_common_bandlimit_convolute(workspace3, workspace2, otf->gaussian_tf, otf->gaussian_kmax);
   rgrid_inverse_fft_norm2(workspace3);
 
-  /* Construct workspace4 = FFT(H) = FFT((d/dx) \rho * J) */
-  rgrid_copy(workspace4, workspace3);
-  rgrid_product(workspace4, workspace1, workspace4);
-  rgrid_fft(workspace4);
-
-  /* 2nd term: c convolute(F H) */
-  rgrid_fft_convolute(workspace4, otf->gaussian_tf, workspace4);
-  rgrid_inverse_fft_norm2(workspace4);
-  rgrid_multiply(workspace4, c);
-  grid_add_real_to_complex_re(potential, workspace4);
+  /* Accumulate H = (d/dx) \rho * J */
+  rgrid_add_scaled_product(acc_h, 1.0, workspace1, workspace3);
 
-  /* workspace1 (grad rho), workspace3 (J) */
+  /* workspace3 (J) */
 
   /*** 3rd term ***/
   
   /* -c J . convolute((d/dx)F \rho) */
-  rgrid_fft_convolute(workspace2, otf->gaussian_x_tf, rho_tf);
+  dft_common_bandlimit_convolute(workspace2, rho_tf, otf->gaussian_x_tf, otf->gaussian_kmax);
   rgrid_inverse_fft_norm2(workspace2);
   rgrid_product(workspace2, workspace2, workspace3);
   rgrid_multiply(workspace2, -c);
@@ -544,9 +1247,13 @@ static inline void dft_ot_add_nonlocal_correlation_potential_x(dft_ot_functional
 /*
  * Y component to nonlocal correlation potential.
  *
+ * acc_fg = Sum of ((d/dy)F) . G (1st term) accumulated here (Fourier space).
+ * acc_h  = Sum of H = (d/dy) \rho * J (2nd term) accumulated here (real space).
+ * The 3rd term is added directly to potential.
+ *
  */
 
-static inline void dft_ot_add_nonlocal_correlation_potential_y(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3, rgrid *workspace4) {
+static inline void dft_ot_add_nonlocal_correlation_potential_y(dft_ot_functional *otf, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *acc_fg, rgrid *acc_h, cgrid *potential, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3) {
 
   REAL c;
 
@@ -559,42 +1266,30 @@ static inline void dft_ot_add_nonlocal_correlation_potential_y(dft_ot_functional
   /*** 1st term ***/
 
   /* Construct workspace2 = FFT(G) = FFT((d/dy) \rho(r_1) * (1 - \tilde{\rho(r_1)} / \rho_{0s})) */
-  rgrid_product(workspace2, workspace1, rho_st);
+  rgrid_product(workspace2, workspace1, rho_st); // rho_st = (1 - \tilde{\rho(r_1)} / \rho_{0s})
   rgrid_fft(workspace2);
 
-  /* 1st term: c convolute [((d/dy) F) . G] */
-  rgrid_fft_convolute(workspace3, otf->gaussian_y_tf, workspace2);
-  rgrid_inverse_fft_norm2(workspace3);
-  rgrid_product(workspace3, workspace3, rho_st);
-  rgrid_multiply(workspace3, c);
-  grid_add_real_to_complex_re(potential, workspace3);  
+  /* 1st term: accumulate [((d/dy) F) . G] */
+  dft_common_bandlimit_convolute(workspace3, workspace2, otf->gaussian_y_tf, otf->gaussian_kmax);
+  rgrid_fft_sum(acc_fg, acc_fg, workspace3);
 
   /* in use: workspace1 (grad rho), workspace2 (FFT(G)) */
 
   /*** 2nd term ***/
   
   /* Construct workspace3 = J = convolution(F G) */
-  rgrid_fft_convolute(workspace3, otf->gaussian_tf, workspace2);
+  dft_common_bandlimit_convolute(workspace3, workspace2, otf->gaussian_tf, otf->gaussian_kmax);
   rgrid_inverse_fft_norm2(workspace3);
 
-  /* Construct workspace4 = FFT(H) = FFT((d/dy) \rho * J) */
-  rgrid_copy(workspace4, workspace3);
-  rgrid_product(workspace4, workspace1, workspace4);
-  rgrid_fft(workspace4);
-
-  /* 2nd term: c convolute(F H) */
-  rgrid_fft_convolute(workspace4, otf->gaussian_tf, workspace4);
-  rgrid_inverse_fft_norm2(workspace4);
-  rgrid_multiply(workspace4, c);
-  grid_add_real_to_complex_re(potential, workspace4);
+  /* Accumulate H = (d/dy) \rho * J */
+  rgrid_add_scaled_product(acc_h, 1.0, workspace1, workspace3);
 
-  /* workspace1 (grad rho), workspace3 (J) */
+  /* workspace3 (J) */
 
   /*** 3rd term ***/
   
   /* -c J . convolute((d/dy)F \rho) */
-
-  rgrid_fft_convolute(workspace2, otf->gaussian_y_tf, rho_tf);
+  dft_common_bandlimit_convolute(workspace2, rho_tf, otf->gaussian_y_tf, otf->gaussian_kmax);
   rgrid_inverse_fft_norm2(workspace2);
   rgrid_product(workspace2, workspace2, workspace3);
   rgrid_multiply(workspace2, -c);
@@ -604,9 +1299,13 @@ static inline void dft_ot_add_nonlocal_correlation_potential_y(dft_ot_functional
 /*
  * Z component to nonlocal correlation potential.
  *
+ * acc_fg = Sum of ((d/dz)F) . G (1st term) accumulated here (Fourier space).
+ * acc_h  = Sum of H = (d/dz) \rho * J (2nd term) accumulated here (real space).
+ * The 3rd term is added directly to potential.
+ *
  */
 
-static inline void dft_ot_add_nonlocal_correlation_potential_z(dft_ot_functional *otf, cgrid *potential, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3, rgrid *workspace4) {
+static inline void dft_ot_add_nonlocal_correlation_potential_z(dft_ot_functional *otf, rgrid *rho, rgrid *rho_tf, rgrid *rho_st, rgrid *acc_fg, rgrid *acc_h, cgrid *potential, rgrid *workspace1, rgrid *workspace2, rgrid *workspace3) {
 
   REAL c;
 
@@ -619,43 +1318,30 @@ static inline void dft_ot_add_nonlocal_correlation_potential_z(dft_ot_functional
   /*** 1st term ***/
 
   /* Construct workspace2 = FFT(G) = FFT((d/dz) \rho(r_1) * (1 - \tilde{\rho(r_1)} / \rho_{0s})) */
-  rgrid_product(workspace2, workspace1, rho_st);
+  rgrid_product(workspace2, workspace1, rho_st); // rho_st = (1 - \tilde{\rho(r_1)} / \rho_{0s})
   rgrid_fft(workspace2);
 
-  /* 1st term: c convolute [((d/dz) F) . G] */
-  rgrid_fft_convolute(workspace3, otf->gaussian_z_tf, workspace2);
-  rgrid_inverse_fft_norm2(workspace3);
-  rgrid_product(workspace3, workspace3, rho_st);
-  rgrid_multiply(workspace3, c);
-
-  grid_add_real_to_complex_re(potential, workspace3);  
+  /* 1st term: accumulate [((d/dz) F) . G] */
+  dft_common_bandlimit_convolute(workspace3, workspace2, otf->gaussian_z_tf, otf->gaussian_kmax);
+  rgrid_fft_sum(acc_fg, acc_fg, workspace3);
 
   /* in use: workspace1 (grad rho), workspace2 (FFT(G)) */
 
   /*** 2nd term ***/
   
   /* Construct workspace3 = J = convolution(F G) */
-  rgrid_fft_convolute(workspace3, otf->gaussian_tf, workspace2);
+  dft_common_bandlimit_convolute(workspace3, workspace2, otf->gaussian_tf, otf->gaussian_kmax);
   rgrid_inverse_fft_norm2(workspace3);
 
-  /* Construct workspace4 = FFT(H) = FFT((d/dz) \rho * J) */
-  rgrid_copy(workspace4, workspace3);
-  rgrid_product(workspace4, workspace1, workspace4);
-  rgrid_fft(workspace4);
+  /* Accumulate H = (d/dz) \rho * J */
+  rgrid_add_scaled_product(acc_h, 1.0, workspace1, workspace3);
 
-  /* 2nd term: c convolute(F H) */
-  rgrid_fft_convolute(workspace4, otf->gaussian_tf, workspace4);
-  rgrid_inverse_fft_norm2(workspace4);
-  rgrid_multiply(workspace4, c);
-  grid_add_real_to_complex_re(potential, workspace4);
-
-  /* workspace1 (grad rho), workspace3 (J) */
+  /* workspace3 (J) */
 
   /*** 3rd term ***/
   
   /* -c J . convolute((d/dz)F \rho) */
-
-  rgrid_fft_convolute(workspace2, otf->gaussian_z_tf, rho_tf);
+  dft_common_bandlimit_convolute(workspace2, rho_tf, otf->gaussian_z_tf, otf->gaussian_kmax);
   rgrid_inverse_fft_norm2(workspace2);
   rgrid_product(workspace2, workspace2, workspace3);
   rgrid_multiply(workspace2, -c);
@@ -712,7 +1398,7 @@ EXPORT void dft_ot_backflow_potential(dft_ot_functional *otf, cgrid *potential,
   else
     rgrid_copy(workspace1, density);   /* Original BF code (without the MM density cutoff), just rho */
   rgrid_fft(workspace1);
-  rgrid_fft_convolute(workspace1, workspace1, otf->backflow_pot);
+  dft_common_bandlimit_convolute(workspace1, workspace1, otf->backflow_pot, otf->backflow_kmax);
   rgrid_inverse_fft_norm2(workspace1);
 
   /* Calculate C (workspace2) [scalar] */
@@ -727,7 +1413,7 @@ EXPORT void dft_ot_backflow_potential(dft_ot_functional *otf, cgrid *potential,
   else
     rgrid_product(workspace2, workspace2, density);  /* orignal: multiply by just rho */
   rgrid_fft(workspace2);
-  rgrid_fft_convolute(workspace2, workspace2, otf->backflow_pot);
+  dft_common_bandlimit_convolute(workspace2, workspace2, otf->backflow_pot, otf->backflow_kmax);
   rgrid_inverse_fft_norm2(workspace2);
 
   /* Calculate B (workspace3 (B_x), workspace4 (B_y), workspace5 (B_z)) [vector] */
@@ -738,7 +1424,7 @@ EXPORT void dft_ot_backflow_potential(dft_ot_functional *otf, cgrid *potential,
     else
       rgrid_product(workspace3, veloc_x, density); /* original: just rho */
     rgrid_fft(workspace3);
-    rgrid_fft_convolute(workspace3, workspace3, otf->backflow_pot);
+    dft_common_bandlimit_convolute(workspace3, workspace3, otf->backflow_pot, otf->backflow_kmax);
     rgrid_inverse_fft_norm2(workspace3);
   
     /* B_Y */
@@ -747,7 +1433,7 @@ EXPORT void dft_ot_backflow_potential(dft_ot_functional *otf, cgrid *potential,
     else
       rgrid_product(workspace4, veloc_y, density); /* original: just rho */
     rgrid_fft(workspace4);
-    rgrid_fft_convolute(workspace4, workspace4, otf->backflow_pot);
+    dft_common_bandlimit_convolute(workspace4, workspace4, otf->backflow_pot, otf->backflow_kmax);
     rgrid_inverse_fft_norm2(workspace4);
   }
 
@@ -757,7 +1443,7 @@ EXPORT void dft_ot_backflow_potential(dft_ot_functional *otf, cgrid *potential,
   else
     rgrid_product(workspace5, veloc_z, density); /* original: just rho */
   rgrid_fft(workspace5);
-  rgrid_fft_convolute(workspace5, workspace5, otf->backflow_pot);
+  dft_common_bandlimit_convolute(workspace5, workspace5, otf->backflow_pot, otf->backflow_kmax);
   rgrid_inverse_fft_norm2(workspace5);
 
   /* 1. Calculate the real part of the potential */
@@ -59,6 +59,17 @@
 #define DFT_ZERO       2097152
 #define DFT_GP2        4194304
 
+/*
+ * Nonlocal terms that can be evaluated on a coarse grid (see dft_ot_coarse_alloc()):
+ *
+ * DFT_OT_COARSE_LJ  Lennard-Jones.
+ * DFT_OT_COARSE_BF  Backflow.
+ *
+ */
+
+#define DFT_OT_COARSE_LJ 1
+#define DFT_OT_COARSE_BF 2
+
 /*
  * Structures.
  *
@@ -68,6 +79,47 @@ typedef struct bf_struct {
   REAL g11, g12, g21, g22, a1, a2;
 } dft_ot_bf;
 
+typedef struct dft_ot_coarse_struct {
+  INT factor;                             /* Grid step multiplier for the coarse grid */
+  INT terms;                              /* Terms evaluated on the coarse grid (DFT_OT_COARSE_LJ, DFT_OT_COARSE_BF) */
+  struct dft_ot_functional_struct *otf;   /* Functional on the coarse grid (truncated kernels and workspaces) */
+  wf *gwf;                                /* Wave function on the coarse grid (BF only) */
+  rgrid *lj;                              /* LJ potential accumulated on the coarse grid */
+  cgrid *potential;                       /* Potential accumulated on the coarse grid (BF only) */
+  cgrid *cworkspace;                      /* Complex workspace on the fine grid (BF only) */
+  REAL lj_tail;                           /* Max. |V_LJ(k)| / |V_LJ(0)| outside the coarse grid band */
+  REAL bf_tail;                           /* Max. |V_j(k)| / |V_j(0)| outside the coarse grid band */
+  REAL bf_error;                          /* Relative L2 error of the coarse BF potential for a smooth test state */
+  char shared;                            /* 1 = kernels belong to another coarse structure (see dft_ot_coarse_clone()) */
+} dft_ot_coarse;
+
+/*
+ * Kernel set (Fourier space) shared between functionals that have the same grid
+ * and kernel parameters. Managed by dft_ot_alloc() / dft_ot_free().
+ *
+ */
+
+typedef struct dft_ot_kernels_struct {
+  INT refcount;                      /* Number of functionals using this kernel set */
+  INT nx, ny, nz;                    /* Grid dimensions */
+  REAL step, x0, y0, z0;             /* Grid step and origin */
+  INT min_substeps, max_substeps;    /* Substeps used in mapping the kernels */
+  INT flags;                         /* Model bits that affect the kernels (DFT_DR, DFT_OT_KC, DFT_OT_BACKFLOW) */
+  REAL b;                            /* Lennard-Jones integral (used for scaling) */
+  dft_common_lj lj_params;           /* Lennard-Jones parameters */
+  REAL radius;                       /* Spherical average radius */
+  REAL l_g;                          /* Gaussian width (KC) */
+  dft_ot_bf bf_params;               /* Backflow parameters */
+  rgrid *lennard_jones;              /* Kernels (see dft_ot_functional) */
+  rgrid *spherical_avg;
+  rgrid *gaussian_tf;
+  rgrid *gaussian_x_tf;
+  rgrid *gaussian_y_tf;
+  rgrid *gaussian_z_tf;
+  rgrid *backflow_pot;
+  struct dft_ot_kernels_struct *next; /* Next kernel set in the registry */
+} dft_ot_kernels;
+
 /*
  *
  * Original Orsay-Trento functional: Phys. Rev. B 52, 1192 (1995).
@@ -87,6 +139,39 @@ typedef struct bf_struct {
  *     + BACKFLOW
  */
 
+/* Terms that can be lagged (see dft_ot_lag_enable()) */
+#define DFT_OT_LAG_KC 1         /* Non-local kinetic energy correlation */
+#define DFT_OT_LAG_BF 2         /* Backflow */
+
+/* Cache for the lagged refresh of the expensive non-local terms */
+typedef struct dft_ot_lag_struct {
+  char terms;               /* Lagged terms (DFT_OT_LAG_KC | DFT_OT_LAG_BF) */
+  INT interval;             /* Refresh the cached terms at least every interval calls */
+  REAL threshold;           /* Refresh also when || rho - rho_lag || / || rho_lag || > threshold (<= 0 = not used) */
+  INT count;                /* Number of calls since the last refresh */
+  char refresh;             /* 1 = refresh at the next call */
+  cgrid *potential;         /* Cached potential from the lagged terms */
+  rgrid *density;           /* Density at the last refresh (rho_lag) */
+} dft_ot_lag;
+
+/* Tabulated bulk equation of state (see dft_ot_eos_enable()) */
+#define DFT_OT_EOS_N0   256     /* Initial number of points in the tables */
+#define DFT_OT_EOS_NMAX 65536   /* Maximum number of points in the tables */
+
+typedef struct dft_ot_eos_struct {
+  INT n;                    /* Number of points in the density table */
+  REAL rho_min, rho_max;    /* Density range */
+  REAL h;                   /* Density step */
+  REAL *p, *dp;             /* Pressure and dP/drho at the density points */
+  REAL *mu, *dmu;           /* Chemical potential and dmu/drho at the density points */
+  INT np;                   /* Number of points in the pressure (inverse) table */
+  REAL p_min, p_max;        /* Pressure range where P(rho) is monotonic */
+  REAL hp;                  /* Pressure step */
+  REAL *rho, *drho;         /* Density and drho/dP at the pressure points */
+  REAL error;               /* Estimated maximum relative interpolation error */
+  REAL tol;                 /* Requested relative tolerance */
+} dft_ot_eos;
+
 typedef struct dft_ot_functional_struct {   /* All values in atomic units */
   INT model;                /* Functional DFT_OT_* (Orsay-Trento), DFT_DR (Dupont-Roc), DFT_GP (Gross-Pitaevskii) */
   REAL b;                   /* Lennard-Jones integral value for bulk (not used in functional) */
@@ -110,6 +195,8 @@ typedef struct dft_ot_functional_struct {   /* All values in atomic units */
   rgrid *gaussian_y_tf;     /* Grid holding Fourier transformed derivative of gaussian F (dF/dy; kinetic correlation) */ 
   rgrid *gaussian_z_tf;     /* Grid holding Fourier transformed derivative of gaussian F (dF/dz; kinetic correlation) */ 
   rgrid *backflow_pot;      /* Grid holding Fourier transformed bacflow function (V_j) */
+  REAL gaussian_kmax;       /* Effective support of the gaussian kernels in k-space (-1 = no band limit) */
+  REAL backflow_kmax;       /* Effective support of the backflow kernel in k-space (-1 = no band limit) */
   REAL beta;                /* High density correction parameter \beta */
   REAL rhom;                /* High density correction parameter \rho_m */
   REAL C;                   /* High density correction parameter C */
@@ -127,8 +214,163 @@ typedef struct dft_ot_functional_struct {   /* All values in atomic units */
   rgrid *workspace8;        /* Workspace 8 */
   rgrid *workspace9;        /* Workspace 9 */
   rgrid *density;           /* Liquid density */
+  dft_ot_coarse *coarse;    /* Coarse grid evaluation of LJ/BF (NULL = full resolution) */
+  dft_ot_kernels *kernels;  /* Shared kernel set holding the kernel grids above (NULL = kernels owned by this structure) */
+  dft_ot_lag *lag;          /* Lagged refresh of KC/BF terms (NULL = always evaluated) */
+  REAL *lj_table;           /* Cached radial Fourier transform of the LJ kernel (NULL = not computed yet; see helium-ot-bulk.c) */
+  dft_common_lj lj_table_params; /* LJ parameters used for lj_table */
+  dft_ot_eos *eos;          /* Tabulated bulk equation of state (NULL = evaluated directly) */
+  dft_coupling *coupling;   /* Receives FFT(rho) from dft_ot_potential() (NULL = none; see dft_coupling_attach()) */
 } dft_ot_functional;
 
+/*
+ * Evaluation context for dft_ot_potential_context(): holds the density and the workspaces
+ * so that one dft_ot_functional (kernels) can be used by several threads at the same time.
+ *
+ */
+
+typedef struct dft_ot_context_struct {
+  rgrid *density;           /* Liquid density */
+  rgrid *workspace1;        /* Workspace 1 (these may be NULL if not needed by the functional) */
+  rgrid *workspace2;        /* Workspace 2 */
+  rgrid *workspace3;        /* Workspace 3 */
+  rgrid *workspace4;        /* Workspace 4 */
+  rgrid *workspace5;        /* Workspace 5 */
+  rgrid *workspace6;        /* Workspace 6 */
+  rgrid *workspace7;        /* Workspace 7 */
+  rgrid *workspace8;        /* Workspace 8 */
+  rgrid *workspace9;        /* Workspace 9 */
+  dft_ot_coarse *coarse;    /* Coarse grid workspaces (NULL if coarse grid evaluation not in use) */
+  dft_coupling *coupling;   /* Receives FFT(rho) (NULL = none) */
+  char owner;               /* 1 = grids allocated by dft_ot_context_alloc(), 0 = grids belong to otf */
+} dft_ot_context;
+
+/* Acceleration methods for the ground state driver (see dft_ot_ground_state()) */
+#define DFT_DRIVER_ACCEL_NONE     0   /* Plain imaginary time propagation */
+#define DFT_DRIVER_ACCEL_NESTEROV 1   /* Nesterov momentum extrapolation */
+#define DFT_DRIVER_ACCEL_ANDERSON 2   /* Anderson (Pulay) mixing of the imaginary time map */
+#define DFT_DRIVER_ANDERSON_MAX   8   /* Maximum Anderson history length */
+#define DFT_DRIVER_COARSE_TOL     10.0 /* Multiplier for the convergence tolerances on coarse levels (dft_ot_ground_state_multilevel()) */
+
+/* Parameters and results for the ground state drivers (dft_ot_ground_state() and dft_ot_minimize()) */
+typedef struct dft_ot_driver_struct {
+  REAL step;                /* Imaginary time step (atomic units; initial value, adjusted during the run) */
+  REAL min_step, max_step;  /* Limits for the time step */
+  REAL step_grow;           /* Multiplier for the time step when the energy keeps decreasing (> 1) */
+  REAL step_shrink;         /* Multiplier for the time step when the energy increases (< 1) */
+  char accel;               /* Acceleration method (DFT_DRIVER_ACCEL_*) */
+  REAL momentum;            /* Nesterov momentum parameter (0 <= momentum < 1) */
+  INT anderson_depth;       /* Anderson history length (<= DFT_DRIVER_ANDERSON_MAX) */
+  REAL anderson_beta;       /* Anderson mixing parameter */
+  REAL mu0;                 /* Chemical potential (used when natoms <= 0) */
+  REAL natoms;              /* If > 0, keep the number of atoms fixed at this value (mu0 not used) */
+  INT max_iter;             /* Maximum number of iterations */
+  INT check;                /* Energy, step and convergence checks every check iterations */
+  REAL energy_tol;          /* Convergence: change in (E - mu N) / N between checks (<= 0 disables) */
+  REAL residual_tol;        /* Convergence: || (H - mu) psi || / || psi || (<= 0 disables) */
+  rgrid *ext_pot;           /* Static external potential (NULL if none) */
+  void (*extpot)(void *, cgrid *, wf *, INT); /* Callback adding a (time dependent) external potential (NULL if none) */
+  void *extpot_arg;         /* First argument to extpot() */
+  REAL precond;             /* dft_ot_minimize(): preconditioner energy shift (<= 0: automatic) */
+  char verbose;             /* Print progress at each check */
+  /* Results */
+  INT iterations;           /* Number of iterations done */
+  REAL energy;              /* Total energy */
+  REAL residual;            /* Last residual estimate */
+  char converged;           /* 1 = converged, 0 = not converged */
+} dft_ot_driver;
+
+/* Self-consistent propagator for the OT potential (see ot-propagate.c) */
+typedef struct dft_ot_propagator_struct {
+  dft_ot_functional *otf;   /* Functional used for the non-linear potential */
+  wf *gwfp;                 /* Predicted wave function (workspace) */
+  cgrid *potential;         /* Potential at the beginning of the time step */
+  cgrid *potential2;        /* Potential at the predicted wave function */
+  cgrid *predict;           /* Copy of the predicted wave function (NULL = not kept; see dft_ot_propagate_adaptive()) */
+  rgrid *ext_pot;           /* Static external potential (NULL if none) */
+  void (*extpot)(void *, cgrid *, wf *, INT); /* Callback adding a time dependent external potential (NULL if none) */
+  void *extpot_arg;         /* First argument to extpot() */
+  REAL mu0;                 /* Chemical potential (subtracted from the potential) */
+  INT correct;              /* Number of corrector iterations (>= 1) */
+  INT iter;                 /* Number of time steps taken */
+} dft_ot_propagator;
+
+/* Adaptive time step control for dft_ot_propagate() (see dft_ot_propagate_adaptive()) */
+typedef struct dft_ot_stepper_struct {
+  REAL dt;                  /* Current time step (atomic units) */
+  REAL min_dt, max_dt;      /* Limits for the time step */
+  REAL tol;                 /* Tolerance for the local error estimate || psi(t + dt) - psi* || / || psi || */
+  REAL norm_tol;            /* Tolerance for the relative norm drift per step (<= 0 = not checked) */
+  REAL energy_tol;          /* Tolerance for the relative energy drift since the start or last step reduction (<= 0 = not checked) */
+  INT energy_check;         /* Check energy drift every energy_check accepted steps */
+  REAL safety;              /* Safety factor for the new step length (< 1) */
+  REAL grow_max;            /* Maximum growth factor for the step length per step */
+  REAL shrink_min;          /* Minimum shrink factor for the step length per step */
+  REAL time;                /* Current time */
+  REAL error;               /* Last local error estimate */
+  REAL energy0;             /* Reference energy for the drift check */
+  INT accepted, rejected;   /* Numbers of accepted and rejected steps */
+  FILE *log;                /* Log file for accepted steps (NULL = no log) */
+  cgrid *save;              /* Wave function at the beginning of the step */
+  rgrid *density, *edens;   /* Workspaces for the energy (allocated on first use) */
+} dft_ot_stepper;
+
+/* Checkpoint storage modes (see checkpoint.c) */
+#define DFT_CHECKPOINT_DOUBLE 0     /* Lossless */
+#define DFT_CHECKPOINT_FLOAT  1     /* Single precision */
+#define DFT_CHECKPOINT_LOSSY  2     /* Quantized with absolute error bound */
+#define DFT_CHECKPOINT_MAXNAME 512  /* Maximum length of checkpoint file names */
+
+/* Checkpoint writer (opaque; see checkpoint.c) */
+typedef struct dft_checkpoint_struct dft_checkpoint;
+
+/* Cached LJ Fourier transform used by dft_ot_bulk_dispersion() and dft_ot_bulk_istatic() */
+#define DFT_OT_LJ_TABLE_N    4096   /* Number of points in the table */
+#define DFT_OT_LJ_TABLE_KMAX 8.0    /* Largest k in the table (Bohr^-1); evaluated directly above this */
+
+/* Energy components (see dft_ot_energy_terms_eval()) */
+typedef struct dft_ot_energy_terms_struct {
+  REAL lj;        /* Lennard-Jones */
+  REAL c2;        /* C2 correlation term */
+  REAL c3;        /* C3 correlation term */
+  REAL hd;        /* High density correction (DFT_OT_HD / DFT_OT_HD2) */
+  REAL thermal;   /* Ideal gas (thermal models) */
+  REAL kc;        /* Non-local kinetic energy correlation (DFT_OT_KC) */
+  REAL bf;        /* Backflow (DFT_OT_BACKFLOW) */
+  REAL gp;        /* Gross-Pitaevskii (DFT_GP / DFT_GP2) */
+  REAL total;     /* Sum of all the above (= integral of dft_ot_energy_density()) */
+} dft_ot_energy_terms;
+
+/* Observables for the analysis bundle (see analysis.c) */
+#define DFT_ANALYSIS_OCC_AVG 1      /* Average occupation of |k| shells */
+#define DFT_ANALYSIS_OCC_TOT 2      /* Total occupation of |k| shells */
+#define DFT_ANALYSIS_KE      4      /* Kinetic energy spectra (total, incompressible, compressible) and KE decomposition */
+#define DFT_ANALYSIS_FLUX    8      /* Probability flux and total vorticity */
+#define DFT_ANALYSIS_ENERGY  16     /* Total energy (OT + kinetic) */
+
+/* Analysis bundle */
+typedef struct dft_analysis_struct {
+  INT what;                 /* Requested observables (DFT_ANALYSIS_*) */
+  INT nbins;                /* Number of bins in the spectra */
+  REAL binstep;             /* Bin width in k */
+  REAL eps;                 /* Epsilon for dividing by the density */
+  REAL *occ_avg;            /* Average occupation of |k| shells (DFT_ANALYSIS_OCC_AVG) */
+  REAL *occ_tot;            /* Total occupation of |k| shells (DFT_ANALYSIS_OCC_TOT) */
+  REAL *ke, *ke_incomp, *ke_comp; /* Kinetic energy spectra (energy / k; DFT_ANALYSIS_KE) */
+  REAL natoms;              /* Number of atoms */
+  REAL ke_total;            /* Total kinetic energy */
+  REAL ke_cl;               /* Classical kinetic energy (m/2) rho v^2 (DFT_ANALYSIS_KE) */
+  REAL ke_qp;               /* Quantum pressure kinetic energy = ke_total - ke_cl (DFT_ANALYSIS_KE) */
+  REAL ke_incomp_total, ke_comp_total; /* Incompressible and compressible parts of ke_cl (DFT_ANALYSIS_KE) */
+  REAL vorticity;           /* Integral of |curl J| (DFT_ANALYSIS_FLUX) */
+  REAL energy;              /* Total energy (DFT_ANALYSIS_ENERGY) */
+  rgrid *density;           /* Density */
+  rgrid *flux_x, *flux_y, *flux_z; /* Probability flux (DFT_ANALYSIS_FLUX or DFT_ANALYSIS_KE) */
+  rgrid *wx, *wy, *wz;      /* sqrt(rho) v (DFT_ANALYSIS_KE; Fourier space after dft_analysis_compute()) */
+  rgrid *work;              /* Workspace */
+  cgrid *psik;              /* Wave function in Fourier space */
+} dft_analysis;
+
 /* Prototypes (automatically generated) */
 #include "proto.h"
 
@@ -142,6 +384,9 @@ typedef struct dft_ot_functional_struct {   /* All values in atomic units */
 /* Use special 1D OT-DFT code? */
 #define DFT_OT_1D
 
+/* Default relative tolerance for the k-space support of KC and BF kernels (see dft_ot_bandlimit()) */
+#define DFT_OT_BANDLIMIT_TOL 1E-10
+
 /* Smallest density for evaluating velocity */
 #define DFT_EPS 1E-5
 
@@ -0,0 +1,523 @@
+/*
+ * Asynchronous snapshot writer for real and complex grids.
+ *
+ * dft_snapshot_rgrid() / dft_snapshot_cgrid() copy the grid (optionally
+ * downsampled and/or converted to single precision) into one of the staging
+ * buffers and return immediately. A background thread writes the buffers to
+ * disk in the order they were submitted. When all staging buffers are in use,
+ * the caller waits until the writer frees one (backpressure), so the memory
+ * use is bounded by depth staging buffers.
+ *
+ * File format (native byte order):
+ *   char[8]  "DFTSNAP1"
+ *   int64    nx, ny, nz       (after downsampling)
+ *   int64    type             (0 = real, 1 = complex)
+ *   int64    precision        (4 = float, 8 = double)
+ *   double   step, x0, y0, z0 (after downsampling; the origin is adjusted so that
+ *                              the stored points keep their positions)
+ *   data     (i * ny + j) * nz + k ordering, complex values as (re, im) pairs
+ *
+ * Use dft_snapshot_read_rgrid() / dft_snapshot_read_cgrid() to read the files.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <math.h>
+#include <grid/grid.h>
+#include <grid/au.h>
+#include "dft.h"
+#include "ot.h"
+
+#define DFT_SNAPSHOT_MAGIC "DFTSNAP1"
+
+/* Staging buffer states */
+#define DFT_SNAPSHOT_FREE    0
+#define DFT_SNAPSHOT_FILLING 1
+#define DFT_SNAPSHOT_READY   2
+
+typedef struct dft_snapshot_slot_struct {
+  char state;               /* DFT_SNAPSHOT_FREE, DFT_SNAPSHOT_FILLING or DFT_SNAPSHOT_READY */
+  char file[DFT_SNAPSHOT_MAXNAME]; /* Output file name */
+  int64_t header[5];        /* nx, ny, nz, type, precision */
+  double geom[4];           /* step, x0, y0, z0 */
+  void *data;               /* Staging buffer */
+  size_t size;              /* Allocated size of the staging buffer (bytes) */
+  size_t bytes;             /* Number of bytes to write */
+} dft_snapshot_slot;
+
+struct dft_snapshot_struct {
+  INT depth;                /* Number of staging buffers */
+  INT downsample;           /* Keep every downsample-th point along each axis */
+  char flags;               /* DFT_SNAPSHOT_FLOAT */
+  dft_snapshot_slot *slots; /* Staging buffers (ring) */
+  INT head;                 /* Next slot to be written by the writer thread */
+  INT tail;                 /* Next slot to be filled */
+  INT errors;               /* Number of failed writes */
+  char stop;                /* Request the writer thread to exit */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+/*
+ * Writer thread.
+ *
+ */
+
+static void *dft_snapshot_writer(void *arg) {
+
+  dft_snapshot *snap = (dft_snapshot *) arg;
+  dft_snapshot_slot *slot;
+  FILE *fp;
+  char ok;
+
+  while(1) {
+    pthread_mutex_lock(&snap->lock);
+    while(snap->slots[snap->head].state != DFT_SNAPSHOT_READY && !snap->stop)
+      pthread_cond_wait(&snap->cond, &snap->lock);
+    if(snap->slots[snap->head].state != DFT_SNAPSHOT_READY) { /* stop requested and queue empty */
+      pthread_mutex_unlock(&snap->lock);
+      break;
+    }
+    slot = &snap->slots[snap->head];
+    pthread_mutex_unlock(&snap->lock);
+
+    ok = 0;
+    if((fp = fopen(slot->file, "w"))) {
+      ok = fwrite(DFT_SNAPSHOT_MAGIC, 8, 1, fp) == 1 && fwrite(slot->header, sizeof(int64_t), 5, fp) == 5
+        && fwrite(slot->geom, sizeof(double), 4, fp) == 4 && fwrite(slot->data, 1, slot->bytes, fp) == slot->bytes;
+      if(fclose(fp)) ok = 0;
+    }
+    if(!ok) fprintf(stderr, "libdft: Error writing snapshot file %s.\n", slot->file);
+
+    pthread_mutex_lock(&snap->lock);
+    if(!ok) snap->errors++;
+    slot->state = DFT_SNAPSHOT_FREE;
+    snap->head = (snap->head + 1) % snap->depth;
+    pthread_cond_broadcast(&snap->cond);
+    pthread_mutex_unlock(&snap->lock);
+  }
+  return NULL;
+}
+
+/*
+ * Allocate snapshot writer and start the writer thread.
+ *
+ * depth      = Number of staging buffers, i.e., maximum number of snapshots waiting to be written (input; INT).
+ * downsample = Keep every downsample-th point along each axis (1 = full grid) (input; INT).
+ * flags      = DFT_SNAPSHOT_FLOAT: store values in single precision; 0: double precision (input; char).
+ *
+ * Returns pointer to the snapshot writer or NULL on error.
+ *
+ */
+
+EXPORT dft_snapshot *dft_snapshot_alloc(INT depth, INT downsample, char flags) {
+
+  dft_snapshot *snap;
+  INT i;
+
+  if(depth < 1) depth = 1;
+  if(downsample < 1) downsample = 1;
+  if(!(snap = (dft_snapshot *) malloc(sizeof(dft_snapshot))) || !(snap->slots = (dft_snapshot_slot *) malloc(sizeof(dft_snapshot_slot) * (size_t) depth))) {
+    fprintf(stderr, "libdft: Error in dft_snapshot_alloc(): Could not allocate memory.\n");
+    return NULL;
+  }
+  for(i = 0; i < depth; i++) {
+    snap->slots[i].state = DFT_SNAPSHOT_FREE;
+    snap->slots[i].data = NULL;
+    snap->slots[i].size = 0;
+  }
+  snap->depth = depth;
+  snap->downsample = downsample;
+  snap->flags = flags;
+  snap->head = snap->tail = 0;
+  snap->errors = 0;
+  snap->stop = 0;
+  pthread_mutex_init(&snap->lock, NULL);
+  pthread_cond_init(&snap->cond, NULL);
+  if(pthread_create(&snap->thread, NULL, dft_snapshot_writer, snap)) {
+    fprintf(stderr, "libdft: Error in dft_snapshot_alloc(): Could not start writer thread.\n");
+    pthread_mutex_destroy(&snap->lock);
+    pthread_cond_destroy(&snap->cond);
+    free(snap->slots);
+    free(snap);
+    return NULL;
+  }
+  return snap;
+}
+
+/*
+ * Wait until all submitted snapshots have been written.
+ *
+ * snap = Snapshot writer (input; dft_snapshot *).
+ *
+ * Returns the number of failed writes so far.
+ *
+ */
+
+EXPORT INT dft_snapshot_flush(dft_snapshot *snap) {
+
+  INT i, errors;
+
+  pthread_mutex_lock(&snap->lock);
+  for(i = 0; i < snap->depth; i++)
+    while(snap->slots[i].state != DFT_SNAPSHOT_FREE)
+      pthread_cond_wait(&snap->cond, &snap->lock);
+  errors = snap->errors;
+  pthread_mutex_unlock(&snap->lock);
+  return errors;
+}
+
+/*
+ * Write all pending snapshots, stop the writer thread and free the snapshot writer.
+ *
+ * snap = Snapshot writer (input; dft_snapshot *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_snapshot_free(dft_snapshot *snap) {
+
+  INT i;
+
+  if(!snap) return;
+  dft_snapshot_flush(snap);
+  pthread_mutex_lock(&snap->lock);
+  snap->stop = 1;
+  pthread_cond_broadcast(&snap->cond);
+  pthread_mutex_unlock(&snap->lock);
+  pthread_join(snap->thread, NULL);
+  pthread_mutex_destroy(&snap->lock);
+  pthread_cond_destroy(&snap->cond);
+  for(i = 0; i < snap->depth; i++)
+    if(snap->slots[i].data) free(snap->slots[i].data);
+  free(snap->slots);
+  free(snap);
+}
+
+/*
+ * Reserve a staging buffer of given size (waits for a free buffer).
+ *
+ */
+
+static dft_snapshot_slot *dft_snapshot_reserve(dft_snapshot *snap, char *file, size_t bytes) {
+
+  dft_snapshot_slot *slot;
+
+  pthread_mutex_lock(&snap->lock);
+  while(snap->slots[snap->tail].state != DFT_SNAPSHOT_FREE)
+    pthread_cond_wait(&snap->cond, &snap->lock);
+  slot = &snap->slots[snap->tail];
+  slot->state = DFT_SNAPSHOT_FILLING;
+  snap->tail = (snap->tail + 1) % snap->depth;
+  pthread_mutex_unlock(&snap->lock);
+
+  if(slot->size < bytes) {
+    if(slot->data) free(slot->data);
+    if(!(slot->data = malloc(bytes))) {
+      fprintf(stderr, "libdft: Error in dft_snapshot: Could not allocate staging buffer.\n");
+      exit(1);
+    }
+    slot->size = bytes;
+  }
+  slot->bytes = bytes;
+  strncpy(slot->file, file, DFT_SNAPSHOT_MAXNAME - 1);
+  slot->file[DFT_SNAPSHOT_MAXNAME - 1] = 0;
+  return slot;
+}
+
+/*
+ * Origin of the downsampled axis (n points -> nd points, every ds-th kept) such that
+ * coarse point i is at the position of fine point i * ds. With x = (i - n/2) step - x0
+ * this requires x0' = x0 + (n/2 - (nd/2) ds) step.
+ *
+ */
+
+static REAL dft_snapshot_origin(INT n, INT nd, INT ds, REAL step, REAL x0) {
+
+  return x0 + ((REAL) (n / 2 - (nd / 2) * ds)) * step;
+}
+
+/*
+ * Hand a filled staging buffer to the writer thread.
+ *
+ */
+
+static void dft_snapshot_submit(dft_snapshot *snap, dft_snapshot_slot *slot) {
+
+  pthread_mutex_lock(&snap->lock);
+  slot->state = DFT_SNAPSHOT_READY;
+  pthread_cond_broadcast(&snap->cond);
+  pthread_mutex_unlock(&snap->lock);
+}
+
+/*
+ * Submit real grid for writing. Returns as soon as the grid has been copied to a staging buffer.
+ *
+ * snap = Snapshot writer (input; dft_snapshot *).
+ * grid = Grid to be written (input; rgrid *). Must be in real space.
+ * file = Output file name (input; char *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_snapshot_rgrid(dft_snapshot *snap, rgrid *grid, char *file) {
+
+  INT ds = snap->downsample, nx = grid->nx, ny = grid->ny, nz = grid->nz, nz2 = grid->nz2;
+  INT nxd = (nx + ds - 1) / ds, nyd = (ny + ds - 1) / ds, nzd = (nz + ds - 1) / ds, i, j, k, ij, idx;
+  char sp = (snap->flags & DFT_SNAPSHOT_FLOAT)?1:0;
+  dft_snapshot_slot *slot;
+  REAL *value;
+  float *fdst;
+  double *ddst;
+
+  slot = dft_snapshot_reserve(snap, file, (size_t) (nxd * nyd * nzd) * (sp?sizeof(float):sizeof(double)));
+  slot->header[0] = nxd; slot->header[1] = nyd; slot->header[2] = nzd;
+  slot->header[3] = 0; slot->header[4] = sp?4:8;
+  slot->geom[0] = grid->step * (REAL) ds;
+  slot->geom[1] = dft_snapshot_origin(nx, nxd, ds, grid->step, grid->x0);
+  slot->geom[2] = dft_snapshot_origin(ny, nyd, ds, grid->step, grid->y0);
+  slot->geom[3] = dft_snapshot_origin(nz, nzd, ds, grid->step, grid->z0);
+  fdst = (float *) slot->data;
+  ddst = (double *) slot->data;
+
+#ifdef GRID_MGPU
+  rgrid_host_lock(grid);
+#endif
+  value = grid->value;
+#pragma omp parallel for firstprivate(nxd,nyd,nzd,ds,ny,nz2,value,fdst,ddst,sp) private(i,j,k,ij,idx) default(none) schedule(runtime)
+  for(ij = 0; ij < nxd * nyd; ij++) {
+    i = ij / nyd;
+    j = ij % nyd;
+    for(k = 0; k < nzd; k++) {
+      idx = ((i * ds) * ny + j * ds) * nz2 + k * ds;
+      if(sp) fdst[ij * nzd + k] = (float) value[idx];
+      else ddst[ij * nzd + k] = (double) value[idx];
+    }
+  }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(grid);
+#endif
+
+  dft_snapshot_submit(snap, slot);
+}
+
+/*
+ * Submit complex grid (e.g., wave function) for writing. Returns as soon as the grid has been
+ * copied to a staging buffer.
+ *
+ * snap = Snapshot writer (input; dft_snapshot *).
+ * grid = Grid to be written (input; cgrid *). Must be in real space.
+ * file = Output file name (input; char *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_snapshot_cgrid(dft_snapshot *snap, cgrid *grid, char *file) {
+
+  INT ds = snap->downsample, nx = grid->nx, ny = grid->ny, nz = grid->nz;
+  INT nxd = (nx + ds - 1) / ds, nyd = (ny + ds - 1) / ds, nzd = (nz + ds - 1) / ds, i, j, k, ij, idx, odx;
+  char sp = (snap->flags & DFT_SNAPSHOT_FLOAT)?1:0;
+  dft_snapshot_slot *slot;
+  REAL complex *value;
+  float *fdst;
+  double *ddst;
+
+  slot = dft_snapshot_reserve(snap, file, (size_t) (2 * nxd * nyd * nzd) * (sp?sizeof(float):sizeof(double)));
+  slot->header[0] = nxd; slot->header[1] = nyd; slot->header[2] = nzd;
+  slot->header[3] = 1; slot->header[4] = sp?4:8;
+  slot->geom[0] = grid->step * (REAL) ds;
+  slot->geom[1] = dft_snapshot_origin(nx, nxd, ds, grid->step, grid->x0);
+  slot->geom[2] = dft_snapshot_origin(ny, nyd, ds, grid->step, grid->y0);
+  slot->geom[3] = dft_snapshot_origin(nz, nzd, ds, grid->step, grid->z0);
+  fdst = (float *) slot->data;
+  ddst = (double *) slot->data;
+
+#ifdef GRID_MGPU
+  cgrid_host_lock(grid);
+#endif
+  value = grid->value;
+#pragma omp parallel for firstprivate(nxd,nyd,nzd,ds,ny,nz,value,fdst,ddst,sp) private(i,j,k,ij,idx,odx) default(none) schedule(runtime)
+  for(ij = 0; ij < nxd * nyd; ij++) {
+    i = ij / nyd;
+    j = ij % nyd;
+    for(k = 0; k < nzd; k++) {
+      idx = ((i * ds) * ny + j * ds) * nz + k * ds;
+      odx = 2 * (ij * nzd + k);
+      if(sp) {
+        fdst[odx] = (float) CREAL(value[idx]);
+        fdst[odx + 1] = (float) CIMAG(value[idx]);
+      } else {
+        ddst[odx] = (double) CREAL(value[idx]);
+        ddst[odx + 1] = (double) CIMAG(value[idx]);
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  cgrid_host_unlock(grid);
+#endif
+
+  dft_snapshot_submit(snap, slot);
+}
+
+/*
+ * Read snapshot header. Returns the file pointer positioned at the data (NULL on error).
+ *
+ */
+
+static FILE *dft_snapshot_open(char *file, int64_t *header, double *geom) {
+
+  FILE *fp;
+  char magic[8];
+
+  if(!(fp = fopen(file, "r"))) {
+    fprintf(stderr, "libdft: Can't open snapshot file %s.\n", file);
+    return NULL;
+  }
+  if(fread(magic, 8, 1, fp) != 1 || memcmp(magic, DFT_SNAPSHOT_MAGIC, 8) || fread(header, sizeof(int64_t), 5, fp) != 5
+     || fread(geom, sizeof(double), 4, fp) != 4 || (header[4] != 4 && header[4] != 8)) {
+    fprintf(stderr, "libdft: %s is not a snapshot file.\n", file);
+    fclose(fp);
+    return NULL;
+  }
+  return fp;
+}
+
+/*
+ * Read n values (float or double) from a snapshot file into val.
+ * buf must hold n doubles. Returns 1 on success and 0 on error.
+ *
+ */
+
+static char dft_snapshot_values(FILE *fp, int64_t prec, INT n, REAL *val, void *buf) {
+
+  INT i;
+
+  if(fread(buf, (size_t) prec, (size_t) n, fp) != (size_t) n) return 0;
+  if(prec == 4)
+    for(i = 0; i < n; i++) val[i] = (REAL) ((float *) buf)[i];
+  else
+    for(i = 0; i < n; i++) val[i] = (REAL) ((double *) buf)[i];
+  return 1;
+}
+
+/*
+ * Read real grid written by dft_snapshot_rgrid().
+ *
+ * file = File name (input; char *).
+ *
+ * Returns a newly allocated grid (NULL on error).
+ *
+ */
+
+EXPORT rgrid *dft_snapshot_read_rgrid(char *file) {
+
+  FILE *fp;
+  int64_t header[5];
+  double geom[4];
+  rgrid *grid;
+  INT i, j, k;
+  REAL *row;
+  void *buf;
+
+  if(!(fp = dft_snapshot_open(file, header, geom))) return NULL;
+  if(header[3] != 0) {
+    fprintf(stderr, "libdft: Snapshot file %s does not contain a real grid.\n", file);
+    fclose(fp);
+    return NULL;
+  }
+  grid = rgrid_alloc((INT) header[0], (INT) header[1], (INT) header[2], (REAL) geom[0], RGRID_PERIODIC_BOUNDARY, 0, "snapshot");
+  rgrid_set_origin(grid, (REAL) geom[1], (REAL) geom[2], (REAL) geom[3]);
+  if(!(row = (REAL *) malloc(sizeof(REAL) * (size_t) grid->nz)) || !(buf = malloc(sizeof(double) * (size_t) grid->nz))) {
+    fprintf(stderr, "libdft: Error in dft_snapshot_read_rgrid(): Could not allocate memory.\n");
+    exit(1);
+  }
+#ifdef GRID_MGPU
+  rgrid_host_lock(grid);
+#endif
+  for(i = 0; i < grid->nx; i++)
+    for(j = 0; j < grid->ny; j++) {
+      if(!dft_snapshot_values(fp, header[4], grid->nz, row, buf)) {
+        fprintf(stderr, "libdft: Snapshot file %s is truncated.\n", file);
+        fclose(fp);
+        free(row); free(buf);
+#ifdef GRID_MGPU
+        rgrid_host_unlock(grid);
+#endif
+        rgrid_free(grid);
+        return NULL;
+      }
+      for(k = 0; k < grid->nz; k++)
+        grid->value[(i * grid->ny + j) * grid->nz2 + k] = row[k];
+    }
+#ifdef GRID_MGPU
+  rgrid_host_unlock(grid);
+#endif
+  free(row); free(buf);
+  fclose(fp);
+  return grid;
+}
+
+/*
+ * Read complex grid written by dft_snapshot_cgrid().
+ *
+ * file = File name (input; char *).
+ *
+ * Returns a newly allocated grid (NULL on error).
+ *
+ */
+
+EXPORT cgrid *dft_snapshot_read_cgrid(char *file) {
+
+  FILE *fp;
+  int64_t header[5];
+  double geom[4];
+  cgrid *grid;
+  INT i, j, k;
+  REAL *row;
+  void *buf;
+
+  if(!(fp = dft_snapshot_open(file, header, geom))) return NULL;
+  if(header[3] != 1) {
+    fprintf(stderr, "libdft: Snapshot file %s does not contain a complex grid.\n", file);
+    fclose(fp);
+    return NULL;
+  }
+  grid = cgrid_alloc((INT) header[0], (INT) header[1], (INT) header[2], (REAL) geom[0], CGRID_PERIODIC_BOUNDARY, 0, "snapshot");
+  cgrid_set_origin(grid, (REAL) geom[1], (REAL) geom[2], (REAL) geom[3]);
+  if(!(row = (REAL *) malloc(sizeof(REAL) * (size_t) (2 * grid->nz))) || !(buf = malloc(sizeof(double) * (size_t) (2 * grid->nz)))) {
+    fprintf(stderr, "libdft: Error in dft_snapshot_read_cgrid(): Could not allocate memory.\n");
+    exit(1);
+  }
+#ifdef GRID_MGPU
+  cgrid_host_lock(grid);
+#endif
+  for(i = 0; i < grid->nx; i++)
+    for(j = 0; j < grid->ny; j++) {
+      if(!dft_snapshot_values(fp, header[4], 2 * grid->nz, row, buf)) {
+        fprintf(stderr, "libdft: Snapshot file %s is truncated.\n", file);
+        fclose(fp);
+        free(row); free(buf);
+#ifdef GRID_MGPU
+        cgrid_host_unlock(grid);
+#endif
+        cgrid_free(grid);
+        return NULL;
+      }
+      for(k = 0; k < grid->nz; k++)
+        grid->value[(i * grid->ny + j) * grid->nz + k] = row[2 * k] + I * row[2 * k + 1];
+    }
+#ifdef GRID_MGPU
+  cgrid_host_unlock(grid);
+#endif
+  free(row); free(buf);
+  fclose(fp);
+  return grid;
+}
@@ -0,0 +1,499 @@
+/*
+ * Vortex line detection.
+ *
+ * The phase winding of the wave function is computed around each grid plaquette
+ * (sum of the wrapped phase differences along the four edges divided by 2 pi).
+ * A non-zero winding means that a vortex line pierces the plaquette. The lines
+ * live on the dual lattice: cell (i, j, k) is centered at (i + 1/2, j + 1/2, k + 1/2)
+ * and a pierced plaquette connects the two cells sharing it. The sign of the
+ * winding gives the direction of the line (right-hand rule for the circulation).
+ *
+ * The cells containing line segments are collected into a sorted list, labeled
+ * into connected components by union-find (parallel over slabs of x planes,
+ * followed by merging across the slab boundaries) and the points of each
+ * component are then ordered into lines by following the line direction
+ * (parallel over the components). Periodic boundaries are assumed.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <grid/grid.h>
+#include <grid/au.h>
+#include "dft.h"
+#include "ot.h"
+
+#define DFT_VORTEX_SLAB 4   /* Number of x planes in one union-find slab */
+
+/* Cell faces: -x, +x, -y, +y, -z, +z */
+static const INT dft_vortex_di[6] = {-1, 1, 0, 0, 0, 0};
+static const INT dft_vortex_dj[6] = {0, 0, -1, 1, 0, 0};
+static const INT dft_vortex_dk[6] = {0, 0, 0, 0, -1, 1};
+
+/*
+ * Phase winding around plaquette a -> b -> c -> d -> a. Zero if the density at all corners is below rho_min.
+ *
+ */
+
+static inline signed char dft_vortex_winding(REAL complex a, REAL complex b, REAL complex c, REAL complex d, REAL rho_min) {
+
+  REAL complex t;
+  REAL s;
+
+  if(CREAL(a * CONJ(a)) < rho_min && CREAL(b * CONJ(b)) < rho_min && CREAL(c * CONJ(c)) < rho_min && CREAL(d * CONJ(d)) < rho_min) return 0;
+  t = b * CONJ(a);
+  s = ATAN2(CIMAG(t), CREAL(t));
+  t = c * CONJ(b);
+  s += ATAN2(CIMAG(t), CREAL(t));
+  t = d * CONJ(c);
+  s += ATAN2(CIMAG(t), CREAL(t));
+  t = a * CONJ(d);
+  s += ATAN2(CIMAG(t), CREAL(t));
+  return (signed char) FLOOR(s / (2.0 * M_PI) + 0.5);
+}
+
+/*
+ * Position of cell with grid index idx in the sorted cell list (-1 if not a line cell).
+ * Only the cells on the same x plane (list entries lo ... hi - 1) need to be searched.
+ *
+ */
+
+static INT dft_vortex_lookup(INT *cell, INT lo, INT hi, INT idx) {
+
+  INT mid, end = hi;
+
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(cell[mid] < idx) lo = mid + 1;
+    else hi = mid;
+  }
+  if(lo == end || cell[lo] != idx) return -1;
+  return lo;
+}
+
+/*
+ * Union-find: root (with path halving).
+ *
+ */
+
+static INT dft_vortex_find(INT *parent, INT a) {
+
+  while(parent[a] != a) {
+    parent[a] = parent[parent[a]];
+    a = parent[a];
+  }
+  return a;
+}
+
+/*
+ * Union-find: merge (the smaller index becomes the root).
+ *
+ */
+
+static void dft_vortex_union(INT *parent, INT a, INT b) {
+
+  a = dft_vortex_find(parent, a);
+  b = dft_vortex_find(parent, b);
+  if(a < b) parent[b] = a;
+  else if(b < a) parent[a] = b;
+}
+
+/*
+ * Neighbor of cell c (list position) through face f (list position; -1 if not a line cell).
+ *
+ */
+
+static INT dft_vortex_neighbor(INT *cell, INT *plane, INT nx, INT ny, INT nz, INT c, INT f) {
+
+  INT i, j, k, idx = cell[c];
+
+  i = idx / (ny * nz);
+  j = (idx / nz) % ny;
+  k = idx % nz;
+  i = (i + dft_vortex_di[f] + nx) % nx;
+  j = (j + dft_vortex_dj[f] + ny) % ny;
+  k = (k + dft_vortex_dk[f] + nz) % nz;
+  return dft_vortex_lookup(cell, plane[i], plane[i+1], (i * ny + j) * nz + k);
+}
+
+/*
+ * Detect vortex lines in a wave function.
+ *
+ * psi     = Wave function (input; cgrid *).
+ * rho_min = Plaquettes with density below this value at all corners are ignored (input; REAL).
+ *           This excludes the noisy phase outside the liquid (e.g., droplets or bubbles)
+ *           and should be well below the density next to the vortex cores.
+ * stride  = Separation of the points used for the curvature (input; INT). The points are
+ *           one grid step apart along the lines and the discrete curvature is evaluated
+ *           from points m - stride, m and m + stride, which smooths the lattice steps.
+ *           Typically of the order of the vortex core size in grid steps.
+ *
+ * Returns pointer to the vortex line structure (free with dft_vortex_free()).
+ * The structure contains the ordered points of each line along with the line lengths
+ * and curvature statistics.
+ *
+ */
+
+EXPORT dft_vortex *dft_vortex_trace(cgrid *psi, REAL rho_min, INT stride) {
+
+  INT nx = psi->nx, ny = psi->ny, nz = psi->nz, nyz = ny * nz, i, j, k, ii, jj, kk, f, m, n, c, s, nslab, ncells, ncomp, nlines;
+  INT *plane, *cell, *parent, *comp, *cstart, *order, *pos, *from, *next_line;
+  signed char *w, *face, fc[6];
+  char *visited;
+  REAL complex *val;
+  INT len, cnt, kcount = 0;
+  REAL step = psi->step, dx, dy, dz, ax, ay, az, bx, by, bz, cx, cy, cz, la, lb, lc, kap, csum, lsum, *p, *q, *shift;
+  REAL ksum = 0.0, k2sum = 0.0, kmax = 0.0;
+  dft_vortex *vort;
+
+  if(stride < 1) stride = 1;
+
+  /* 1. Plaquette windings: w[3 * idx + 0] (normal x), w[3 * idx + 1] (normal y), w[3 * idx + 2] (normal z) at lower corner idx */
+  if(!(w = (signed char *) malloc(sizeof(signed char) * 3 * (size_t) (nx * nyz))) || !(plane = (INT *) malloc(sizeof(INT) * (size_t) (nx + 1)))) {
+    fprintf(stderr, "libdft: Error in dft_vortex_trace(): Could not allocate memory.\n");
+    exit(1);
+  }
+#ifdef GRID_MGPU
+  cgrid_host_lock(psi);
+#endif
+  val = psi->value;
+#pragma omp parallel for firstprivate(nx,ny,nz,nyz,val,w,rho_min) private(i,j,k,ii,jj,kk) default(none) schedule(runtime)
+  for(i = 0; i < nx; i++) {
+    ii = (i + 1) % nx;
+    for(j = 0; j < ny; j++) {
+      jj = (j + 1) % ny;
+      for(k = 0; k < nz; k++) {
+        kk = (k + 1) % nz;
+        /* normal x: y -> z */
+        w[3 * (i * nyz + j * nz + k)] = dft_vortex_winding(val[i * nyz + j * nz + k], val[i * nyz + jj * nz + k], val[i * nyz + jj * nz + kk], val[i * nyz + j * nz + kk], rho_min);
+        /* normal y: z -> x */
+        w[3 * (i * nyz + j * nz + k) + 1] = dft_vortex_winding(val[i * nyz + j * nz + k], val[i * nyz + j * nz + kk], val[ii * nyz + j * nz + kk], val[ii * nyz + j * nz + k], rho_min);
+        /* normal z: x -> y */
+        w[3 * (i * nyz + j * nz + k) + 2] = dft_vortex_winding(val[i * nyz + j * nz + k], val[ii * nyz + j * nz + k], val[ii * nyz + jj * nz + k], val[i * nyz + jj * nz + k], rho_min);
+      }
+    }
+  }
+#ifdef GRID_MGPU
+  cgrid_host_unlock(psi);
+#endif
+
+  /* 2. Line cells (any pierced face) and their outgoing windings through the six faces */
+#pragma omp parallel for firstprivate(nx,ny,nz,nyz,w,plane) private(i,j,k,ii,jj,kk,n) default(none) schedule(runtime)
+  for(i = 0; i < nx; i++) {
+    ii = (i + 1) % nx;
+    n = 0;
+    for(j = 0; j < ny; j++) {
+      jj = (j + 1) % ny;
+      for(k = 0; k < nz; k++) {
+        kk = (k + 1) % nz;
+        if(w[3 * (i * nyz + j * nz + k)] || w[3 * (ii * nyz + j * nz + k)] || w[3 * (i * nyz + j * nz + k) + 1] || w[3 * (i * nyz + jj * nz + k) + 1]
+           || w[3 * (i * nyz + j * nz + k) + 2] || w[3 * (i * nyz + j * nz + kk) + 2]) n++;
+      }
+    }
+    plane[i + 1] = n;
+  }
+  plane[0] = 0;
+  for(i = 0; i < nx; i++)
+    plane[i + 1] += plane[i];
+  ncells = plane[nx];
+
+  if(!(cell = (INT *) malloc(sizeof(INT) * (size_t) (ncells + 1))) || !(face = (signed char *) malloc(sizeof(signed char) * 6 * (size_t) (ncells + 1)))) {
+    fprintf(stderr, "libdft: Error in dft_vortex_trace(): Could not allocate memory.\n");
+    exit(1);
+  }
+#pragma omp parallel for firstprivate(nx,ny,nz,nyz,w,plane,cell,face) private(i,j,k,ii,jj,kk,n,fc) default(none) schedule(runtime)
+  for(i = 0; i < nx; i++) {
+    ii = (i + 1) % nx;
+    n = plane[i];
+    for(j = 0; j < ny; j++) {
+      jj = (j + 1) % ny;
+      for(k = 0; k < nz; k++) {
+        kk = (k + 1) % nz;
+        /* Positive = line leaves the cell through the face */
+        fc[0] = (signed char) -w[3 * (i * nyz + j * nz + k)];
+        fc[1] = w[3 * (ii * nyz + j * nz + k)];
+        fc[2] = (signed char) -w[3 * (i * nyz + j * nz + k) + 1];
+        fc[3] = w[3 * (i * nyz + jj * nz + k) + 1];
+        fc[4] = (signed char) -w[3 * (i * nyz + j * nz + k) + 2];
+        fc[5] = w[3 * (i * nyz + j * nz + kk) + 2];
+        if(fc[0] || fc[1] || fc[2] || fc[3] || fc[4] || fc[5]) {
+          memcpy(face + 6 * n, fc, 6);
+          cell[n] = i * nyz + j * nz + k;
+          n++;
+        }
+      }
+    }
+  }
+  free(w);
+
+  /* 3. Connected components: union-find within slabs of x planes in parallel, then across slab boundaries */
+  if(!(parent = (INT *) malloc(sizeof(INT) * (size_t) (ncells + 1))) || !(comp = (INT *) malloc(sizeof(INT) * (size_t) (ncells + 1)))) {
+    fprintf(stderr, "libdft: Error in dft_vortex_trace(): Could not allocate memory.\n");
+    exit(1);
+  }
+  nslab = (nx + DFT_VORTEX_SLAB - 1) / DFT_VORTEX_SLAB;
+#pragma omp parallel for firstprivate(nx,ny,nz,nslab,plane,cell,face,parent) private(s,c,f,n,i) default(none) schedule(dynamic)
+  for(s = 0; s < nslab; s++) {
+    for(c = plane[s * DFT_VORTEX_SLAB]; c < plane[(s + 1) * DFT_VORTEX_SLAB < nx ? (s + 1) * DFT_VORTEX_SLAB : nx]; c++)
+      parent[c] = c;
+    for(c = plane[s * DFT_VORTEX_SLAB]; c < plane[(s + 1) * DFT_VORTEX_SLAB < nx ? (s + 1) * DFT_VORTEX_SLAB : nx]; c++) {
+      i = cell[c] / (ny * nz);
+      for(f = 1; f < 6; f += 2) {   /* each face is the + face of exactly one cell */
+        if(!face[6 * c + f]) continue;
+        if(f == 1 && ((i + 1) % DFT_VORTEX_SLAB == 0 || i + 1 == nx)) continue;   /* crosses slab boundary */
+        if((n = dft_vortex_neighbor(cell, plane, nx, ny, nz, c, f)) >= 0) dft_vortex_union(parent, c, n);
+      }
+    }
+  }
+  for(s = 0; s < nslab; s++) {
+    i = ((s + 1) * DFT_VORTEX_SLAB < nx ? (s + 1) * DFT_VORTEX_SLAB : nx) - 1;   /* last plane of the slab */
+    for(c = plane[i]; c < plane[i + 1]; c++)
+      if(face[6 * c + 1] && (n = dft_vortex_neighbor(cell, plane, nx, ny, nz, c, 1)) >= 0) dft_vortex_union(parent, c, n);
+  }
+  /* Roots are the smallest members, so the components are numbered in order of appearance */
+  ncomp = 0;
+  for(c = 0; c < ncells; c++) {
+    n = dft_vortex_find(parent, c);
+    if(n == c) comp[c] = ncomp++;
+    else comp[c] = comp[n];
+  }
+  free(parent);
+
+  /* 4. Order the points: members of each component (counting sort) */
+  if(!(cstart = (INT *) malloc(sizeof(INT) * (size_t) (ncomp + 1))) || !(order = (INT *) malloc(sizeof(INT) * (size_t) (ncells + 1)))
+     || !(pos = (INT *) malloc(sizeof(INT) * (size_t) (ncomp + 1))) || !(from = (INT *) malloc(sizeof(INT) * (size_t) (ncells + 1)))
+     || !(visited = (char *) malloc(sizeof(char) * (size_t) (ncells + 1))) || !(next_line = (INT *) malloc(sizeof(INT) * (size_t) (ncells + 1)))) {
+    fprintf(stderr, "libdft: Error in dft_vortex_trace(): Could not allocate memory.\n");
+    exit(1);
+  }
+  for(m = 0; m <= ncomp; m++)
+    cstart[m] = 0;
+  for(c = 0; c < ncells; c++)
+    cstart[comp[c] + 1]++;
+  for(m = 0; m < ncomp; m++)
+    cstart[m + 1] += cstart[m];
+  memcpy(pos, cstart, sizeof(INT) * (size_t) (ncomp + 1));
+  for(c = 0; c < ncells; c++)
+    order[pos[comp[c]]++] = c;
+  memset(visited, 0, (size_t) (ncells + 1));
+
+  /*
+   * Walk along the line direction within each component. The points of component m
+   * occupy entries cstart[m] ... cstart[m+1] - 1 of the output (from[] holds the cells
+   * in walk order) and next_line[] marks the first point of each line (1 = start of open line,
+   * 2 = start of closed line, 0 = continuation).
+   *
+   */
+#pragma omp parallel for firstprivate(ncomp,cstart,order,face,cell,plane,nx,ny,nz,visited,from,next_line) private(m,n,c,f,s,i,j) default(none) schedule(dynamic)
+  for(m = 0; m < ncomp; m++) {
+    n = cstart[m];
+    while(n < cstart[m + 1]) {
+      /* Start from an unvisited cell without an incoming face (open end); otherwise any unvisited cell */
+      c = -1;
+      for(i = cstart[m]; i < cstart[m + 1]; i++) {
+        if(visited[order[i]]) continue;
+        if(c < 0) c = order[i];
+        for(f = 0; f < 6; f++)
+          if(face[6 * order[i] + f] < 0 && (j = dft_vortex_neighbor(cell, plane, nx, ny, nz, order[i], f)) >= 0 && !visited[j]) break;
+        if(f == 6) {
+          c = order[i];
+          break;
+        }
+      }
+      s = c;
+      j = n;   /* first point of the line */
+      next_line[n] = 1;
+      while(1) {
+        visited[c] = 1;
+        from[n++] = c;
+        for(f = 0; f < 6; f++)
+          if(face[6 * c + f] > 0 && (i = dft_vortex_neighbor(cell, plane, nx, ny, nz, c, f)) >= 0 && !visited[i]) break;
+        if(f == 6) break;
+        next_line[n] = 0;
+        c = i;
+      }
+      /* Closed if the last point connects back to the first */
+      for(f = 0; f < 6; f++)
+        if(face[6 * c + f] > 0 && dft_vortex_neighbor(cell, plane, nx, ny, nz, c, f) == s) break;
+      if(f < 6 && c != s) next_line[j] = 2;
+    }
+  }
+  free(order);
+  free(pos);
+  free(visited);
+  free(comp);
+
+  /* 5. Output: coordinates (continuous along the line), lengths and curvatures */
+  nlines = 0;
+  for(n = 0; n < ncells; n++)
+    if(next_line[n]) nlines++;
+  if(!(vort = (dft_vortex *) malloc(sizeof(dft_vortex))) || !(vort->points = (REAL *) malloc(sizeof(REAL) * 3 * (size_t) (ncells + 1)))
+     || !(vort->start = (INT *) malloc(sizeof(INT) * (size_t) (nlines + 1))) || !(vort->closed = (char *) malloc(sizeof(char) * (size_t) (nlines + 1)))
+     || !(vort->component = (INT *) malloc(sizeof(INT) * (size_t) (nlines + 1))) || !(vort->length = (REAL *) malloc(sizeof(REAL) * (size_t) (nlines + 1)))
+     || !(vort->curvature = (REAL *) malloc(sizeof(REAL) * (size_t) (nlines + 1)))) {
+    fprintf(stderr, "libdft: Error in dft_vortex_trace(): Could not allocate memory.\n");
+    exit(1);
+  }
+  vort->npoints = ncells;
+  vort->nlines = nlines;
+  vort->ncomponents = ncomp;
+  vort->nloops = 0;
+  nlines = 0;
+  for(m = 0; m < ncomp; m++)
+    for(n = cstart[m]; n < cstart[m + 1]; n++)
+      if(next_line[n]) {
+        vort->start[nlines] = n;
+        vort->closed[nlines] = (char) (next_line[n] == 2);
+        if(next_line[n] == 2) vort->nloops++;
+        vort->component[nlines++] = m;
+      }
+  vort->start[nlines] = ncells;
+  free(cstart);
+
+  /* shift[] = periodic image shift of the first point after going around a closed line (non-zero if it winds around the box) */
+  if(!(shift = (REAL *) malloc(sizeof(REAL) * 3 * (size_t) (nlines + 1)))) {
+    fprintf(stderr, "libdft: Error in dft_vortex_trace(): Could not allocate memory.\n");
+    exit(1);
+  }
+  p = vort->points;
+  for(m = 0; m < nlines; m++) {
+    vort->length[m] = 0.0;
+    for(n = vort->start[m]; n <= vort->start[m + 1]; n++) {
+      if(n == vort->start[m + 1] && !vort->closed[m]) break;
+      c = cell[from[(n == vort->start[m + 1])?vort->start[m]:n]];
+      i = c / nyz;
+      j = (c / nz) % ny;
+      k = c % nz;
+      if(n == vort->start[m]) {
+        p[3 * n] = (((REAL) (i - nx / 2)) + 0.5) * step - psi->x0;
+        p[3 * n + 1] = (((REAL) (j - ny / 2)) + 0.5) * step - psi->y0;
+        p[3 * n + 2] = (((REAL) (k - nz / 2)) + 0.5) * step - psi->z0;
+        continue;
+      }
+      /* Minimum image step from the previous point */
+      c = cell[from[n - 1]];
+      ii = i - c / nyz;
+      jj = j - (c / nz) % ny;
+      kk = k - c % nz;
+      if(ii > nx / 2) ii -= nx;
+      if(ii < -nx / 2) ii += nx;
+      if(jj > ny / 2) jj -= ny;
+      if(jj < -ny / 2) jj += ny;
+      if(kk > nz / 2) kk -= nz;
+      if(kk < -nz / 2) kk += nz;
+      dx = p[3 * (n - 1)] + ((REAL) ii) * step;
+      dy = p[3 * (n - 1) + 1] + ((REAL) jj) * step;
+      dz = p[3 * (n - 1) + 2] + ((REAL) kk) * step;
+      vort->length[m] += step * SQRT((REAL) (ii * ii + jj * jj + kk * kk));
+      if(n == vort->start[m + 1]) {   /* closing step back to the first point */
+        shift[3 * m] = dx - p[3 * vort->start[m]];
+        shift[3 * m + 1] = dy - p[3 * vort->start[m] + 1];
+        shift[3 * m + 2] = dz - p[3 * vort->start[m] + 2];
+      } else {
+        p[3 * n] = dx;
+        p[3 * n + 1] = dy;
+        p[3 * n + 2] = dz;
+      }
+    }
+    if(!vort->closed[m]) shift[3 * m] = shift[3 * m + 1] = shift[3 * m + 2] = 0.0;
+  }
+  free(cell);
+  free(face);
+  free(from);
+  free(next_line);
+  free(plane);
+
+  /*
+   * Curvature from points n - stride, n and n + stride (Menger curvature 4 A / (|a| |b| |c|)).
+   * For closed lines the indices wrap around (with the periodic image shift);
+   * for open lines only the interior points are included. The lattice length computed above
+   * is replaced by the length along the chords between points n and n + stride.
+   *
+   */
+#pragma omp parallel for firstprivate(vort,stride,shift) private(m,n,i,j,s,q,len,cnt,csum,lsum,ax,ay,az,bx,by,bz,cx,cy,cz,la,lb,lc,kap) reduction(+:ksum,k2sum,kcount) reduction(max:kmax) default(none) schedule(dynamic)
+  for(m = 0; m < vort->nlines; m++) {
+    q = vort->points + 3 * vort->start[m];
+    len = vort->start[m + 1] - vort->start[m];
+    csum = lsum = 0.0;
+    cnt = 0;
+    for(n = 0; n < len; n++) {
+      i = n - stride;
+      j = n + stride;
+      if(!vort->closed[m] && j >= len) break;
+      bx = q[3 * n];
+      by = q[3 * n + 1];
+      bz = q[3 * n + 2];
+      s = j % len;
+      cx = q[3 * s];
+      cy = q[3 * s + 1];
+      cz = q[3 * s + 2];
+      if(j >= len) {   /* periodic image shift when going around closed line */
+        cx += ((REAL) (j / len)) * shift[3 * m];
+        cy += ((REAL) (j / len)) * shift[3 * m + 1];
+        cz += ((REAL) (j / len)) * shift[3 * m + 2];
+      }
+      lb = SQRT((cx - bx) * (cx - bx) + (cy - by) * (cy - by) + (cz - bz) * (cz - bz));
+      lsum += lb;
+      if(i < 0 && !vort->closed[m]) continue;
+      s = ((i % len) + len) % len;
+      ax = q[3 * s];
+      ay = q[3 * s + 1];
+      az = q[3 * s + 2];
+      if(i < 0) {
+        ax -= ((REAL) ((len - 1 - i) / len)) * shift[3 * m];
+        ay -= ((REAL) ((len - 1 - i) / len)) * shift[3 * m + 1];
+        az -= ((REAL) ((len - 1 - i) / len)) * shift[3 * m + 2];
+      }
+      la = SQRT((bx - ax) * (bx - ax) + (by - ay) * (by - ay) + (bz - az) * (bz - az));
+      lc = SQRT((cx - ax) * (cx - ax) + (cy - ay) * (cy - ay) + (cz - az) * (cz - az));
+      if(la * lb * lc == 0.0) continue;
+      /* 2 A = |(b - a) x (c - a)| */
+      bx -= ax; by -= ay; bz -= az;
+      cx -= ax; cy -= ay; cz -= az;
+      kap = 2.0 * SQRT((by * cz - bz * cy) * (by * cz - bz * cy) + (bz * cx - bx * cz) * (bz * cx - bx * cz) + (bx * cy - by * cx) * (bx * cy - by * cx)) / (la * lb * lc);
+      csum += kap;
+      cnt++;
+      ksum += kap;
+      k2sum += kap * kap;
+      kcount++;
+      if(kap > kmax) kmax = kap;
+    }
+    /* Length from the chords over stride points (removes most of the lattice staircase) */
+    if(vort->closed[m]) vort->length[m] = lsum / (REAL) stride;
+    else if(len > stride) vort->length[m] = lsum * ((REAL) (len - 1)) / (((REAL) stride) * ((REAL) (len - stride)));
+    vort->curvature[m] = cnt?(csum / (REAL) cnt):0.0;
+  }
+  free(shift);
+
+  vort->total_length = 0.0;
+  for(m = 0; m < vort->nlines; m++)
+    vort->total_length += vort->length[m];
+  vort->mean_curvature = kcount?(ksum / (REAL) kcount):0.0;
+  vort->rms_curvature = kcount?SQRT(k2sum / (REAL) kcount):0.0;
+  vort->max_curvature = kmax;
+
+  return vort;
+}
+
+/*
+ * Free vortex line structure.
+ *
+ * vort = Vortex lines to be freed (input; dft_vortex *).
+ *
+ * No return value.
+ *
+ */
+
+EXPORT void dft_vortex_free(dft_vortex *vort) {
+
+  if(!vort) return;
+  free(vort->points);
+  free(vort->start);
+  free(vort->closed);
+  free(vort->component);
+  free(vort->length);
+  free(vort->curvature);
+  free(vort);
+}